@@ -1,5 +1,7 @@
 import os
 import glob
+import struct
+import numpy as np
 import pandas as pd
 from collections import defaultdict
 
@@ -102,6 +104,77 @@ def analyze_benchmark_results(workdir="."):
     return results
 
 
+def read_gathered_results(path):
+    """
+    读取 share_benchmark 以 gather=1 运行时 party 0 写出的 benchmark_gather_p*_*.bin，
+    返回 {表名: DataFrame}，包含 rounds / parties / iterations / steps / summary / critical_steps
+    """
+    with open(path, "rb") as f:
+        data = f.read()
+
+    if data[:8] != b"EMPSHARE":
+        raise ValueError(f"不是汇聚结果文件: {path}")
+    version, table_count = struct.unpack_from("<II", data, 8)
+    if version != 1:
+        raise ValueError(f"不支持的文件版本: {version}")
+    pos = 16
+
+    def read_string():
+        nonlocal pos
+        (length,) = struct.unpack_from("<H", data, pos)
+        pos += 2
+        text = data[pos : pos + length].decode()
+        pos += length
+        return text
+
+    tables = {}
+    for _ in range(table_count):
+        name = read_string()
+        column_count, row_count = struct.unpack_from("<IQ", data, pos)
+        pos += 12
+        columns = [read_string() for _ in range(column_count)]
+        values = {}
+        for column in columns:
+            values[column] = np.frombuffer(data, dtype="<i8", count=row_count, offset=pos)
+            pos += row_count * 8
+        tables[name] = pd.DataFrame(values)
+    return tables
+
+
+def analyze_workload_results(workdir="."):
+    """
+    汇总 workload=ssle 写出的 benchmark_workload_p*_id*_<label>.csv，按 label（网络配置名，守护进程模式下带运行标签）
+    与party数量统计各阶段与整个纪元的平均时间（ms）以及每秒完成的选举数，返回 DataFrame，每个 (label, party数量) 一行
+    """
+    workdir = os.path.abspath(workdir)
+    files = glob.glob(os.path.join(workdir, "benchmark_workload_p*_id*.csv"))
+    if not files:
+        print(f"未在目录 {workdir} 中找到匹配的文件 benchmark_workload_p*_id*.csv")
+        return pd.DataFrame()
+
+    frames = []
+    for file in files:
+        # 文件名 benchmark_workload_p<N>_id<k>_<label>.csv，label 本身可能含下划线
+        parts = os.path.splitext(os.path.basename(file))[0].split("_", 4)
+        label = parts[4] if len(parts) > 4 else ""
+        frames.append(pd.read_csv(file).assign(Label=label))
+    df = pd.concat(frames, ignore_index=True)
+    rows = []
+    for (label, num_parties), group in sorted(df.groupby(["Label", "NumParties"]), key=lambda x: x[0]):
+        row = {"Label": label, "NumParties": num_parties}
+        # 一个纪元的时间取最慢的参与方
+        for phase, phase_rows in group.groupby("Phase", sort=False):
+            slowest = phase_rows.groupby("Epoch")["Total_ns"].max()
+            row[f"{phase}_ms"] = round(slowest.mean() / 1e6, 3)
+        elections = group["Elections"].iloc[0]
+        row["Elections_per_s"] = round(elections * 1e3 / row["epoch_ms"], 1) if row.get("epoch_ms") else 0.0
+        rows.append(row)
+
+    result = pd.DataFrame(rows)
+    print(result.to_string(index=False))
+    return result
+
+
 def save_results_to_csv(results, output_file="analysis.csv", workdir="."):
     """
     将分析结果保存到指定工作目录中
@@ -1,371 +1,2142 @@
-#include <emp-tool/emp-tool.h>
+#include "share_engine.h"
+
 #include <vector>
 #include <string>
 #include <chrono>
 #include <map>
 #include <fstream>
 #include <iostream>
-#include <random>
 #include <iomanip>
 #include <sstream>
-#include <cassert>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <sys/prctl.h>
+
+// 选举纪元中一个阶段在收发前后的本地计算：none 不计算；hash 本方的块为对随机打开值的 SHA-256 承诺，收到后重新计算
+// 每个 32 字节的哈希；prg 本方的块为 AES PRG 的输出（洗牌后的密文），收到后对每个块异或一段新的 PRG 流（重随机化）；
+// field 本方的块为 2^61-1 上的域元素（重随机化分享），收到后把所有块按元素相加（打开）
+enum class PhaseCompute
+{
+    None,
+    Hash,
+    Prg,
+    Field
+};
+
+// 纪元中的一个阶段：每个参与方的块为 size_bytes * elections 字节，经配置的 all-gather 交换
+struct EpochPhase
+{
+    std::string name;
+    size_t size_bytes; // 每次选举本方的数据量
+    PhaseCompute compute;
+};
+
+// 默认的 SSLE 纪元：提交承诺、洗牌、重随机化分享、打开，每次选举本方的数据量按各阶段的典型大小取
+std::vector<EpochPhase> default_ssle_epoch()
+{
+    return {{"commit", 32, PhaseCompute::Hash},
+            {"shuffle", 4096, PhaseCompute::Prg},
+            {"rerandomize", 1024, PhaseCompute::Field},
+            {"reveal", 64, PhaseCompute::Hash}};
+}
+
+const char *phase_compute_name(PhaseCompute compute)
+{
+    switch (compute)
+    {
+    case PhaseCompute::Hash:
+        return "hash";
+    case PhaseCompute::Prg:
+        return "prg";
+    case PhaseCompute::Field:
+        return "field";
+    default:
+        return "none";
+    }
+}
+
+// 运行参数，配置文件中的 key=value 行与命令行参数都会写入这里；分享本身的参数在 EngineOptions 中
+struct BenchmarkOptions : EngineOptions
+{
+    int base_port = 8080;             // 参与方 i 监听 base_port + i
+    std::string transport = "socket"; // netio / socket / raw / uring / quic / shm
+    std::map<std::string, NetworkProfile> profiles = default_network_profiles();
+    int streams_override = 0;         // streams=K 覆盖所选配置的连接数
+    std::string network_mode = "lan"; // 选定的配置名，按名称实际使用的配置写入 network
+    int iterations = 10;              // 每个数据大小的测量次数（数据大小行未单独指定时）
+    int warmup = 1;                   // 每个数据大小测量前的预热次数（warmup_cv 开启时为最少次数）
+    double warmup_cv = 0;             // 继续预热直到最近 warmup_window 次的变异系数不超过该值，0 表示只做固定次数
+    int warmup_window = 5;            // 计算变异系数的预热次数
+    int warmup_max = 100;             // 预热的最多次数，达到后即使仍不平稳也开始测量
+    bool barrier = true;              // 每次计时迭代前所有参与方同步一次
+    uint64_t payload_seed = 1;        // 生成测试数据的公共种子，所有参与方必须相同
+    bool validate = true;             // 每个数据大小测完后按种子重新生成各块，校验收到的数据
+    bool gather = false;              // 测试结束后由 party 0 汇聚所有参与方的结果写入一个二进制文件
+    bool gather_csv = false;          // 汇聚时另外导出每次迭代的全局汇总CSV
+    int clock_sync_samples = 8;       // 时钟偏移估计的往返次数，取往返时间最短的一次
+    std::vector<int> batch_sizes = {1}; // 每个数据大小依次测试的合并实例数 M，配置项 batch
+    std::string overlap = "off";      // 每次迭代附带合成计算：off / serial（收齐后再算）/ async（边收边算）
+    int compute_passes = 4;           // 合成计算对每个 64 位字的混合轮数
+    size_t shm_ring_bytes = 256 * 1024; // shm 传输每条连接每个方向的环大小，配置项 shm_ring_kb
+    bool shm_link_model = false;      // shm 传输按所选网络配置模拟带宽与时延
+    bool sim_pin = true;              // shm 传输把参与方线程依次绑定到可用的 CPU 上
+    bool workload = false;            // workload=ssle：重复运行选举纪元，代替数据大小扫描
+    std::vector<EpochPhase> epoch = default_ssle_epoch(); // 纪元的各个阶段，配置项 epoch
+    int elections = 1;                // 每个纪元同时进行的选举数
+    int daemon_port = 0;              // 守护进程模式：party 0 在该端口接受协调端的运行请求，0 表示运行一次后退出
+};
+
+// 扫描中的一个数据大小
+struct SweepPoint
+{
+    size_t size_bytes;
+    int iterations = 0; // 0 表示使用 iterations 参数
+    int batch = 1;      // 合并成一次传输的独立实例数，size_bytes 为单个实例的大小，由 batch 参数展开
+};
+
+// 一次测试输出的各个文件
+struct OutputFiles
+{
+    std::string results, connection, chunks, telemetry, phases, gather, summary, warmup, workload;
+};
+
+// 文件名包含参与方数量、参与方编号（汇聚结果只由 party 0 写出，不含编号）与 label（网络配置名，守护进程模式下再加上运行的标签）
+OutputFiles output_files(int num_parties, int party_id, const std::string &label)
+{
+    auto name = [&](const std::string &prefix, bool with_id, const std::string &extension)
+    {
+        std::stringstream filename;
+        filename << prefix << "_p" << num_parties;
+        if (with_id)
+            filename << "_id" << party_id;
+        filename << "_" << label << extension;
+        return filename.str();
+    };
+    return {name("benchmark_results", true, ".csv"), name("connection", true, ".csv"),
+            name("benchmark_chunks", true, ".csv"), name("benchmark_telemetry", true, ".csv"),
+            name("benchmark_phases", true, ".csv"), name("benchmark_gather", false, ".bin"),
+            name("benchmark_summary", false, ".csv"), name("benchmark_warmup", true, ".csv"),
+            name("benchmark_workload", true, ".csv")};
+}
+
+// 数据大小默认单位为 KB，以 B 结尾时为字节（用于很小的实例）
+size_t parse_size_bytes(const std::string &token)
+{
+    if (!token.empty() && (token.back() == 'B' || token.back() == 'b'))
+        return std::stoul(token.substr(0, token.size() - 1));
+    return std::stoul(token) * 1024;
+}
+
+// 逗号分隔的正整数列表，每项可以是 <起始>-<结束>，按 2 的幂展开
+bool parse_doubling_list(const std::string &value, std::vector<int> &values)
+{
+    values.clear();
+    std::istringstream iss(value);
+    std::string token;
+    try
+    {
+        while (std::getline(iss, token, ','))
+        {
+            size_t dash = token.find('-');
+            int first = std::stoi(token.substr(0, dash));
+            int last = dash == std::string::npos ? first : std::stoi(token.substr(dash + 1));
+            if (first <= 0 || last < first)
+                return false;
+            for (long long v = first; v <= last; v *= 2)
+                values.push_back((int)v);
+        }
+    }
+    catch (const std::exception &)
+    {
+        return false;
+    }
+    return !values.empty();
+}
+
+// 解析数据大小行，每项为 <KB>、<KB>:<次数>，或 <起始KB>-<结束KB>[:<次数>] 表示按2的幂展开的区间，
+// 例如 "1-65536:20 200" 表示 1KB..64MB 每个大小测20次，再测一次 200KB；大小以 B 结尾时单位为字节，如 "64B-4096B"
+bool parse_sweep(const std::string &line, std::vector<SweepPoint> &points)
+{
+    std::istringstream iss(line);
+    std::string token;
+    while (iss >> token)
+    {
+        try
+        {
+            SweepPoint point{0, 0};
+            size_t colon = token.find(':');
+            if (colon != std::string::npos)
+            {
+                point.iterations = std::stoi(token.substr(colon + 1));
+                if (point.iterations <= 0)
+                    throw std::invalid_argument("iterations");
+                token = token.substr(0, colon);
+            }
+
+            size_t dash = token.find('-');
+            size_t first = parse_size_bytes(token.substr(0, dash));
+            size_t last = dash == std::string::npos ? first : parse_size_bytes(token.substr(dash + 1));
+            if (first == 0 || last < first)
+                throw std::invalid_argument("range");
+            for (size_t size_bytes = first; size_bytes <= last; size_bytes *= 2)
+            {
+                point.size_bytes = size_bytes;
+                points.push_back(point);
+            }
+        }
+        catch (const std::exception &)
+        {
+            std::cerr << "Invalid data size entry: " << token << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// 解析纪元的阶段列表，逗号分隔，每项为 <名称>:<大小>[:<计算>]，大小的单位同数据大小行（默认 KB，以 B 结尾时为字节），
+// 计算为 none / hash / prg / field，默认 none。例如 "commit:32B:hash,shuffle:4:prg"
+bool parse_epoch(const std::string &value, std::vector<EpochPhase> &phases)
+{
+    phases.clear();
+    std::istringstream iss(value);
+    std::string token;
+    while (std::getline(iss, token, ','))
+    {
+        try
+        {
+            size_t first = token.find(':');
+            if (first == std::string::npos || first == 0)
+                throw std::invalid_argument("name");
+            size_t second = token.find(':', first + 1);
+            EpochPhase phase{token.substr(0, first), parse_size_bytes(token.substr(first + 1, second - first - 1)),
+                             PhaseCompute::None};
+            std::string compute = second == std::string::npos ? "none" : token.substr(second + 1);
+            bool known = false;
+            for (PhaseCompute candidate : {PhaseCompute::None, PhaseCompute::Hash, PhaseCompute::Prg, PhaseCompute::Field})
+            {
+                if (compute == phase_compute_name(candidate))
+                {
+                    phase.compute = candidate;
+                    known = true;
+                }
+            }
+            // 域元素每个 8 字节
+            if (!known || phase.size_bytes == 0 || (phase.compute == PhaseCompute::Field && phase.size_bytes % 8 != 0))
+                throw std::invalid_argument("phase");
+            phases.push_back(phase);
+        }
+        catch (const std::exception &)
+        {
+            std::cerr << "Invalid epoch phase: " << token
+                      << " (expected <name>:<size>[:none|hash|prg|field], field sizes a multiple of 8 bytes)" << std::endl;
+            return false;
+        }
+    }
+    return !phases.empty();
+}
+
+bool apply_option(BenchmarkOptions &options, const std::string &key, const std::string &value)
+{
+    if (key == "base_port")
+    {
+        options.base_port = std::stoi(value);
+        return true;
+    }
+
+    if (key == "transport")
+    {
+        if (value != "netio" && value != "socket" && value != "raw" && value != "uring" && value != "quic" && value != "shm")
+        {
+            std::cerr << "Unknown transport: " << value << " (expected netio, socket, raw, uring, quic or shm)" << std::endl;
+            return false;
+        }
+#ifndef HAVE_IO_URING
+        if (value == "uring")
+        {
+            std::cerr << "transport=uring is not available: built without <linux/io_uring.h>" << std::endl;
+            return false;
+        }
+#endif
+#ifndef HAVE_MSQUIC
+        if (value == "quic")
+        {
+            std::cerr << "transport=quic is not available: built without msquic" << std::endl;
+            return false;
+        }
+#endif
+        options.transport = value;
+        return true;
+    }
+
+    if (key == "shm_ring_kb")
+    {
+        options.shm_ring_bytes = std::stoul(value) * 1024;
+        if (options.shm_ring_bytes == 0)
+        {
+            std::cerr << "shm_ring_kb must be positive" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    if (key == "shm_link_model")
+    {
+        options.shm_link_model = value == "1" || value == "true";
+        return true;
+    }
+
+    if (key == "sim_pin")
+    {
+        options.sim_pin = value == "1" || value == "true";
+        return true;
+    }
+
+    if (key == "streams")
+    {
+        options.streams_override = std::stoi(value);
+        if (options.streams_override <= 0)
+        {
+            std::cerr << "streams must be positive" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // nic_ips.<party> 是引擎参数，其余带点的 key 属于某个网络配置
+    size_t dot = key.find('.');
+    if (dot != std::string::npos && key.compare(0, dot, "nic_ips") != 0)
+        return apply_profile_option(options.profiles[key.substr(0, dot)], key.substr(dot + 1), value);
+
+    if (key == "barrier")
+    {
+        options.barrier = value == "1" || value == "true";
+        return true;
+    }
+
+    if (key == "overlap")
+    {
+        if (value != "off" && value != "serial" && value != "async")
+        {
+            std::cerr << "overlap must be off, serial or async" << std::endl;
+            return false;
+        }
+        options.overlap = value;
+        return true;
+    }
+
+    if (key == "compute_passes")
+    {
+        options.compute_passes = std::stoi(value);
+        if (options.compute_passes <= 0)
+        {
+            std::cerr << "compute_passes must be positive" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    if (key == "batch")
+    {
+        if (!parse_doubling_list(value, options.batch_sizes))
+        {
+            std::cerr << "batch must be a comma-separated list of positive counts or <first>-<last> ranges" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    if (key == "payload_seed")
+    {
+        options.payload_seed = std::stoull(value);
+        return true;
+    }
+
+    if (key == "validate")
+    {
+        options.validate = value == "1" || value == "true";
+        return true;
+    }
+
+    if (key == "gather")
+    {
+        options.gather = value == "1" || value == "true";
+        return true;
+    }
+
+    if (key == "gather_csv")
+    {
+        options.gather_csv = value == "1" || value == "true";
+        return true;
+    }
+
+    if (key == "clock_sync_samples")
+    {
+        options.clock_sync_samples = std::stoi(value);
+        if (options.clock_sync_samples <= 0)
+        {
+            std::cerr << "clock_sync_samples must be positive" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    if (key == "workload")
+    {
+        if (value != "off" && value != "ssle")
+        {
+            std::cerr << "workload must be off or ssle" << std::endl;
+            return false;
+        }
+        options.workload = value == "ssle";
+        return true;
+    }
+
+    if (key == "epoch")
+        return parse_epoch(value, options.epoch);
 
-const size_t round_count = 10;
+    if (key == "elections")
+    {
+        options.elections = std::stoi(value);
+        if (options.elections <= 0)
+        {
+            std::cerr << "elections must be positive" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    if (key == "daemon_port")
+    {
+        options.daemon_port = std::stoi(value);
+        if (options.daemon_port < 0 || options.daemon_port > 65535)
+        {
+            std::cerr << "daemon_port is out of range: " << value << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    if (key == "warmup_cv")
+    {
+        options.warmup_cv = std::stod(value);
+        if (options.warmup_cv < 0)
+        {
+            std::cerr << "warmup_cv must be non-negative" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    if (key == "warmup_window" || key == "warmup_max")
+    {
+        int count = std::stoi(value);
+        if (count < (key == "warmup_window" ? 2 : 1))
+        {
+            std::cerr << key << " is out of range: " << value << std::endl;
+            return false;
+        }
+        (key == "warmup_window" ? options.warmup_window : options.warmup_max) = count;
+        return true;
+    }
+
+    if (key == "iterations" || key == "warmup")
+    {
+        int count = std::stoi(value);
+        if (count < (key == "warmup" ? 0 : 1))
+        {
+            std::cerr << key << " is out of range: " << value << std::endl;
+            return false;
+        }
+        (key == "warmup" ? options.warmup : options.iterations) = count;
+        return true;
+    }
+
+    return apply_engine_option(options, key, value);
+}
+
+// 解析 "key=value" 形式的参数
+bool parse_option(BenchmarkOptions &options, const std::string &arg)
+{
+    size_t eq = arg.find('=');
+    if (eq == std::string::npos)
+    {
+        std::cerr << "Invalid option (expected key=value): " << arg << std::endl;
+        return false;
+    }
+
+    auto trim = [](std::string str)
+    {
+        const char *ws = " \t\r";
+        str.erase(0, str.find_first_not_of(ws));
+        str.erase(str.find_last_not_of(ws) + 1);
+        return str;
+    };
+
+    return apply_option(options, trim(arg.substr(0, eq)), trim(arg.substr(eq + 1)));
+}
+
+// 守护进程的一次运行：在启动时的参数上换用请求中的参数，数据大小与标签
+struct RunSpec
+{
+    BenchmarkOptions options;
+    std::vector<SweepPoint> sweep;
+    std::string tag; // 输出文件名的后缀
+};
+
+// 解析一行运行请求：空白分隔的 key=value，除下面可以按次更改的参数与网络配置字段（<名称>.<字段>）外，
+// 还可以有 profile=<网络配置>、sizes=<数据大小，逗号分隔，每项同数据大小行>、tag=<标签>。
+// 其余参数决定连接与缓冲区，只能在启动时指定。不合法时返回 false，error 为原因
+bool parse_run_spec(const std::string &line, const BenchmarkOptions &base, const std::vector<SweepPoint> &base_sweep,
+                    const std::string &default_tag, RunSpec &spec, std::string &error)
+{
+    static const char *const run_keys[] = {
+        "algorithm", "ports", "exchange", "chunk_kb", "streams", "telemetry", "iterations", "warmup", "warmup_cv",
+        "warmup_window", "warmup_max", "barrier", "clock_sync_samples", "batch", "overlap", "compute_passes",
+        "payload_seed", "validate", "gather", "gather_csv", "workload", "epoch", "elections"};
+
+    spec.options = base;
+    spec.sweep = base_sweep;
+    spec.tag = default_tag;
+    std::istringstream iss(line);
+    std::string token;
+    while (iss >> token)
+    {
+        size_t eq = token.find('=');
+        if (eq == std::string::npos)
+        {
+            error = "expected key=value: " + token;
+            return false;
+        }
+        std::string key = token.substr(0, eq);
+        std::string value = token.substr(eq + 1);
+        if (key == "tag")
+        {
+            // 标签进入文件名
+            if (value.empty() || value.find_first_not_of("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-.") !=
+                                     std::string::npos)
+            {
+                error = "tag may only contain letters, digits, '_', '-' and '.'";
+                return false;
+            }
+            spec.tag = value;
+            continue;
+        }
+        if (key == "profile")
+        {
+            spec.options.network_mode = value;
+            continue;
+        }
+        if (key == "sizes")
+        {
+            std::replace(value.begin(), value.end(), ',', ' ');
+            spec.sweep.clear();
+            if (!parse_sweep(value, spec.sweep) || spec.sweep.empty())
+            {
+                error = "invalid sizes: " + value;
+                return false;
+            }
+            continue;
+        }
+
+        size_t dot = key.find('.');
+        bool profile_field = dot != std::string::npos && key.compare(0, dot, "nic_ips") != 0;
+        if (!profile_field && std::find(std::begin(run_keys), std::end(run_keys), key) == std::end(run_keys))
+        {
+            error = key + " is fixed when the daemon starts";
+            return false;
+        }
+        bool applied;
+        try
+        {
+            applied = apply_option(spec.options, key, value);
+        }
+        catch (const std::exception &)
+        {
+            applied = false;
+        }
+        if (!applied)
+        {
+            error = "invalid value for " + key + ": " + value;
+            return false;
+        }
+    }
+
+    if (!spec.options.profiles.count(spec.options.network_mode))
+    {
+        error = "unknown network profile: " + spec.options.network_mode;
+        return false;
+    }
+    spec.options.network = spec.options.profiles[spec.options.network_mode];
+    if (spec.options.streams_override > 0)
+        spec.options.network.streams = spec.options.streams_override;
+    return true;
+}
+
+// 守护进程与协调端之间按行收发文本。read_line 从 fd 读出下一行（不含换行），pending 保存已读入但尚未返回的部分，
+// 连接关闭或出错时返回 false
+bool read_line(int fd, std::string &pending, std::string &line)
+{
+    for (;;)
+    {
+        size_t newline = pending.find('\n');
+        if (newline != std::string::npos)
+        {
+            line = pending.substr(0, newline);
+            pending.erase(0, newline + 1);
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            return true;
+        }
+        char buffer[4096];
+        ssize_t n = ::recv(fd, buffer, sizeof(buffer), 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        pending.append(buffer, n);
+    }
+}
+
+// 协调端已断开时写入失败，忽略，下一次读取时发现连接关闭
+void write_line(int fd, const std::string &text)
+{
+    std::string line = text + "\n";
+    for (size_t sent = 0; sent < line.size();)
+    {
+        ssize_t n = ::send(fd, line.data() + sent, line.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return;
+        sent += n;
+    }
+}
+
+// HDR 风格的对数线性直方图：[2^k, 2^(k+1)) 等分为 2^kSubBits 个桶，记录值的相对误差不超过 2^-kSubBits，
+// 内存固定，记录为 O(1)
+class LatencyHistogram
+{
+public:
+    void record(int64_t value)
+    {
+        if (value < 0)
+            return;
+        counts[bucket_index(value)]++;
+        total++;
+        max_value = std::max(max_value, value);
+    }
+
+    uint64_t count() const { return total; }
+
+    // 分位数 q（0~1）所在桶的上界，不超过记录过的最大值；没有记录时为 0
+    int64_t percentile(double q) const
+    {
+        if (total == 0)
+            return 0;
+        uint64_t rank = std::max<uint64_t>(1, (uint64_t)std::ceil(q * total));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); i++)
+        {
+            seen += counts[i];
+            if (seen >= rank)
+                return std::min(bucket_upper(i), max_value);
+        }
+        return max_value;
+    }
+
+private:
+    static constexpr int kSubBits = 7;
+    static constexpr int64_t kSubCount = int64_t(1) << kSubBits;
+
+    std::vector<uint64_t> counts = std::vector<uint64_t>((64 - kSubBits) * kSubCount, 0);
+    uint64_t total = 0;
+    int64_t max_value = 0;
+
+    // 小于 kSubCount 的值每个值一个桶；更大的值按最高位所在的段定位，段内取最高位之后的 kSubBits 位
+    static size_t bucket_index(int64_t value)
+    {
+        if (value < kSubCount)
+            return value;
+        int shift = 63 - __builtin_clzll(value) - kSubBits;
+        return (shift + 1) * kSubCount + ((value >> shift) - kSubCount);
+    }
+
+    static int64_t bucket_upper(size_t index)
+    {
+        if ((int64_t)index < kSubCount)
+            return index;
+        int shift = index / kSubCount - 1;
+        int64_t low = (int64_t)(index % kSubCount + kSubCount) << shift;
+        return low + (int64_t(1) << shift) - 1;
+    }
+};
+
+// 进程的峰值常驻内存（/proc/self/status 中的 VmHWM），单位 KB，读取失败时为 -1
+int64_t peak_rss_kb()
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+    {
+        if (line.compare(0, 6, "VmHWM:") == 0)
+            return std::stoll(line.substr(6));
+    }
+    return -1;
+}
+
+// 把峰值常驻内存重置为当前值，之后的 peak_rss_kb 只反映重置以来的峰值；内核不支持时峰值从进程启动起累计
+void reset_peak_rss()
+{
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    clear_refs << "5";
+}
+
+// 列式结果表，所有列都是 int64（时间单位为 ns），party 0 汇总各参与方的记录后写入二进制文件
+struct ColumnTable
+{
+    std::string name;
+    std::vector<std::string> columns;
+    std::vector<std::vector<int64_t>> data; // [列][行]
+
+    ColumnTable(std::string name, std::vector<std::string> columns)
+        : name(std::move(name)), columns(std::move(columns)), data(this->columns.size()) {}
+
+    void add_row(std::initializer_list<int64_t> values)
+    {
+        size_t c = 0;
+        for (int64_t value : values)
+            data[c++].push_back(value);
+    }
+
+    size_t rows() const { return data.empty() ? 0 : data[0].size(); }
+};
+
+// 二进制格式（小端）：8 字节魔数 "EMPSHARE"、u32 版本、u32 表数，之后每张表依次为
+// u16 表名长度 + 表名、u32 列数、u64 行数、每列的 u16 列名长度 + 列名，最后按列连续存放 int64 数据
+void write_column_tables(const std::string &filename, const std::vector<ColumnTable> &tables)
+{
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open())
+        throw std::runtime_error("Failed to open result file: " + filename);
+
+    auto put = [&](const auto &value)
+    { file.write(reinterpret_cast<const char *>(&value), sizeof(value)); };
+    auto put_string = [&](const std::string &text)
+    {
+        put(static_cast<uint16_t>(text.size()));
+        file.write(text.data(), text.size());
+    };
+
+    file.write("EMPSHARE", 8);
+    put(uint32_t(1));
+    put(static_cast<uint32_t>(tables.size()));
+    for (const auto &table : tables)
+    {
+        put_string(table.name);
+        put(static_cast<uint32_t>(table.columns.size()));
+        put(static_cast<uint64_t>(table.rows()));
+        for (const auto &column : table.columns)
+            put_string(column);
+        for (const auto &column : table.data)
+            file.write(reinterpret_cast<const char *>(column.data()), column.size() * sizeof(int64_t));
+    }
+    if (!file)
+        throw std::runtime_error("Failed to write result file: " + filename);
+}
+
+void write_table_csv(const std::string &filename, const ColumnTable &table)
+{
+    std::ofstream file(filename);
+    if (!file.is_open())
+    {
+        std::cerr << "Failed to open CSV file: " << filename << std::endl;
+        return;
+    }
+
+    for (size_t c = 0; c < table.columns.size(); c++)
+        file << (c ? "," : "") << table.columns[c];
+    file << std::endl;
+    for (size_t r = 0; r < table.rows(); r++)
+    {
+        for (size_t c = 0; c < table.columns.size(); c++)
+            file << (c ? "," : "") << table.data[c][r];
+        file << std::endl;
+    }
+}
+
+// 合成的本地计算，模拟收到分享后的洗牌/重随机化：对每个 64 位字做 passes 轮乘加混合并异或累积。
+// 只读不写，收到的块之后可能还要转发
+uint64_t synthetic_compute(const uint8_t *data, size_t len, int passes)
+{
+    uint64_t digest = 0;
+    for (size_t i = 0; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t))
+    {
+        uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        for (int pass = 0; pass < passes; pass++)
+            word = (word ^ (word >> 29)) * 0xbf58476d1ce4e5b9ULL + pass;
+        digest ^= word;
+    }
+    return digest;
+}
+
+// 纪元阶段的本地计算。prg 为本方私有的随机源，scratch 为按 16 字节对齐的临时区，须不小于 len
+constexpr uint64_t kMersenne61 = (uint64_t(1) << 61) - 1;
+
+// 收发之前生成本方 len 字节的块
+void prepare_phase_block(PhaseCompute compute, emp::PRG &prg, PayloadStream::Aligned16 *scratch, uint8_t *own, size_t len)
+{
+    uint8_t *random = scratch->bytes;
+    switch (compute)
+    {
+    case PhaseCompute::Hash:
+        // 每 32 字节为对一个随机打开值的承诺，最后不足 32 字节时截断
+        for (size_t offset = 0; offset < len; offset += emp::Hash::DIGEST_SIZE)
+        {
+            uint8_t digest[emp::Hash::DIGEST_SIZE];
+            prg.random_data(random, emp::Hash::DIGEST_SIZE);
+            emp::Hash::hash_once(digest, random, emp::Hash::DIGEST_SIZE);
+            std::memcpy(own + offset, digest, std::min<size_t>(emp::Hash::DIGEST_SIZE, len - offset));
+        }
+        break;
+    case PhaseCompute::Prg:
+        prg.random_data(random, (len + 15) / 16 * 16);
+        std::memcpy(own, random, len);
+        break;
+    case PhaseCompute::Field:
+        prg.random_data(random, (len + 15) / 16 * 16);
+        for (size_t offset = 0; offset < len; offset += sizeof(uint64_t))
+        {
+            uint64_t value;
+            std::memcpy(&value, random + offset, sizeof(value));
+            value &= kMersenne61;
+            value = value == kMersenne61 ? 0 : value;
+            std::memcpy(own + offset, &value, sizeof(value));
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+// 收发之后在所有 num_blocks 个 len 字节的块上计算，返回摘要，只为不让编译器省掉计算
+uint64_t process_phase_blocks(PhaseCompute compute, emp::PRG &prg, PayloadStream::Aligned16 *scratch, uint8_t *blocks,
+                              int num_blocks, size_t len)
+{
+    uint8_t *temp = scratch->bytes;
+    uint64_t digest = 0;
+    switch (compute)
+    {
+    case PhaseCompute::Hash:
+        for (int block = 0; block < num_blocks; block++)
+        {
+            for (size_t offset = 0; offset < len; offset += emp::Hash::DIGEST_SIZE)
+            {
+                uint64_t hashed[emp::Hash::DIGEST_SIZE / sizeof(uint64_t)];
+                emp::Hash::hash_once(hashed, blocks + block * len + offset,
+                                     (int)std::min<size_t>(emp::Hash::DIGEST_SIZE, len - offset));
+                digest ^= hashed[0];
+            }
+        }
+        break;
+    case PhaseCompute::Prg:
+        for (int block = 0; block < num_blocks; block++)
+        {
+            prg.random_data(temp, (len + 15) / 16 * 16);
+            combine_buffers(ReduceOp::Xor, blocks + block * len, blocks + block * len, temp, len);
+        }
+        std::memcpy(&digest, blocks, std::min(len, sizeof(digest)));
+        break;
+    case PhaseCompute::Field:
+        std::memcpy(temp, blocks, len);
+        for (int block = 1; block < num_blocks; block++)
+            combine_buffers(ReduceOp::Mersenne61, temp, temp, blocks + block * len, len);
+        std::memcpy(&digest, temp, sizeof(digest));
+        break;
+    default:
+        break;
+    }
+    return digest;
+}
 
-class ShareBenchmarkTwoRounds
+// 在 ShareEngine 上按扫描参数重复分享并记录时间：每一步的阶段耗时经 SteadyClock 写入预先分配的记录，
+// 测完后校验数据、输出CSV或由 party 0 汇聚所有参与方的结果
+template <typename IO>
+class ShareBenchmark : public ShareEngine<IO, SteadyClock>
 {
+    using Engine = ShareEngine<IO, SteadyClock>;
+    using Engine::party_id;
+    using Engine::num_parties;
+    using Engine::algorithm;
+    using Engine::steps;
+    using Engine::ios;
+    using Engine::recv_buffers;
+    using Engine::buffer_numa_node;
+    using Engine::connection_time_ms;
+    using Engine::block_checksums;
+    using Engine::seeded;
+    using Engine::seeds_out;
+    using Engine::reduce_steps;
+    using Engine::local_input;
+    using Engine::io_worker;
+    using Engine::share_data;
+    using Engine::start_share;
+    using Engine::send_control;
+    using Engine::recv_control;
+    using Engine::scatter_batch;
+    using Engine::reduce_offset;
+    using Engine::barrier;
+    using Engine::wire_bytes;
+    using Engine::input;
+    using Engine::validate_data_size;
+    using Engine::out;
+
 private:
-    int party_id;
-    int num_parties;
-    int log_n;
-    std::vector<emp::NetIO *> ios;
-    std::vector<uint8_t> recv_buffers; // 预分配的接收缓冲区
-    std::mt19937 rng_engine;
-
-    // 详细时间记录结构
+    BenchmarkOptions options;
+
+    // 一次迭代在本地单调时钟上的开始/结束时间 (ns)
+    struct IterationEvent
+    {
+        int64_t start_ns;
+        int64_t end_ns;
+        int64_t scatter_ns; // 合并多个实例时，传输结束后按实例拆回的时间（包含在开始/结束之间），单个实例时为 0
+        int64_t comm_ns;    // overlap 模式下开始到分享完成的时间，其余模式为 0
+        int64_t compute_ns; // overlap 模式下合成计算的总时间，其余模式为 0
+    };
+
+    // 详细时间记录结构。迭代与步骤的记录在测试开始前一次性分配成扁平数组，测量时只写入不分配：
+    // 第 r 轮第 i 次迭代位于 iteration_events[round_offset[r] + i]，其第 s 步位于 step_events[(round_offset[r] + i) * 步数 + s]
     struct TimeRecord
     {
-        double connection_time_ms;                                // 建立连接的时间
-        std::vector<std::vector<double>> round_times;             // [轮数][迭代次数] 每轮总时间
-        std::vector<std::vector<std::vector<double>>> send_times; // [轮数][迭代次数][对等方] 发送时间
-        std::vector<std::vector<std::vector<double>>> recv_times; // [轮数][迭代次数][对等方] 接收时间
+        std::vector<size_t> round_offset;                              // [轮数] 本轮第一次迭代的下标
+        std::vector<int> round_iterations;                             // [轮数] 本轮迭代次数
+        std::vector<int> round_batch;                                  // [轮数] 本轮合并的实例数
+        std::vector<IterationEvent> iteration_events;                  // [全部迭代] 每次迭代的开始/结束时间
+        std::vector<StepEvent> step_events;                            // [全部迭代 * 步数] 每一步的分阶段耗时
+        std::vector<int64_t> peak_rss_kb;                              // [轮数] 本轮（含预热）的峰值常驻内存
+        std::vector<std::vector<std::vector<ChunkRecord>>> chunk_times; // [轮数][迭代次数][分块] 流水线分块时间
+        std::vector<std::vector<std::vector<TelemetryRecord>>> telemetry; // [轮数][迭代次数][记录] TCP_INFO 采样
+        std::vector<std::vector<int64_t>> warmup_ns;                   // [轮数][预热次数] warmup_cv 开启时每次预热的时间
+        std::vector<bool> warmup_steady;                               // [轮数] 预热是否在 warmup_max 之内达到平稳
     };
 
     TimeRecord detailed_times;
+    SocketSettings network_settings; // 第一条连接上实际生效的 socket 选项
+
+    // 本地单调时钟加上 clock_offset_ns 即party 0 的时钟；clock_rtt_ns 为估计所用往返时间，偏移误差不超过其一半
+    int64_t clock_offset_ns = 0;
+    int64_t clock_rtt_ns = 0;
+
+    // batch 测试中按实例拆回的结果，第 m 个实例占 N * 实例大小，按party编号排列
+    BufferArena batch_outputs;
+
+    uint64_t compute_digest = 0; // 合成计算的结果，只为不让编译器省掉计算
 
 public:
-    ShareBenchmarkTwoRounds(int party_id, int num_parties);
-    ~ShareBenchmarkTwoRounds();
+    ShareBenchmark(int party_id, int num_parties, const BenchmarkOptions &options = BenchmarkOptions(),
+                   std::ostream &out = std::cout);
 
-    // 网络设置
+    // 建立连接并打印实际生效的 socket 选项
     bool setup_connections(const std::vector<std::string> &ips, int base_port);
 
-    // 两轮测试函数
-    void run_two_rounds_test(const std::vector<size_t> &data_sizes,
-                             const std::string &output_csv_1 = "benchmark_results.csv", const std::string &output_csv_2 = "connection_results.csv");
+    // 依次测试每个数据大小（batch 参数给出多个实例数时，每个大小按每个实例数各测一轮），所有大小复用 setup_connections 建立的连接。
+    // 返回每一轮的 (数据大小, 平均时间 ms)
+    std::vector<std::pair<size_t, double>> run_sweep(const std::vector<SweepPoint> &points,
+                   const std::string &output_csv_1 = "benchmark_results.csv", const std::string &output_csv_2 = "connection_results.csv",
+                   const std::string &output_csv_3 = "chunk_results.csv",
+                   const std::string &output_csv_4 = "telemetry_results.csv",
+                   const std::string &output_csv_5 = "phase_results.csv",
+                   const std::string &output_gather = "gathered_results.bin",
+                   const std::string &output_summary = "summary_results.csv",
+                   const std::string &output_warmup = "warmup_results.csv");
+
+    // workload=ssle：按 epoch 的各个阶段重复运行选举纪元（预热同 warmup/warmup_cv，纪元数为 iterations），
+    // 输出各阶段与整个纪元的时延及每秒完成的选举数，每个纪元每个阶段的时间写入 output_csv。
+    // 返回 (一个纪元各阶段的块大小之和, 纪元平均时间 ms)
+    std::pair<size_t, double> run_workload(const std::string &output_csv);
+
+    // 守护进程：下一次运行换用 next 的参数，引擎参数由 Engine::reconfigure 检查并应用。参数不合法时抛出异常
+    void reconfigure(const BenchmarkOptions &next);
+
+    // 守护进程模式：保持连接与缓冲区，party 0 在 daemon_port 上逐行接受协调端的运行请求并转发给其余参与方，
+    // 各方换用请求中的参数运行一次，每次运行结束后 party 0 把各方的结果发回协调端。收到 shutdown 后返回
+    void run_daemon(const std::vector<SweepPoint> &sweep);
 
 private:
-    void benchmark_round(size_t data_size, int round_index, int iterations = 5);
-    void share_data(size_t size, std::vector<double> &send_times, std::vector<double> &recv_times);
+    static void check_options(const BenchmarkOptions &opts, bool seeded);
+    void benchmark_round(size_t data_size, int round_index, int iterations, int warmup);
+    void preallocate_buffers(size_t data_size);
+    void synchronize_clocks();
     void generate_random_data(size_t size);
+    void validate_payload(size_t data_size);
     void write_connection_to_csv(const std::vector<std::pair<size_t, double>> &results,
                                  const std::string &filename);
     void write_detailed_times_to_csv(const std::vector<size_t> &data_sizes,
                                      const std::string &filename);
-    void preallocate_buffers(size_t data_size);
-
-    bool is_power_of_two(int n) const { return (n & (n - 1)) == 0; }
-    void validate_data_size(size_t data_size) const;
+    void write_telemetry_to_csv(const std::vector<size_t> &data_sizes, const std::string &filename);
+    void write_phases_to_csv(const std::vector<size_t> &data_sizes, const std::string &filename);
+    void write_warmup_to_csv(const std::vector<size_t> &data_sizes, const std::string &filename);
+    bool warm_up_until_steady(std::vector<int64_t> &times, const std::function<void()> &iteration);
+    void print_latency_summary(size_t round) const;
+    std::vector<int64_t> serialize_results() const;
+    std::vector<int64_t> gather_results();
+    void write_gathered_results(const std::vector<int64_t> &records, const std::vector<size_t> &data_sizes,
+                                const std::string &filename, const std::string &summary_csv);
+    void write_chunk_times_to_csv(const std::vector<size_t> &data_sizes,
+                                  const std::string &filename);
+    void validate_seeded(size_t data_size);
+    void validate_reduce(size_t data_size);
+    void validate_batch(size_t instance_size, const std::vector<uint8_t *> &outputs);
+    void print_batch_summary(const std::vector<size_t> &data_sizes) const;
+    void share_with_compute(size_t data_size, StepEvent *events, std::vector<ChunkRecord> &chunks,
+                            std::vector<TelemetryRecord> &telemetry, IterationEvent &iteration);
+    void print_overlap_summary(size_t round) const;
 };
 
-ShareBenchmarkTwoRounds::ShareBenchmarkTwoRounds(int pid, int nparties)
-    : party_id(pid), num_parties(nparties), rng_engine(std::random_device{}())
+// 引擎解析后的参数（reduce_op=auto 已按数据类型选定）写回本地副本，测试部分只读 options
+template <typename IO>
+ShareBenchmark<IO>::ShareBenchmark(int pid, int nparties, const BenchmarkOptions &opts, std::ostream &os)
+    : Engine(pid, nparties, opts, os), options(opts)
+{
+    static_cast<EngineOptions &>(options) = Engine::options;
+    check_options(options, seeded);
+}
+
+template <typename IO>
+void ShareBenchmark<IO>::check_options(const BenchmarkOptions &opts, bool seeded)
+{
+    if (*std::max_element(opts.batch_sizes.begin(), opts.batch_sizes.end()) > 1 &&
+        (opts.collective != Collective::AllGather || seeded || opts.sink != "none"))
+        throw std::invalid_argument("batch supports the all-gather algorithms without sink");
+    // 合成计算逐块读取收到的块，块须按原样保留
+    if (opts.overlap != "off" && (opts.collective != Collective::AllGather || seeded || opts.sink != "none"))
+        throw std::invalid_argument("overlap supports the all-gather algorithms without sink");
+    // 纪元的计算在收到的块上原地进行（重随机化）
+    if (opts.workload && (opts.collective != Collective::AllGather || seeded || opts.sink != "none"))
+        throw std::invalid_argument("workload supports the all-gather algorithms without sink");
+}
+
+template <typename IO>
+void ShareBenchmark<IO>::reconfigure(const BenchmarkOptions &next)
+{
+    check_options(next, next.algorithm == "seeded");
+    Engine::reconfigure(next);
+    options = next;
+    static_cast<EngineOptions &>(options) = Engine::options;
+}
+
+template <typename IO>
+bool ShareBenchmark<IO>::setup_connections(const std::vector<std::string> &ips, int base_port)
+{
+    if (!Engine::setup_connections(ips, base_port))
+        return false;
+
+    for (const auto &link : ios)
+    {
+        if (link.empty())
+            continue;
+        network_settings = read_socket_settings(link[0]);
+        break;
+    }
+    out << "Network profile " << options.network_mode << ": requested buffer "
+              << options.network.socket_buffer_bytes() << " bytes, effective sndbuf/rcvbuf "
+              << network_settings.sndbuf << "/" << network_settings.rcvbuf << ", nodelay " << network_settings.nodelay
+              << ", congestion " << network_settings.congestion << ", busy_poll " << network_settings.busy_poll_us
+              << " us" << std::endl;
+    return true;
+}
+
+// 引擎的缓冲区之外，batch 测试还需要拆回结果的缓冲区
+template <typename IO>
+void ShareBenchmark<IO>::preallocate_buffers(size_t data_size)
+{
+    Engine::preallocate_buffers(data_size);
+    if (*std::max_element(options.batch_sizes.begin(), options.batch_sizes.end()) > 1 &&
+        batch_outputs.size() < num_parties * data_size)
+        batch_outputs.allocate(num_parties * data_size, options.huge_pages, buffer_numa_node);
+}
+
+template <typename IO>
+void ShareBenchmark<IO>::generate_random_data(size_t size)
+{
+    PayloadStream::fill(options.payload, options.payload_seed, party_id, num_parties, input(size), size);
+}
+
+// 沿二项树估计各参与方相对party 0 的时钟偏移。父节点为 p 去掉最高位，party [2^k, 2^(k+1)) 在第 k 阶段
+// 与父节点做 NTP 式往返：子节点发出请求后记录 t0/t3，父节点回复收到与发出的时间 t1/t2，
+// 偏移 = ((t1 - t0) + (t2 - t3)) / 2，取往返时间最短的样本，再加上父节点自己到 party 0 的偏移
+template <typename IO>
+void ShareBenchmark<IO>::synchronize_clocks()
+{
+    const int samples = options.clock_sync_samples;
+    for (int distance = 1; distance < num_parties; distance *= 2)
+    {
+        if (party_id < distance && party_id + distance < num_parties)
+        {
+            int child = party_id + distance;
+            for (int i = 0; i < samples; i++)
+            {
+                uint8_t request;
+                recv_control(child, &request, 1);
+                int64_t t1 = monotonic_ns();
+                int64_t reply[2] = {t1, monotonic_ns()};
+                send_control(child, reply, sizeof(reply));
+            }
+            send_control(child, &clock_offset_ns, sizeof(clock_offset_ns));
+        }
+        else if (party_id >= distance && party_id < 2 * distance)
+        {
+            int parent = party_id - distance;
+            int64_t best_rtt = INT64_MAX;
+            int64_t best_offset = 0;
+            for (int i = 0; i < samples; i++)
+            {
+                uint8_t request = 0;
+                int64_t t0 = monotonic_ns();
+                send_control(parent, &request, 1);
+                int64_t reply[2];
+                recv_control(parent, reply, sizeof(reply));
+                int64_t t3 = monotonic_ns();
+
+                int64_t rtt = (t3 - t0) - (reply[1] - reply[0]);
+                if (rtt < best_rtt)
+                {
+                    best_rtt = rtt;
+                    best_offset = ((reply[0] - t0) + (reply[1] - t3)) / 2;
+                }
+            }
+
+            int64_t parent_offset;
+            recv_control(parent, &parent_offset, sizeof(parent_offset));
+            clock_offset_ns = parent_offset + best_offset;
+            clock_rtt_ns = best_rtt;
+        }
+    }
+
+    out << "Clock offset to party 0: " << clock_offset_ns / 1000.0 << " us (rtt "
+              << clock_rtt_ns / 1000.0 << " us)" << std::endl;
+}
+
+// 按种子重新生成其他参与方的块并与收到的数据比较，不一致时抛出异常。sink=callback 时块在交给消费者后已被丢弃，不做校验
+template <typename IO>
+void ShareBenchmark<IO>::validate_payload(size_t data_size)
+{
+    if (!options.validate || options.sink == "callback")
+        return;
+    if (seeded)
+    {
+        validate_seeded(data_size);
+        return;
+    }
+    if (options.collective != Collective::AllGather)
+    {
+        validate_reduce(data_size);
+        return;
+    }
+    for (int block = 0; block < num_parties; block++)
+    {
+        if (block == party_id)
+            continue;
+        size_t offset = PayloadStream::verify(options.payload, options.payload_seed, block, num_parties,
+                                              recv_buffers.data() + block * data_size, data_size);
+        if (offset != data_size)
+        {
+            throw std::runtime_error("Payload validation failed: block " + std::to_string(block) + " differs at byte " +
+                                     std::to_string(offset) + " (data size " + std::to_string(data_size) + ")");
+        }
+    }
+}
+
+// seeded 的分享只有合起来才能还原秘密，各方对每个秘密的分享求线性摘要，沿二项树合并到 party 0，
+// 与按公共种子重新生成的秘密的摘要比较，结果再沿树广播，校验失败时所有参与方抛出同一个异常。
+// 本方对自己秘密的分享是 PRG(s_{j,j})，自己的块上是发出的修正项
+template <typename IO>
+void ShareBenchmark<IO>::validate_seeded(size_t data_size)
+{
+    const uint64_t challenge = options.payload_seed;
+    std::vector<uint64_t> sketches(num_parties);
+    for (int block = 0; block < num_parties; block++)
+    {
+        if (block == party_id && num_parties > 1)
+            sketches[block] = PayloadStream::sketch(options.payload, challenge, nullptr, data_size, seeds_out[block].data());
+        else
+            sketches[block] = PayloadStream::sketch(options.payload, challenge, recv_buffers.data() + block * data_size, data_size);
+    }
+
+    int top = 1;
+    while (top < num_parties)
+        top *= 2;
+    bool is_root = true;
+    for (int distance = top / 2; distance >= 1 && is_root; distance /= 2)
+    {
+        if (party_id < distance && party_id + distance < num_parties)
+        {
+            std::vector<uint64_t> child(num_parties);
+            recv_control(party_id + distance, child.data(), child.size() * sizeof(uint64_t));
+            for (int block = 0; block < num_parties; block++)
+                sketches[block] = PayloadStream::combine(options.payload, sketches[block], child[block]);
+        }
+        else if (party_id >= distance && party_id < 2 * distance)
+        {
+            send_control(party_id - distance, sketches.data(), sketches.size() * sizeof(uint64_t));
+            is_root = false;
+        }
+    }
+
+    // 第一个还原失败的秘密编号，-1 表示全部一致
+    int32_t failed = -1;
+    if (party_id == 0)
+    {
+        std::vector<PayloadStream::Aligned16> secret((data_size + 15) / 16);
+        for (int block = 0; block < num_parties && failed < 0; block++)
+        {
+            uint8_t *data = reinterpret_cast<uint8_t *>(secret.data());
+            PayloadStream::fill(options.payload, options.payload_seed, block, num_parties, data, data_size);
+            if (PayloadStream::sketch(options.payload, challenge, data, data_size) != sketches[block])
+                failed = block;
+        }
+    }
+    for (int distance = 1; distance < num_parties; distance *= 2)
+    {
+        if (party_id < distance && party_id + distance < num_parties)
+            send_control(party_id + distance, &failed, sizeof(failed));
+        else if (party_id >= distance && party_id < 2 * distance)
+            recv_control(party_id - distance, &failed, sizeof(failed));
+    }
+    if (failed >= 0)
+    {
+        throw std::runtime_error("Payload validation failed: shares of party " + std::to_string(failed) +
+                                 " do not reconstruct its secret (data size " + std::to_string(data_size) + ")");
+    }
+}
+
+// 按种子重新生成所有参与方的输入并合并，与本方持有的段（reduce-scatter）或完整结果（all-reduce）比较
+template <typename IO>
+void ShareBenchmark<IO>::validate_reduce(size_t data_size)
+{
+    std::vector<PayloadStream::Aligned16> expected((data_size + 15) / 16), input((data_size + 15) / 16);
+    uint8_t *sum = reinterpret_cast<uint8_t *>(expected.data());
+    uint8_t *block = reinterpret_cast<uint8_t *>(input.data());
+    PayloadStream::fill(options.payload, options.payload_seed, 0, num_parties, sum, data_size);
+    for (int party = 1; party < num_parties; party++)
+    {
+        PayloadStream::fill(options.payload, options.payload_seed, party, num_parties, block, data_size);
+        combine_buffers(options.reduce_op, sum, sum, block, data_size);
+    }
+
+    size_t begin = 0, end = data_size;
+    if (options.collective == Collective::ReduceScatter)
+    {
+        begin = reduce_offset(party_id, data_size);
+        end = reduce_offset(party_id + 1, data_size);
+    }
+    for (size_t i = begin; i < end; i++)
+    {
+        if (sum[i] != recv_buffers[i])
+        {
+            throw std::runtime_error(std::string("Payload validation failed: ") + collective_name(options.collective) +
+                                     " result differs at byte " + std::to_string(i) + " (data size " +
+                                     std::to_string(data_size) + ")");
+        }
+    }
+}
+
+// overlap 模式的一次迭代：对所有 N 个块做合成计算。serial 在分享完成后依次计算；async 在 IO 线程上分享，
+// 本线程先算自己的块，再按到达顺序计算收到的块。分享结束（或失败）时压入 -1，异常在 future 上重新抛出
+template <typename IO>
+void ShareBenchmark<IO>::share_with_compute(size_t data_size, StepEvent *events, std::vector<ChunkRecord> &chunks,
+                                            std::vector<TelemetryRecord> &telemetry, IterationEvent &iteration)
+{
+    iteration.compute_ns = 0;
+    auto compute = [&](int block)
+    {
+        int64_t start = monotonic_ns();
+        compute_digest ^= synthetic_compute(recv_buffers.data() + block * data_size, data_size, options.compute_passes);
+        iteration.compute_ns += monotonic_ns() - start;
+    };
+
+    if (options.overlap == "serial")
+    {
+        share_data(data_size, events, chunks, telemetry);
+        iteration.comm_ns = monotonic_ns() - iteration.start_ns;
+        for (int block = 0; block < num_parties; block++)
+            compute(block);
+        return;
+    }
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<int> arrived;
+    auto push = [&](int block)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            arrived.push_back(block);
+        }
+        cv.notify_one();
+    };
+
+    std::future<void> done = start_share(data_size, events, chunks, telemetry,
+                                         [&](size_t, const std::vector<int> &blocks)
+                                         {
+                                             for (int block : blocks)
+                                                 push(block);
+                                         });
+    // future 就绪后由一个辅助任务投递结束标记：IO 线程按提交顺序执行，标记总在分享之后到达
+    std::future<void> finished = io_worker->submit([&]()
+                                                   {
+        iteration.comm_ns = monotonic_ns() - iteration.start_ns;
+        push(-1); });
+
+    compute(party_id);
+    for (;;)
+    {
+        int block;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&]() { return !arrived.empty(); });
+            block = arrived.front();
+            arrived.pop_front();
+        }
+        if (block < 0)
+            break;
+        compute(block);
+    }
+    finished.get();
+    done.get();
+}
+
+// overlap 模式下本轮的平均分享时间、计算时间与总时间，重叠比例为被分享时间掩盖的计算占可重叠部分的比例
+template <typename IO>
+void ShareBenchmark<IO>::print_overlap_summary(size_t round) const
+{
+    double comm = 0, compute = 0, total = 0;
+    int iterations = detailed_times.round_iterations[round];
+    for (int i = 0; i < iterations; i++)
+    {
+        const IterationEvent &iteration = detailed_times.iteration_events[detailed_times.round_offset[round] + i];
+        comm += iteration.comm_ns;
+        compute += iteration.compute_ns;
+        total += iteration.end_ns - iteration.start_ns;
+    }
+    comm /= iterations;
+    compute /= iterations;
+    total /= iterations;
+    double hidden = std::max(0.0, comm + compute - total);
+    out << "Overlap (" << options.overlap << ", " << options.compute_passes << " passes): share "
+              << std::fixed << std::setprecision(3) << comm / 1e6 << " ms, compute " << compute / 1e6 << " ms, total "
+              << total / 1e6 << " ms, hidden " << std::setprecision(1)
+              << (std::min(comm, compute) > 0 ? 100.0 * hidden / std::min(comm, compute) : 0.0) << "%" << std::endl;
+}
+
+// 收到的块已由 validate_payload 校验，这里只检查拆回的结果与块中对应的位置一致
+template <typename IO>
+void ShareBenchmark<IO>::validate_batch(size_t instance_size, const std::vector<uint8_t *> &outputs)
+{
+    if (!options.validate)
+        return;
+    size_t batch = outputs.size();
+    for (size_t m = 0; m < batch; m++)
+    {
+        for (int block = 0; block < num_parties; block++)
+        {
+            if (std::memcmp(outputs[m] + block * instance_size,
+                            recv_buffers.data() + (block * batch + m) * instance_size, instance_size) != 0)
+            {
+                throw std::runtime_error("Batch validation failed: instance " + std::to_string(m) + " of block " +
+                                         std::to_string(block) + " was not scattered correctly");
+            }
+        }
+    }
+}
+
+// times 中以第 end 个（不含）结尾的 window 个时间的变异系数，不足 window 个时返回 -1
+double window_cv(const std::vector<int64_t> &times, size_t window, size_t end)
+{
+    if (end < window)
+        return -1;
+    double sum = 0, sum_sq = 0;
+    for (size_t i = end - window; i < end; i++)
+    {
+        sum += times[i];
+        sum_sq += double(times[i]) * times[i];
+    }
+    double mean = sum / window;
+    double variance = std::max(0.0, sum_sq / window - mean * mean);
+    return mean > 0 ? std::sqrt(variance) / mean : 0;
+}
+
+// 先做 warmup 次预热，之后继续预热直到最近 warmup_window 次的变异系数（标准差/均值）不超过 warmup_cv。
+// 各参与方的判断经屏障取与，所有参与方都平稳时一起停止，保证各方的分享次数相同；屏障同时让下一次预热同时开始。
+// 每次预热的时间追加到 times，返回是否在 warmup_max 之内达到平稳
+template <typename IO>
+bool ShareBenchmark<IO>::warm_up_until_steady(std::vector<int64_t> &times, const std::function<void()> &iteration)
+{
+    times.reserve(options.warmup_max);
+    double cv = -1;
+    bool steady = false;
+    while (!steady && (int)times.size() < options.warmup_max)
+    {
+        int64_t start = monotonic_ns();
+        iteration();
+        times.push_back(monotonic_ns() - start);
+
+        cv = window_cv(times, options.warmup_window, times.size());
+        steady = barrier((int)times.size() >= options.warmup && cv >= 0 && cv <= options.warmup_cv);
+    }
+    out << "Warmup: " << times.size() << " iterations";
+    if (steady)
+        out << ", steady at CV " << std::fixed << std::setprecision(2) << cv * 100 << "% over the last "
+                  << options.warmup_window << std::endl;
+    else
+        out << ", not steady within warmup_max (last CV " << std::fixed << std::setprecision(2) << cv * 100
+                  << "%), measuring anyway" << std::endl;
+    return steady;
+}
+
+template <typename IO>
+void ShareBenchmark<IO>::benchmark_round(size_t data_size, int round_index, int iterations, int warmup)
+{
+    // 预分配缓冲区
+    preallocate_buffers(data_size);
+
+    generate_random_data(data_size);
+    reset_peak_rss();
+
+    // 合并 M 个实例时本方的块即 M 个实例的输入依次拼接，每次迭代传输后按实例拆回到 batch_outputs
+    size_t batch = detailed_times.round_batch[round_index];
+    size_t instance_size = data_size / batch;
+    std::vector<uint8_t *> outputs;
+    for (size_t m = 0; batch > 1 && m < batch; m++)
+        outputs.push_back(batch_outputs.data() + m * num_parties * instance_size);
+
+    // IO 线程在计时之外创建
+    if (options.overlap == "async" && !io_worker)
+        io_worker.reset(new IoWorker());
+
+    // 预热
+    std::vector<StepEvent> warmup_events(steps.size());
+    std::vector<ChunkRecord> warmup_chunks;
+    std::vector<TelemetryRecord> warmup_telemetry;
+    auto warmup_iteration = [&]()
+    {
+        share_data(data_size, warmup_events.data(), warmup_chunks, warmup_telemetry);
+        if (!outputs.empty())
+            scatter_batch(instance_size, outputs);
+    };
+    if (options.warmup_cv > 0)
+        detailed_times.warmup_steady[round_index] =
+            warm_up_until_steady(detailed_times.warmup_ns[round_index], warmup_iteration);
+    else
+    {
+        for (int i = 0; i < warmup; i++)
+            warmup_iteration();
+    }
+
+    // 为当前轮次初始化分块与遥测记录，迭代与步骤的记录已在 run_sweep 中分配
+    detailed_times.chunk_times[round_index].resize(iterations);
+    detailed_times.telemetry[round_index].resize(iterations);
+    size_t first = detailed_times.round_offset[round_index];
+
+    for (int i = 0; i < iterations; i++)
+    {
+        // 所有参与方同时开始，本次迭代的时间不再包含等待其他参与方完成上一次迭代的时间
+        if (options.barrier)
+            barrier();
+
+        IterationEvent &iteration = detailed_times.iteration_events[first + i];
+        iteration.start_ns = monotonic_ns();
+
+        iteration.comm_ns = 0;
+        if (options.overlap == "off")
+            share_data(data_size, detailed_times.step_events.data() + (first + i) * steps.size(),
+                       detailed_times.chunk_times[round_index][i], detailed_times.telemetry[round_index][i]);
+        else
+            share_with_compute(data_size, detailed_times.step_events.data() + (first + i) * steps.size(),
+                               detailed_times.chunk_times[round_index][i], detailed_times.telemetry[round_index][i],
+                               iteration);
+
+        iteration.scatter_ns = 0;
+        if (!outputs.empty())
+        {
+            int64_t scatter_start = monotonic_ns();
+            scatter_batch(instance_size, outputs);
+            iteration.scatter_ns = monotonic_ns() - scatter_start;
+        }
+
+        iteration.end_ns = monotonic_ns();
+    }
+
+    detailed_times.peak_rss_kb[round_index] = peak_rss_kb();
+
+    // 最后一次迭代收齐的数据在计时之外校验
+    validate_payload(data_size);
+    if (!outputs.empty())
+        validate_batch(instance_size, outputs);
+}
+
+template <typename IO>
+void ShareBenchmark<IO>::write_connection_to_csv(const std::vector<std::pair<size_t, double>> &results,
+                                                 const std::string &filename)
+{
+    std::ofstream file(filename);
+    if (!file.is_open())
+    {
+        std::cerr << "Failed to open CSV file: " << filename << std::endl;
+        return;
+    }
+
+    // 写入CSV头部
+    file << "ConnectionTime_ms,NumConnections,StreamsPerLink,Profile,Bandwidth_Mbps,RTT_ms,RequestedBuffer_Bytes,"
+         << "SndBuf_Bytes,RcvBuf_Bytes,NoDelay,Congestion,BusyPoll_us,ClockOffset_ns,ClockRTT_ns" << std::endl;
+
+    size_t num_connections = 0;
+    for (const auto &link : ios)
+        num_connections += link.size();
+    file << connection_time_ms << "," << num_connections << "," << options.network.streams << ","
+         << options.network_mode << "," << options.network.bandwidth_mbps << "," << options.network.rtt_ms << ","
+         << options.network.socket_buffer_bytes() << "," << network_settings.sndbuf << "," << network_settings.rcvbuf << ","
+         << network_settings.nodelay << "," << network_settings.congestion << "," << network_settings.busy_poll_us << ","
+         << clock_offset_ns << "," << clock_rtt_ns << std::endl;
+
+    file.close();
+    out << "Results written to: " << filename << std::endl;
+}
+
+template <typename IO>
+void ShareBenchmark<IO>::write_detailed_times_to_csv(const std::vector<size_t> &data_sizes,
+                                                     const std::string &filename)
+{
+    std::ofstream file(filename);
+    if (!file.is_open())
+    {
+        std::cerr << "Failed to open detailed CSV file: " << filename << std::endl;
+        return;
+    }
+
+    // 写入CSV头部
+    file << "Round,Iteration,DataSize_KB,DataSize_Bytes,TotalTime_ms";
+
+    // 添加每一步的发送和接收时间列（超立方体中第i步即第i维的对等方），发送时间截止到数据全部发到线上
+    for (size_t i = 0; i < steps.size(); i++)
+    {
+        file << ",SendToPeer" << i << "_ms";
+        file << ",RecvFromPeer" << i << "_ms";
+    }
+    file << ",PartyID,NumParties,ExchangeMode,Algorithm,Transport,GlobalStart_ns,GlobalEnd_ns,PeakRSS_KB,Collective,"
+         << "Batch,InstanceSize_Bytes,Scatter_ns,Comm_ns,Compute_ns" << std::endl;
+
+    // 写入每轮的详细时间，毫秒值保留到纳秒
+    for (size_t round = 0; round < detailed_times.round_offset.size(); round++)
+    {
+        for (int iter = 0; iter < detailed_times.round_iterations[round]; iter++)
+        {
+            size_t index = detailed_times.round_offset[round] + iter;
+            const IterationEvent &iteration = detailed_times.iteration_events[index];
+            const StepEvent *events = detailed_times.step_events.data() + index * steps.size();
+            file << (round + 1) << "," << (iter + 1) << ","
+                 << (data_sizes[round] / 1024) << "," << data_sizes[round] << ","
+                 << std::fixed << std::setprecision(6) << (iteration.end_ns - iteration.start_ns) / 1e6;
+
+            // 写入每一步的发送和接收时间
+            for (size_t i = 0; i < steps.size(); i++)
+                file << "," << events[i].send_ns / 1e6 << "," << events[i].recv_ns / 1e6;
+
+            file << "," << party_id << "," << num_parties << "," << exchange_mode_name(options.exchange_mode)
+                 << "," << algorithm->name() << "," << options.transport
+                 << "," << (iteration.start_ns + clock_offset_ns) << "," << (iteration.end_ns + clock_offset_ns)
+                 << "," << detailed_times.peak_rss_kb[round] << "," << collective_name(options.collective)
+                 << "," << detailed_times.round_batch[round] << "," << data_sizes[round] / detailed_times.round_batch[round]
+                 << "," << iteration.scatter_ns << "," << iteration.comm_ns << "," << iteration.compute_ns << std::endl;
+        }
+    }
+
+    file.close();
+    out << "Detailed results written to: " << filename << std::endl;
+}
+
+// 每行为一次迭代中的一步，各阶段耗时的含义见 StepEvent，-1 表示无法单独测量
+template <typename IO>
+void ShareBenchmark<IO>::write_phases_to_csv(const std::vector<size_t> &data_sizes, const std::string &filename)
+{
+    std::ofstream file(filename);
+    if (!file.is_open())
+    {
+        std::cerr << "Failed to open phases CSV file: " << filename << std::endl;
+        return;
+    }
+
+    file << "Round,Iteration,DataSize_KB,Step,Send_ns,Recv_ns,Serialize_ns,SendSyscall_ns,SendWait_ns,"
+         << "RecvWait_ns,RecvSyscall_ns,Combine_ns,PartyID,NumParties" << std::endl;
+
+    for (size_t round = 0; round < detailed_times.round_offset.size(); round++)
+    {
+        for (int iter = 0; iter < detailed_times.round_iterations[round]; iter++)
+        {
+            const StepEvent *events = detailed_times.step_events.data() + (detailed_times.round_offset[round] + iter) * steps.size();
+            for (size_t i = 0; i < steps.size(); i++)
+            {
+                const StepEvent &event = events[i];
+                file << (round + 1) << "," << (iter + 1) << "," << (data_sizes[round] / 1024) << "," << i << ","
+                     << event.send_ns << "," << event.recv_ns << "," << event.serialize_ns << ","
+                     << event.send_syscall_ns << "," << event.send_wait_ns << ","
+                     << event.recv_wait_ns << "," << event.recv_syscall_ns << "," << event.combine_ns << ","
+                     << party_id << "," << num_parties << std::endl;
+            }
+        }
+    }
+
+    file.close();
+    out << "Phase results written to: " << filename << std::endl;
+}
+
+// 合并传输的效果：按实例大小分组，每个实例数 M 一行，均摊到每个实例的时间与逐个传输（M 个 batch=1 的传输）的估计相比。
+// 均摊时间趋近于 batch=1 的时间除以 M 说明仍受延迟限制，不再下降时说明已受带宽或拷贝限制
+template <typename IO>
+void ShareBenchmark<IO>::print_batch_summary(const std::vector<size_t> &data_sizes) const
+{
+    auto mean_ns = [&](size_t round, bool scatter)
+    {
+        double sum = 0;
+        for (int i = 0; i < detailed_times.round_iterations[round]; i++)
+        {
+            const IterationEvent &iteration = detailed_times.iteration_events[detailed_times.round_offset[round] + i];
+            sum += scatter ? iteration.scatter_ns : iteration.end_ns - iteration.start_ns;
+        }
+        return sum / detailed_times.round_iterations[round];
+    };
+
+    out << "Batching (instance bytes, M, pass ms, scatter ms, us per instance, speedup vs M=1):" << std::endl;
+    std::map<size_t, double> single; // 实例大小 -> batch=1 的平均时间
+    for (size_t round = 0; round < data_sizes.size(); round++)
+    {
+        if (detailed_times.round_batch[round] == 1)
+            single[data_sizes[round]] = mean_ns(round, false);
+    }
+    for (size_t round = 0; round < data_sizes.size(); round++)
+    {
+        int batch = detailed_times.round_batch[round];
+        size_t instance_size = data_sizes[round] / batch;
+        double pass = mean_ns(round, false);
+        out << "  " << std::setw(10) << instance_size << std::setw(8) << batch << std::fixed << std::setprecision(3)
+                  << std::setw(12) << pass / 1e6 << std::setw(12) << mean_ns(round, true) / 1e6 << std::setw(14)
+                  << pass / batch / 1e3;
+        auto it = single.find(instance_size);
+        if (it != single.end())
+            out << std::setw(10) << std::setprecision(2) << it->second * batch / pass << "x";
+        out << std::endl;
+    }
+}
+
+// 本轮迭代总时间与每一步收发时间的分位数 (us)
+template <typename IO>
+void ShareBenchmark<IO>::print_latency_summary(size_t round) const
+{
+    size_t first = detailed_times.round_offset[round];
+    int iterations = detailed_times.round_iterations[round];
+
+    auto print_row = [this](const std::string &label, const LatencyHistogram &histogram)
+    {
+        out << "  " << std::left << std::setw(14) << label << std::right << std::fixed << std::setprecision(1);
+        for (double q : {0.5, 0.99, 0.999})
+            out << std::setw(12) << histogram.percentile(q) / 1e3;
+        out << std::endl;
+    };
+
+    LatencyHistogram total;
+    for (int iter = 0; iter < iterations; iter++)
+    {
+        const IterationEvent &iteration = detailed_times.iteration_events[first + iter];
+        total.record(iteration.end_ns - iteration.start_ns);
+    }
+
+    out << "  " << std::left << std::setw(14) << "Latency (us)" << std::right
+              << std::setw(12) << "p50" << std::setw(12) << "p99" << std::setw(12) << "p999" << std::endl;
+    print_row("total", total);
+    for (size_t i = 0; i < steps.size(); i++)
+    {
+        LatencyHistogram send, recv, combine;
+        for (int iter = 0; iter < iterations; iter++)
+        {
+            const StepEvent &event = detailed_times.step_events[(first + iter) * steps.size() + i];
+            send.record(event.send_ns);
+            recv.record(event.recv_ns);
+            combine.record(event.combine_ns);
+        }
+        if (steps[i].send_peer >= 0)
+            print_row("step " + std::to_string(i) + " send", send);
+        if (steps[i].recv_peer >= 0)
+            print_row("step " + std::to_string(i) + " recv", recv);
+        if (!reduce_steps.empty() && reduce_steps[i].combine)
+            print_row("step " + std::to_string(i) + " comb", combine);
+    }
+}
+
+template <typename IO>
+void ShareBenchmark<IO>::write_chunk_times_to_csv(const std::vector<size_t> &data_sizes,
+                                                  const std::string &filename)
 {
-    if (!is_power_of_two(num_parties))
+    std::ofstream file(filename);
+    if (!file.is_open())
     {
-        throw std::invalid_argument("Number of parties must be a power of two");
+        std::cerr << "Failed to open chunk CSV file: " << filename << std::endl;
+        return;
     }
 
-    log_n = 0;
-    int temp = num_parties;
-    while (temp > 1)
+    file << "Round,Iteration,DataSize_KB,Step,Direction,Chunk,ChunkSize_Bytes,Start_ms,End_ms,PartyID,NumParties" << std::endl;
+
+    for (size_t round = 0; round < detailed_times.chunk_times.size(); round++)
     {
-        temp >>= 1;
-        log_n++;
+        for (size_t iter = 0; iter < detailed_times.chunk_times[round].size(); iter++)
+        {
+            for (const auto &chunk : detailed_times.chunk_times[round][iter])
+            {
+                file << (round + 1) << "," << (iter + 1) << "," << (data_sizes[round] / 1024) << ","
+                     << chunk.step << "," << (chunk.is_send ? "send" : "recv") << ","
+                     << chunk.chunk_index << "," << chunk.bytes << ","
+                     << std::fixed << std::setprecision(3) << chunk.start_ms << "," << chunk.end_ms << ","
+                     << party_id << "," << num_parties << std::endl;
+            }
+        }
     }
 
-    std::cout << "log_n " << log_n << std::endl;
-    ios.resize(log_n, nullptr);
-
-    // 初始化详细时间记录
-    detailed_times.round_times.resize(2); // 两轮测试
-    detailed_times.send_times.resize(2);
-    detailed_times.recv_times.resize(2);
+    file.close();
+    out << "Chunk results written to: " << filename << std::endl;
 }
 
-void ShareBenchmarkTwoRounds::validate_data_size(size_t data_size) const
+// 每行为一步中一条连接的采样：RTT/拥塞窗口取步骤前后的值，重传与字节数为步骤内的增量，
+// DeliveryRate 为步骤结束时内核估计的交付速率
+template <typename IO>
+void ShareBenchmark<IO>::write_telemetry_to_csv(const std::vector<size_t> &data_sizes, const std::string &filename)
 {
-    if (data_size == 0)
+    std::ofstream file(filename);
+    if (!file.is_open())
     {
-        throw std::invalid_argument("Data size cannot be zero");
+        std::cerr << "Failed to open telemetry CSV file: " << filename << std::endl;
+        return;
     }
 
-    // 检查缓冲区大小不会溢出
-    if (num_parties > SIZE_MAX / data_size)
+    file << "Round,Iteration,DataSize_KB,Step,Direction,Peer,Stream,RTTBefore_us,RTTAfter_us,RTTVarAfter_us,"
+         << "CwndBefore,CwndAfter,Retrans,BytesAcked,BytesReceived,DeliveryRate_Bps,PartyID,NumParties" << std::endl;
+
+    for (size_t round = 0; round < detailed_times.telemetry.size(); round++)
     {
-        throw std::overflow_error("Buffer size would overflow");
+        for (size_t iter = 0; iter < detailed_times.telemetry[round].size(); iter++)
+        {
+            for (const auto &record : detailed_times.telemetry[round][iter])
+            {
+                const TcpInfo &before = record.before;
+                const TcpInfo &after = record.after;
+                file << (round + 1) << "," << (iter + 1) << "," << (data_sizes[round] / 1024) << ","
+                     << record.step << "," << (record.is_send ? "send" : "recv") << ","
+                     << record.peer << "," << record.stream << ","
+                     << before.base.tcpi_rtt << "," << after.base.tcpi_rtt << "," << after.base.tcpi_rttvar << ","
+                     << before.base.tcpi_snd_cwnd << "," << after.base.tcpi_snd_cwnd << ","
+                     << (after.base.tcpi_total_retrans - before.base.tcpi_total_retrans) << ","
+                     << (after.bytes_acked - before.bytes_acked) << ","
+                     << (after.bytes_received - before.bytes_received) << ","
+                     << after.delivery_rate << "," << party_id << "," << num_parties << std::endl;
+            }
+        }
     }
+
+    file.close();
+    out << "Telemetry results written to: " << filename << std::endl;
 }
 
-ShareBenchmarkTwoRounds::~ShareBenchmarkTwoRounds()
+// 预热CSV：每轮每次预热的时间，以及以该次结尾的窗口的变异系数（不足一个窗口时为空）
+template <typename IO>
+void ShareBenchmark<IO>::write_warmup_to_csv(const std::vector<size_t> &data_sizes, const std::string &filename)
 {
-    for (auto io : ios)
+    std::ofstream file(filename);
+    if (!file.is_open())
     {
-        if (io)
-            delete io;
+        std::cerr << "Failed to open warmup CSV file: " << filename << std::endl;
+        return;
     }
-}
 
-bool ShareBenchmarkTwoRounds::setup_connections(const std::vector<std::string> &ips, int base_port)
-{
-    auto connection_start = std::chrono::high_resolution_clock::now();
+    file << "Round,Warmup,DataSize_KB,Time_ms,WindowCV,RoundSteady,PartyID,NumParties" << std::endl;
 
-    try
+    for (size_t round = 0; round < detailed_times.warmup_ns.size(); round++)
     {
-        int mask = 1;
-        for (size_t i = 0; i < log_n; ++i)
+        const std::vector<int64_t> &times = detailed_times.warmup_ns[round];
+        for (size_t i = 0; i < times.size(); i++)
         {
-            int peer_id = party_id ^ mask;
-
-            if (peer_id < party_id)
-            {
-                int port = base_port + party_id * num_parties + peer_id;
-                std::cout << "Party " << party_id << " connecting to Party " << peer_id << " from port " << port << std::endl;
-                ios[i] = new emp::NetIO(ips[peer_id].c_str(), port);
-            }
-            else
-            {
-                int port = base_port + peer_id * num_parties + party_id;
-                std::cout << "Party " << party_id << " listening on port " << port << " for Party " << peer_id << std::endl;
-                ios[i] = new emp::NetIO(nullptr, port);
-            }
-            mask <<= 1;
+            double cv = window_cv(times, options.warmup_window, i + 1);
+            file << (round + 1) << "," << (i + 1) << "," << (data_sizes[round] / 1024) << ","
+                 << std::fixed << std::setprecision(6) << times[i] / 1e6 << ",";
+            if (cv >= 0)
+                file << cv;
+            file << "," << (detailed_times.warmup_steady[round] ? 1 : 0) << "," << party_id << "," << num_parties
+                 << std::endl;
         }
+    }
 
-        auto connection_end = std::chrono::high_resolution_clock::now();
-        auto connection_duration = std::chrono::duration_cast<std::chrono::microseconds>(connection_end - connection_start);
-        detailed_times.connection_time_ms = connection_duration.count() / 1000.0;
-
-        std::cout << "Connection setup time: " << detailed_times.connection_time_ms << " ms" << std::endl;
+    file.close();
+    out << "Warmup results written to: " << filename << std::endl;
+}
 
-        return true;
+// 一个参与方的结果序列化为 int64 数组：kResultHeader 个头部字段 [party, 步数, 迭代总数, 建连时间, 时钟偏移,
+// 时钟往返, SO_SNDBUF, SO_RCVBUF]，之后是每次迭代在公共时钟上的开始/结束时间、每次迭代每一步 StepEvent 的各字段，
+// 以及每轮的峰值常驻内存
+template <typename IO>
+std::vector<int64_t> ShareBenchmark<IO>::serialize_results() const
+{
+    std::vector<int64_t> words = {party_id, (int64_t)steps.size(), (int64_t)detailed_times.iteration_events.size(),
+                                  (int64_t)(connection_time_ms * 1e6), clock_offset_ns, clock_rtt_ns,
+                                  network_settings.sndbuf, network_settings.rcvbuf};
+    for (const auto &iteration : detailed_times.iteration_events)
+    {
+        words.push_back(iteration.start_ns + clock_offset_ns);
+        words.push_back(iteration.end_ns + clock_offset_ns);
     }
-    catch (const std::exception &e)
+    for (const auto &event : detailed_times.step_events)
     {
-        std::cerr << "Network setup error: " << e.what() << std::endl;
-        return false;
+        words.insert(words.end(), {event.send_ns, event.recv_ns, event.serialize_ns, event.send_syscall_ns,
+                                   event.send_wait_ns, event.recv_wait_ns, event.recv_syscall_ns, event.combine_ns});
     }
+    words.insert(words.end(), detailed_times.peak_rss_kb.begin(), detailed_times.peak_rss_kb.end());
+    return words;
 }
 
-void ShareBenchmarkTwoRounds::generate_random_data(size_t size)
+// 沿时钟同步所用的二项树反向汇聚：距离从大到小，子节点把自己子树的全部记录发给父节点（p 去掉最高位）。
+// 返回值只在 party 0 上包含所有参与方的记录
+template <typename IO>
+std::vector<int64_t> ShareBenchmark<IO>::gather_results()
 {
-    std::uniform_int_distribution<uint8_t> dis(0, 255);
-    size_t start_offset = party_id * size;
-
-    for (size_t i = 0; i < size; i++)
+    std::vector<int64_t> records = serialize_results();
+    int top = 1;
+    while (top < num_parties)
+        top *= 2;
+    for (int distance = top / 2; distance >= 1; distance /= 2)
     {
-        recv_buffers[start_offset + i] = dis(rng_engine);
+        if (party_id < distance && party_id + distance < num_parties)
+        {
+            int child = party_id + distance;
+            uint64_t words = 0;
+            recv_control(child, &words, sizeof(words));
+            size_t offset = records.size();
+            records.resize(offset + words);
+            recv_control(child, records.data() + offset, words * sizeof(int64_t));
+        }
+        else if (party_id >= distance && party_id < 2 * distance)
+        {
+            int parent = party_id - distance;
+            uint64_t words = records.size();
+            send_control(parent, &words, sizeof(words));
+            send_control(parent, records.data(), words * sizeof(int64_t));
+            return {};
+        }
     }
+    return records;
 }
 
-void ShareBenchmarkTwoRounds::preallocate_buffers(size_t data_size)
+// party 0 把汇聚的记录整理成列式表写入一个二进制文件，并计算每次迭代的全局指标：
+// Makespan 为最早开始到最晚结束，PartyMin/Mean/Max 为各参与方本地迭代时间的统计。
+// 关键路径按公共时钟计算：参与方完成第 s 步的时刻为其迭代开始时间加上前 s 步的耗时，第 s 步的完成时刻
+// 取所有参与方中最晚的一个（相对最早开始），与上一步完成时刻之差即该步在关键路径上的长度，
+// 最晚完成的参与方即该步的瓶颈。CriticalPath 为最后完成的一步，不含最后一步之后的收尾时间
+template <typename IO>
+void ShareBenchmark<IO>::write_gathered_results(const std::vector<int64_t> &records, const std::vector<size_t> &data_sizes,
+                                                const std::string &filename, const std::string &summary_csv)
 {
-    validate_data_size(data_size);
+    constexpr size_t kResultHeader = 8;
+    constexpr size_t kStepFields = 8;
 
-    recv_buffers.resize(num_parties * data_size);
-}
-
-void ShareBenchmarkTwoRounds::share_data(size_t data_size,
-                                         std::vector<double> &send_times, std::vector<double> &recv_times)
-{
-    int mask = 1;
-    size_t current_offset = party_id * data_size;
-    size_t current_size = data_size;
+    // 按party编号索引每个参与方记录的起始位置
+    std::vector<const int64_t *> party_records(num_parties, nullptr);
+    for (size_t pos = 0; pos < records.size();)
+    {
+        const int64_t *header = records.data() + pos;
+        party_records.at(header[0]) = header;
+        pos += kResultHeader + header[2] * 2 + header[2] * header[1] * kStepFields + data_sizes.size();
+    }
 
-    std::chrono::microseconds send_duration;
-    std::chrono::microseconds recv_duration;
+    ColumnTable rounds("rounds", {"Round", "DataSize_Bytes", "Iterations", "Batch"});
+    for (size_t round = 0; round < data_sizes.size(); round++)
+        rounds.add_row({(int64_t)round + 1, (int64_t)data_sizes[round], detailed_times.round_iterations[round],
+                        detailed_times.round_batch[round]});
+
+    ColumnTable parties("parties", {"Party", "Steps", "ConnectionTime_ns", "ClockOffset_ns", "ClockRTT_ns",
+                                    "SndBuf_Bytes", "RcvBuf_Bytes"});
+    ColumnTable iterations("iterations", {"Party", "Round", "Iteration", "GlobalStart_ns", "GlobalEnd_ns"});
+    ColumnTable step_table("steps", {"Party", "Round", "Iteration", "Step", "Send_ns", "Recv_ns", "Serialize_ns",
+                                     "SendSyscall_ns", "SendWait_ns", "RecvWait_ns", "RecvSyscall_ns", "Combine_ns"});
+    ColumnTable summary("summary", {"Round", "Iteration", "DataSize_Bytes", "Makespan_ns", "PartyMin_ns", "PartyMean_ns",
+                                    "PartyMax_ns", "CriticalPath_ns", "SlowestParty"});
+    ColumnTable critical("critical_steps", {"Round", "Iteration", "Step", "Finish_ns", "Critical_ns", "Party"});
+    ColumnTable memory("memory", {"Party", "Round", "PeakRSS_KB"});
+
+    for (int p = 0; p < num_parties; p++)
+    {
+        const int64_t *header = party_records[p];
+        if (!header)
+            throw std::runtime_error("Missing results from party " + std::to_string(p));
+        parties.add_row({p, header[1], header[3], header[4], header[5], header[6], header[7]});
+    }
 
-    for (int i = 0; i < log_n; i++)
+    // 一步在一个参与方上的耗时：半双工先后收发，全双工两个方向同时进行，reduce 的合并在收发之后
+    auto step_duration = [&](const int64_t *event)
     {
-        int peer_id = party_id ^ mask;
+        if (options.exchange_mode == ExchangeMode::PingPong)
+            return event[2] + event[0] + event[1] + event[7];
+        return event[2] + std::max(event[0], event[1]) + event[7];
+    };
 
-        if (party_id < peer_id)
+    for (size_t round = 0; round < data_sizes.size(); round++)
+    {
+        int64_t makespan_sum = 0, makespan_min = INT64_MAX, makespan_max = 0, critical_sum = 0;
+        for (int iter = 0; iter < detailed_times.round_iterations[round]; iter++)
         {
-            auto send_start = std::chrono::high_resolution_clock::now();
-            ios[i]->send_data(recv_buffers.data() + current_offset, current_size);
-            ios[i]->flush();
-            auto send_end = std::chrono::high_resolution_clock::now();
-
-            auto recv_start = send_end;
-            ios[i]->recv_data(recv_buffers.data() + current_offset + current_size, current_size);
-            auto recv_end = std::chrono::high_resolution_clock::now();
+            size_t index = detailed_times.round_offset[round] + iter;
+            int64_t first_start = INT64_MAX, last_end = INT64_MIN;
+            int64_t party_min = INT64_MAX, party_max = 0, party_sum = 0;
+            int slowest = 0;
+            std::vector<std::pair<int64_t, int>> step_finish; // [步] 最晚完成的公共时钟时刻与参与方编号
 
-            send_duration = std::chrono::duration_cast<std::chrono::microseconds>(send_end - send_start);
-            recv_duration = std::chrono::duration_cast<std::chrono::microseconds>(recv_end - recv_start);
-        }
-        else
-        {
-            auto recv_start = std::chrono::high_resolution_clock::now();
-            ios[i]->recv_data(recv_buffers.data() + current_offset - current_size, current_size);
-            auto recv_end = std::chrono::high_resolution_clock::now();
+            for (int p = 0; p < num_parties; p++)
+            {
+                const int64_t *header = party_records[p];
+                size_t num_steps = header[1];
+                const int64_t *iteration = header + kResultHeader + index * 2;
+                const int64_t *events = header + kResultHeader + header[2] * 2 + index * num_steps * kStepFields;
+
+                iterations.add_row({p, (int64_t)round + 1, iter + 1, iteration[0], iteration[1]});
+                first_start = std::min(first_start, iteration[0]);
+                last_end = std::max(last_end, iteration[1]);
+                int64_t duration = iteration[1] - iteration[0];
+                party_min = std::min(party_min, duration);
+                party_sum += duration;
+                if (duration > party_max)
+                {
+                    party_max = duration;
+                    slowest = p;
+                }
+
+                if (step_finish.size() < num_steps)
+                    step_finish.resize(num_steps, {INT64_MIN, -1});
+                int64_t finish = iteration[0], group_start = iteration[0];
+                for (size_t s = 0; s < num_steps; s++)
+                {
+                    const int64_t *event = events + s * kStepFields;
+                    step_table.add_row({p, (int64_t)round + 1, iter + 1, (int64_t)s, event[0], event[1], event[2],
+                                        event[3], event[4], event[5], event[6], event[7]});
+                    // 流水线模式下记录的就是相对迭代开始的完成时刻；多端口调度中同一轮的各步同时开始，
+                    // 各方的调度分组相同，按本方的分组计算
+                    int64_t step_end;
+                    if (options.exchange_mode == ExchangeMode::Pipelined)
+                        step_end = iteration[0] + std::max(event[0], event[1]);
+                    else
+                    {
+                        if (s >= steps.size() || !steps[s].concurrent)
+                            group_start = finish;
+                        step_end = group_start + step_duration(event);
+                    }
+                    finish = options.exchange_mode == ExchangeMode::Pipelined ? step_end : std::max(finish, step_end);
+                    if (step_end > step_finish[s].first)
+                        step_finish[s] = {step_end, p};
+                }
+            }
 
-            auto send_start = recv_end;
-            ios[i]->send_data(recv_buffers.data() + current_offset, current_size);
-            ios[i]->flush();
-            auto send_end = std::chrono::high_resolution_clock::now();
-            current_offset -= current_size;
+            int64_t critical_path = 0;
+            for (size_t s = 0; s < step_finish.size(); s++)
+            {
+                int64_t step_end = step_finish[s].first - first_start;
+                critical.add_row({(int64_t)round + 1, iter + 1, (int64_t)s, step_end,
+                                  std::max<int64_t>(0, step_end - critical_path), step_finish[s].second});
+                critical_path = std::max(critical_path, step_end);
+            }
 
-            send_duration = std::chrono::duration_cast<std::chrono::microseconds>(send_end - send_start);
-            recv_duration = std::chrono::duration_cast<std::chrono::microseconds>(recv_end - recv_start);
+            int64_t makespan = last_end - first_start;
+            summary.add_row({(int64_t)round + 1, iter + 1, (int64_t)data_sizes[round], makespan, party_min,
+                             party_sum / num_parties, party_max, critical_path, slowest});
+            makespan_sum += makespan;
+            makespan_min = std::min(makespan_min, makespan);
+            makespan_max = std::max(makespan_max, makespan);
+            critical_sum += critical_path;
         }
 
-        send_times[i] = send_duration.count() / 1000.0;
-        recv_times[i] = recv_duration.count() / 1000.0;
+        int64_t max_rss = 0;
+        for (int p = 0; p < num_parties; p++)
+        {
+            const int64_t *header = party_records[p];
+            int64_t rss = header[kResultHeader + header[2] * 2 + header[2] * header[1] * kStepFields + round];
+            memory.add_row({p, (int64_t)round + 1, rss});
+            max_rss = std::max(max_rss, rss);
+        }
 
-        mask <<= 1;
-        current_size *= 2;
+        int iters = detailed_times.round_iterations[round];
+        out << "Round " << (round + 1) << " (" << (data_sizes[round] / 1024) << " KB) across " << num_parties
+                  << " parties: makespan min/mean/max " << std::fixed << std::setprecision(3) << makespan_min / 1e6
+                  << "/" << makespan_sum / 1e6 / iters << "/" << makespan_max / 1e6 << " ms, critical path "
+                  << critical_sum / 1e6 / iters << " ms, max peak RSS " << max_rss / 1024.0 << " MB" << std::endl;
     }
-}
 
-void ShareBenchmarkTwoRounds::benchmark_round(size_t data_size, int round_index, int iterations)
-{
-    // 预分配缓冲区
-    preallocate_buffers(data_size);
-
-    generate_random_data(data_size);
-
-    // 预热
-    std::vector<double> warmup_send_times(log_n, 0.0);
-    std::vector<double> warmup_recv_times(log_n, 0.0);
-    share_data(data_size, warmup_send_times, warmup_recv_times);
-
-    // 为当前轮次初始化时间记录
-    detailed_times.round_times[round_index].resize(iterations);
-    detailed_times.send_times[round_index].resize(iterations);
-    detailed_times.recv_times[round_index].resize(iterations);
+    write_column_tables(filename, {rounds, parties, iterations, step_table, summary, critical, memory});
+    out << "Gathered results written to: " << filename << std::endl;
 
-    for (int i = 0; i < iterations; i++)
+    if (!summary_csv.empty())
     {
-        auto round_start = std::chrono::high_resolution_clock::now();
-
-        // 初始化当前迭代的时间记录
-        detailed_times.send_times[round_index][i].resize(log_n, 0.0);
-        detailed_times.recv_times[round_index][i].resize(log_n, 0.0);
-
-        share_data(data_size, detailed_times.send_times[round_index][i],
-                   detailed_times.recv_times[round_index][i]);
-
-        auto round_end = std::chrono::high_resolution_clock::now();
-        auto round_duration = std::chrono::duration_cast<std::chrono::microseconds>(round_end - round_start);
-        detailed_times.round_times[round_index][i] = round_duration.count() / 1000.0;
+        write_table_csv(summary_csv, summary);
+        out << "Summary written to: " << summary_csv << std::endl;
     }
 }
 
-void ShareBenchmarkTwoRounds::write_connection_to_csv(const std::vector<std::pair<size_t, double>> &results,
-                                                      const std::string &filename)
+template <typename IO>
+std::vector<std::pair<size_t, double>> ShareBenchmark<IO>::run_sweep(const std::vector<SweepPoint> &points,
+                                   const std::string &output_csv_1, const std::string &output_csv_2,
+                                   const std::string &output_csv_3, const std::string &output_csv_4,
+                                   const std::string &output_csv_5, const std::string &output_gather,
+                                   const std::string &output_summary, const std::string &output_warmup)
 {
-    std::ofstream file(filename);
-    if (!file.is_open())
+    std::vector<std::pair<size_t, double>> results;
+
+    // 每个数据大小按 batch 中的每个实例数 M 展开成一轮，该轮每次传输的块为 M 个实例拼接
+    std::vector<SweepPoint> sweep;
+    for (const auto &point : points)
     {
-        std::cerr << "Failed to open CSV file: " << filename << std::endl;
-        return;
+        for (int batch : options.batch_sizes)
+        {
+            SweepPoint round = point;
+            round.batch = batch;
+            sweep.push_back(round);
+        }
     }
 
-    // 写入CSV头部
-    file << "ConnectionTime_ms" << std::endl;
-
-    file << detailed_times.connection_time_ms << std::endl;
-
-    file.close();
-    std::cout << "Results written to: " << filename << std::endl;
-}
-
-void ShareBenchmarkTwoRounds::write_detailed_times_to_csv(const std::vector<size_t> &data_sizes,
-                                                          const std::string &filename)
-{
-    std::ofstream file(filename);
-    if (!file.is_open())
+    std::vector<size_t> data_sizes;
+    for (const auto &point : sweep)
+        data_sizes.push_back(point.size_bytes * point.batch);
+
+    // plan=auto：所有轮次的步骤记录共用同一个步数，按最大的数据大小选定一次方案，参数写回本地副本
+    Engine::plan(*std::max_element(data_sizes.begin(), data_sizes.end()));
+    static_cast<EngineOptions &>(options) = Engine::options;
+
+    out << "\n=== EMP Share Benchmark ===" << std::endl;
+    out << "Party: " << party_id << ", Total Parties: " << num_parties << std::endl;
+    out << "Algorithm: " << algorithm->name() << ", Exchange mode: " << exchange_mode_name(options.exchange_mode) << std::endl;
+    if (options.exchange_mode == ExchangeMode::Pipelined)
+        out << "Chunk size: " << (options.chunk_size / 1024) << " KB" << std::endl;
+    out << "Payload: " << payload_kind_name(options.payload) << (options.validate ? ", validated" : "") << std::endl;
+    if (options.collective != Collective::AllGather)
+        out << "Collective: " << collective_name(options.collective) << ", combine " << reduce_op_name(options.reduce_op)
+                  << " (" << combine_kernel_name() << ")" << std::endl;
+    out << "Sizes: " << points.size() << ", batches per size: " << options.batch_sizes.size() << ", warmup ";
+    if (options.warmup_cv > 0)
+        out << "until CV <= " << options.warmup_cv * 100 << "% over " << options.warmup_window << " (at least "
+                  << options.warmup << ", at most " << options.warmup_max << ") per round" << std::endl;
+    else
+        out << options.warmup << " per round" << std::endl;
+    out << std::string(50, '=') << std::endl;
+
+    // 一次性分配所有轮次的迭代与步骤记录，测量过程中不再分配内存
+    detailed_times.round_offset.clear();
+    detailed_times.round_iterations.clear();
+    detailed_times.round_batch.clear();
+    size_t total_iterations = 0;
+    for (const auto &point : sweep)
     {
-        std::cerr << "Failed to open detailed CSV file: " << filename << std::endl;
-        return;
+        int iterations = point.iterations > 0 ? point.iterations : options.iterations;
+        detailed_times.round_offset.push_back(total_iterations);
+        detailed_times.round_iterations.push_back(iterations);
+        detailed_times.round_batch.push_back(point.batch);
+        total_iterations += iterations;
     }
+    detailed_times.iteration_events.assign(total_iterations, IterationEvent{});
+    detailed_times.step_events.assign(total_iterations * steps.size(), StepEvent{});
+    detailed_times.peak_rss_kb.assign(sweep.size(), -1);
+    detailed_times.chunk_times.assign(sweep.size(), {});
+    detailed_times.telemetry.assign(sweep.size(), {});
+    detailed_times.warmup_ns.assign(sweep.size(), {});
+    detailed_times.warmup_steady.assign(sweep.size(), false);
 
-    // 写入CSV头部
-    file << "Round,Iteration,DataSize_KB,DataSize_Bytes,TotalTime_ms";
+    // 按最大的数据大小一次性分配并预先缺页，之后各轮直接复用
+    size_t max_size = *std::max_element(data_sizes.begin(), data_sizes.end());
+    preallocate_buffers(max_size);
 
-    // 添加每个对等方的发送和接收时间列
-    for (int i = 0; i < log_n; i++)
-    {
-        file << ",SendToPeer" << i << "_ms";
-        file << ",RecvFromPeer" << i << "_ms";
-    }
-    file << ",PartyID,NumParties" << std::endl;
+    synchronize_clocks();
 
-    // 写入每轮的详细时间
-    for (int round = 0; round < 2; round++)
+    for (size_t round = 0; round < sweep.size(); round++)
     {
-        for (size_t iter = 0; iter < detailed_times.round_times[round].size(); iter++)
+        int iterations = detailed_times.round_iterations[round];
+        out << "Round " << (round + 1) << " - Data Size: " << data_sizes[round] << " bytes ("
+                  << (data_sizes[round] / 1024) << " KB), " << iterations << " iterations";
+        if (sweep[round].batch > 1)
+            out << ", " << sweep[round].batch << " instances of " << sweep[round].size_bytes << " bytes";
+        out << std::endl;
+        benchmark_round(data_sizes[round], round, iterations, options.warmup);
+
+        // 计算本轮的平均时间
+        double avg_time = 0.0;
+        for (int i = 0; i < iterations; i++)
         {
-            file << (round + 1) << "," << (iter + 1) << ","
-                 << (data_sizes[round] / 1024) << "," << data_sizes[round] << ","
-                 << std::fixed << std::setprecision(3) << detailed_times.round_times[round][iter];
-
-            // 写入每个对等方的发送和接收时间
-            for (int peer = 0; peer < log_n; peer++)
-            {
-                file << "," << std::fixed << std::setprecision(3) << detailed_times.send_times[round][iter][peer]
-                     << "," << std::fixed << std::setprecision(3) << detailed_times.recv_times[round][iter][peer];
-            }
+            const IterationEvent &iteration = detailed_times.iteration_events[detailed_times.round_offset[round] + i];
+            avg_time += (iteration.end_ns - iteration.start_ns) / 1e6;
+        }
+        avg_time /= iterations;
+        results.push_back({data_sizes[round], avg_time});
+        // 本方的总出口吞吐：每次迭代发到所有连接上的字节数除以平均时间，多端口/多网卡时为各条链路之和
+        double sent_bytes = double(wire_bytes(data_sizes[round]));
+        out << "Average Time: " << std::fixed << std::setprecision(3) << avg_time << " ms, sent "
+                  << sent_bytes / 1024.0 << " KB per iteration (egress " << sent_bytes * 8 / (avg_time * 1e6)
+                  << " Gbit/s), peak RSS " << detailed_times.peak_rss_kb[round] / 1024.0 << " MB" << std::endl;
+        if (options.auto_plan)
+        {
+            double predicted_ms = Engine::predicted_ns(data_sizes[round]) / 1e6;
+            out << "Model: predicted " << predicted_ms << " ms, measured " << avg_time << " ms (ratio "
+                      << (predicted_ms > 0 ? avg_time / predicted_ms : 0) << ")" << std::endl;
+        }
+        print_latency_summary(round);
+        if (options.overlap != "off")
+            print_overlap_summary(round);
 
-            file << "," << party_id << "," << num_parties << std::endl;
+        // 默认消费者的校验和，所有参与方应一致
+        if (!block_checksums.empty())
+        {
+            uint64_t combined = block_checksum(reinterpret_cast<const uint8_t *>(block_checksums.data()),
+                                               block_checksums.size() * sizeof(uint64_t));
+            out << "Sink checksum: " << std::hex << combined << std::dec << std::endl;
         }
     }
 
-    file.close();
-    std::cout << "Detailed results written to: " << filename << std::endl;
-}
-
-void ShareBenchmarkTwoRounds::run_two_rounds_test(const std::vector<size_t> &data_sizes,
-                                                  const std::string &output_csv_1, const std::string &output_csv_2)
-{
-    std::vector<std::pair<size_t, double>> results;
-
-    std::cout << "\n=== Two Rounds EMP Share Benchmark ===" << std::endl;
-    std::cout << "Party: " << party_id << ", Total Parties: " << num_parties << std::endl;
-    std::cout << std::string(50, '=') << std::endl;
+    if (options.batch_sizes.size() > 1 || options.batch_sizes[0] > 1)
+        print_batch_summary(data_sizes);
+    out << std::string(50, '=') << std::endl;
 
-    // 第一轮测试
-    std::cout << "Round 1 - Data Size: " << data_sizes[0] << " bytes ("
-              << (data_sizes[0] / 1024) << " KB)" << std::endl;
-    benchmark_round(data_sizes[0], 0, round_count);
-
-    // 计算第一轮的平均时间
-    double avg_time1 = 0.0;
-    for (auto time : detailed_times.round_times[0])
+    // 汇聚模式下由 party 0 统一写出所有参与方的结果，其余参与方不再各自写结果/连接/分阶段CSV
+    if (options.gather)
     {
-        avg_time1 += time;
+        std::vector<int64_t> records = gather_results();
+        if (party_id == 0)
+            write_gathered_results(records, data_sizes, output_gather, options.gather_csv ? output_summary : "");
     }
-    avg_time1 /= detailed_times.round_times[0].size();
-    results.push_back({data_sizes[0], avg_time1});
-    std::cout << "Average Time: " << std::fixed << std::setprecision(3) << avg_time1 << " ms" << std::endl;
+    else
+    {
+        // 写入原始CSV文件（保持兼容性）
+        write_connection_to_csv(results, output_csv_2);
 
-    // 第二轮测试
-    std::cout << "Round 2 - Data Size: " << data_sizes[1] << " bytes ("
-              << (data_sizes[1] / 1024) << " KB)" << std::endl;
-    benchmark_round(data_sizes[1], 1, round_count);
+        // 写入详细时间CSV文件
+        write_detailed_times_to_csv(data_sizes, output_csv_1);
 
-    // 计算第二轮的平均时间
-    double avg_time2 = 0.0;
-    for (auto time : detailed_times.round_times[1])
-    {
-        avg_time2 += time;
+        write_phases_to_csv(data_sizes, output_csv_5);
     }
-    avg_time2 /= detailed_times.round_times[1].size();
-    results.push_back({data_sizes[1], avg_time2});
-    std::cout << "Average Time: " << std::fixed << std::setprecision(3) << avg_time2 << " ms" << std::endl;
 
-    std::cout << std::string(50, '=') << std::endl;
+    // 流水线模式额外写入每个分块的收发时间
+    if (options.exchange_mode == ExchangeMode::Pipelined)
+        write_chunk_times_to_csv(data_sizes, output_csv_3);
 
-    // 写入原始CSV文件（保持兼容性）
-    write_connection_to_csv(results, output_csv_2);
+    if (options.telemetry)
+        write_telemetry_to_csv(data_sizes, output_csv_4);
 
-    // 写入详细时间CSV文件
-    write_detailed_times_to_csv(data_sizes, output_csv_1);
+    if (options.warmup_cv > 0)
+        write_warmup_to_csv(data_sizes, output_warmup);
+    return results;
 }
 
 // 读取配置文件的辅助函数
 bool read_config(const std::string &filename, int &num_parties,
-                 std::vector<std::string> &ips, std::vector<size_t> &data_sizes_kb)
+                 std::vector<std::string> &ips, std::vector<SweepPoint> &sweep,
+                 BenchmarkOptions &options)
 {
     std::ifstream file(filename);
     if (!file.is_open())
@@ -402,96 +2173,581 @@ bool read_config(const std::string &filename, int &num_parties,
         return false;
     }
 
-    std::istringstream iss(line);
-    size_t size_kb;
-    while (iss >> size_kb)
+    if (!parse_sweep(line, sweep))
+        return false;
+
+    if (sweep.empty())
     {
-        data_sizes_kb.push_back(size_kb);
+        std::cerr << "Expected at least one data size in KB" << std::endl;
+        return false;
     }
 
-    if (data_sizes_kb.size() != 2)
+    // 其余行为可选的 key=value 参数，# 开头为注释
+    while (std::getline(file, line))
     {
-        std::cerr << "Expected exactly 2 data sizes in KB" << std::endl;
-        return false;
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#')
+            continue;
+        if (!parse_option(options, line))
+            return false;
     }
 
     return true;
 }
 
+// 每个阶段：本方按阶段的计算生成自己的块（计入计算时间），经 all-gather 交换（收发时间），再在收到的所有块上计算。
+// 纪元之间按 barrier 参数同步，纪元内的各阶段之间不同步，一个阶段的计算与对端的收发自然交错
+template <typename IO>
+std::pair<size_t, double> ShareBenchmark<IO>::run_workload(const std::string &output_csv)
+{
+    const std::vector<EpochPhase> &phases = options.epoch;
+    const size_t num_phases = phases.size();
+    const size_t elections = options.elections;
+    const int epochs = options.iterations;
+    size_t max_block = 0;
+    size_t wire_per_epoch = 0;
+    for (const auto &phase : phases)
+        max_block = std::max(max_block, phase.size_bytes * elections);
+
+    // plan=auto：按最大的阶段选定一次方案，参数写回本地副本
+    Engine::plan(max_block);
+    static_cast<EngineOptions &>(options) = Engine::options;
+    for (const auto &phase : phases)
+        wire_per_epoch += wire_bytes(phase.size_bytes * elections);
+
+    out << "\n=== SSLE Election Workload ===" << std::endl;
+    out << "Party: " << party_id << ", Total Parties: " << num_parties << std::endl;
+    out << "Algorithm: " << algorithm->name() << ", Exchange mode: " << exchange_mode_name(options.exchange_mode)
+              << std::endl;
+    out << "Epoch:";
+    for (const auto &phase : phases)
+        out << " " << phase.name << " (" << phase.size_bytes << " B, " << phase_compute_name(phase.compute) << ")";
+    out << std::endl;
+    out << "Elections per epoch: " << elections << ", epochs: " << epochs << " (data sizes from the config are not used)"
+              << std::endl;
+    out << std::string(50, '=') << std::endl;
+
+    preallocate_buffers(max_block);
+    emp::PRG prg;
+    std::vector<PayloadStream::Aligned16> scratch((std::max<size_t>(max_block, emp::Hash::DIGEST_SIZE) + 15) / 16);
+    std::vector<StepEvent> events(steps.size());
+    std::vector<ChunkRecord> chunks;
+    std::vector<TelemetryRecord> telemetry;
+
+    // [纪元 * 阶段数 + 阶段] 的收发与计算时间、[纪元] 整个纪元的时间，测量前一次性分配
+    std::vector<int64_t> comm_ns(epochs * num_phases), compute_ns(epochs * num_phases), epoch_ns(epochs);
+
+    auto run_epoch = [&](int64_t *comm, int64_t *compute)
+    {
+        for (size_t i = 0; i < num_phases; i++)
+        {
+            size_t block = phases[i].size_bytes * elections;
+            int64_t start = monotonic_ns();
+            prepare_phase_block(phases[i].compute, prg, scratch.data(), recv_buffers.data() + party_id * block, block);
+            int64_t prepared = monotonic_ns();
+            share_data(block, events.data(), chunks, telemetry);
+            int64_t shared = monotonic_ns();
+            compute_digest ^= process_phase_blocks(phases[i].compute, prg, scratch.data(), recv_buffers.data(),
+                                                   num_parties, block);
+            comm[i] = shared - prepared;
+            compute[i] = (prepared - start) + (monotonic_ns() - shared);
+        }
+    };
+
+    std::vector<int64_t> warmup_comm(num_phases), warmup_compute(num_phases);
+    auto warmup_epoch = [&]()
+    { run_epoch(warmup_comm.data(), warmup_compute.data()); };
+    if (options.warmup_cv > 0)
+    {
+        std::vector<int64_t> warmup_times;
+        warm_up_until_steady(warmup_times, warmup_epoch);
+    }
+    else
+    {
+        for (int i = 0; i < options.warmup; i++)
+            warmup_epoch();
+    }
+
+    for (int epoch = 0; epoch < epochs; epoch++)
+    {
+        if (options.barrier)
+            barrier();
+        int64_t start = monotonic_ns();
+        run_epoch(comm_ns.data() + epoch * num_phases, compute_ns.data() + epoch * num_phases);
+        epoch_ns[epoch] = monotonic_ns() - start;
+    }
+
+    auto print_row = [this](const std::string &label, double comm, double compute, const LatencyHistogram &total)
+    {
+        out << "  " << std::left << std::setw(14) << label << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(12) << comm / 1e3 << std::setw(12) << compute / 1e3 << std::setw(12)
+                  << total.percentile(0.5) / 1e3 << std::setw(12) << total.percentile(0.99) / 1e3 << std::endl;
+    };
+    out << "  " << std::left << std::setw(14) << "Phase (us)" << std::right << std::setw(12) << "comm"
+              << std::setw(12) << "compute" << std::setw(12) << "p50" << std::setw(12) << "p99" << std::endl;
+    double epoch_comm = 0, epoch_compute = 0;
+    for (size_t i = 0; i < num_phases; i++)
+    {
+        double comm = 0, compute = 0;
+        LatencyHistogram total;
+        for (int epoch = 0; epoch < epochs; epoch++)
+        {
+            comm += comm_ns[epoch * num_phases + i];
+            compute += compute_ns[epoch * num_phases + i];
+            total.record(comm_ns[epoch * num_phases + i] + compute_ns[epoch * num_phases + i]);
+        }
+        print_row(phases[i].name, comm / epochs, compute / epochs, total);
+        epoch_comm += comm / epochs;
+        epoch_compute += compute / epochs;
+    }
+    LatencyHistogram epoch_total;
+    double epoch_mean = 0;
+    for (int epoch = 0; epoch < epochs; epoch++)
+    {
+        epoch_total.record(epoch_ns[epoch]);
+        epoch_mean += epoch_ns[epoch];
+    }
+    epoch_mean /= epochs;
+    print_row("epoch", epoch_comm, epoch_compute, epoch_total);
+    out << "Epoch latency: " << std::fixed << std::setprecision(3) << epoch_mean / 1e6 << " ms, "
+              << std::setprecision(1) << elections * 1e9 / epoch_mean << " elections/s, sent "
+              << std::setprecision(3) << wire_per_epoch / 1024.0 << " KB per epoch" << std::endl;
+    out << std::string(50, '=') << std::endl;
+
+    size_t epoch_bytes = 0;
+    for (const auto &phase : phases)
+        epoch_bytes += phase.size_bytes * elections;
+    std::pair<size_t, double> result{epoch_bytes, epoch_mean / 1e6};
+
+    std::ofstream file(output_csv);
+    if (!file.is_open())
+    {
+        std::cerr << "Failed to open workload CSV file: " << output_csv << std::endl;
+        return result;
+    }
+
+    // 每个纪元先是各阶段的行，再是 Phase 为 epoch 的汇总行（Total_ns 为纪元的实际时间）
+    file << "Epoch,Phase,Compute,BlockSize_Bytes,Elections,Comm_ns,Compute_ns,Total_ns,PartyID,NumParties" << std::endl;
+    for (int epoch = 0; epoch < epochs; epoch++)
+    {
+        int64_t comm_sum = 0, compute_sum = 0;
+        for (size_t i = 0; i < num_phases; i++)
+        {
+            int64_t comm = comm_ns[epoch * num_phases + i];
+            int64_t compute = compute_ns[epoch * num_phases + i];
+            comm_sum += comm;
+            compute_sum += compute;
+            file << (epoch + 1) << "," << phases[i].name << "," << phase_compute_name(phases[i].compute) << ","
+                 << phases[i].size_bytes * elections << "," << elections << "," << comm << "," << compute << ","
+                 << comm + compute << "," << party_id << "," << num_parties << std::endl;
+        }
+        file << (epoch + 1) << ",epoch,,," << elections << "," << comm_sum << "," << compute_sum
+             << "," << epoch_ns[epoch] << "," << party_id << "," << num_parties << std::endl;
+    }
+    file.close();
+    out << "Workload results written to: " << output_csv << std::endl;
+    return result;
+}
+
+// 每个参与方一次运行的结果，经控制连接汇总到 party 0
+struct RunResult
+{
+    uint64_t size_bytes;  // 数据大小；workload 为一个纪元各阶段的块大小之和
+    double avg_ms;        // 平均时间；workload 为纪元的平均时间
+    double egress_gbps;   // 本方的总出口吞吐
+};
+
+template <typename IO>
+void ShareBenchmark<IO>::run_daemon(const std::vector<SweepPoint> &sweep)
+{
+    // 每次运行都以启动时的参数为基础，请求之间互不影响
+    const BenchmarkOptions base = options;
+    int listen_fd = -1;
+    int client_fd = -1;
+    std::string pending;
+
+    if (party_id == 0)
+    {
+        listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        int reuse = 1;
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(options.daemon_port);
+        if (bind(listen_fd, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_fd, 1) < 0)
+        {
+            std::string error = std::strerror(errno);
+            close(listen_fd);
+            throw std::runtime_error("Failed to listen on daemon port " + std::to_string(options.daemon_port) + ": " + error);
+        }
+    }
+    out << "Daemon ready: " << num_parties << " parties connected"
+              << (party_id == 0 ? ", accepting runs on port " + std::to_string(options.daemon_port) : "") << std::endl;
+
+    // 请求由 party 0 原样转发：u32 长度 + 文本，长度为 0 表示退出
+    auto forward = [&](const std::string &line)
+    {
+        uint32_t len = line.size();
+        for (int peer_id = 1; peer_id < num_parties; peer_id++)
+        {
+            send_control(peer_id, &len, sizeof(len));
+            if (len > 0)
+                send_control(peer_id, line.data(), len);
+        }
+    };
+
+    for (int run = 1;; run++)
+    {
+        std::string line;
+        std::string default_tag = "run" + std::to_string(run);
+        if (party_id == 0)
+        {
+            // 等待下一个请求；协调端断开后等待下一个协调端连上，各方保持连接不变
+            for (;;)
+            {
+                if (client_fd < 0)
+                {
+                    client_fd = accept(listen_fd, nullptr, nullptr);
+                    if (client_fd < 0)
+                        continue;
+                    pending.clear();
+                    out << "Coordinator connected" << std::endl;
+                }
+                if (!read_line(client_fd, pending, line))
+                {
+                    close(client_fd);
+                    client_fd = -1;
+                    out << "Coordinator disconnected" << std::endl;
+                    continue;
+                }
+                size_t first = line.find_first_not_of(" \t");
+                if (first == std::string::npos || line[first] == '#')
+                    continue;
+                line = line.substr(first);
+                if (line == "shutdown")
+                    break;
+
+                // 先在 party 0 上检查，不合法的请求直接回复，不转发
+                RunSpec spec;
+                std::string error;
+                if (parse_run_spec(line, base, sweep, default_tag, spec, error))
+                    break;
+                write_line(client_fd, "error " + spec.tag + " " + error);
+            }
+            forward(line == "shutdown" ? "" : line);
+        }
+        else
+        {
+            uint32_t len;
+            recv_control(0, &len, sizeof(len));
+            line.resize(len);
+            if (len > 0)
+                recv_control(0, &line[0], len);
+        }
+        if (line.empty() || line == "shutdown")
+            break;
+
+        // 各方换用请求的参数，全部成功时才运行，否则跳过这次请求（下一次请求仍从启动时的参数出发）
+        RunSpec spec;
+        std::string error;
+        bool ready = parse_run_spec(line, base, sweep, default_tag, spec, error);
+        if (ready)
+        {
+            try
+            {
+                reconfigure(spec.options);
+                // 元素大小与 reduce 的段数取决于换用后的参数，运行前逐个检查数据大小，不合法时与其他错误一样拒绝这次请求
+                if (options.workload)
+                {
+                    for (const auto &phase : options.epoch)
+                        validate_data_size(phase.size_bytes * options.elections);
+                }
+                else
+                {
+                    for (const auto &point : spec.sweep)
+                    {
+                        for (int batch : options.batch_sizes)
+                            validate_data_size(point.size_bytes * batch);
+                    }
+                }
+            }
+            catch (const std::exception &e)
+            {
+                ready = false;
+                error = e.what();
+            }
+        }
+        if (!ready)
+            std::cerr << "Run " << spec.tag << " rejected: " << error << std::endl;
+        if (!barrier(ready))
+        {
+            if (party_id == 0)
+                write_line(client_fd, "error " + spec.tag + " " + (ready ? "rejected by another party (see its log)" : error));
+            continue;
+        }
+
+        out << "Run " << spec.tag << ": " << line << std::endl;
+        auto run_start = std::chrono::steady_clock::now();
+        OutputFiles files = output_files(num_parties, party_id, options.network_mode + "_" + spec.tag);
+        std::vector<std::pair<size_t, double>> averages;
+        if (options.workload)
+            averages.push_back(run_workload(files.workload));
+        else
+            averages = run_sweep(spec.sweep, files.results, files.connection, files.chunks, files.telemetry, files.phases,
+                                 files.gather, files.summary, files.warmup);
+        std::vector<RunResult> results;
+        for (const auto &average : averages)
+            results.push_back({average.first, average.second,
+                               wire_bytes(average.first) * 8 / (average.second * 1e6)});
+
+        // 各方的结果经控制连接交给 party 0，由它逐方逐轮发回协调端
+        uint32_t count = results.size();
+        if (party_id != 0)
+        {
+            send_control(0, &count, sizeof(count));
+            send_control(0, results.data(), count * sizeof(RunResult));
+            continue;
+        }
+        double elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - run_start).count();
+        for (int p = 0; p < num_parties; p++)
+        {
+            if (p > 0)
+            {
+                recv_control(p, &count, sizeof(count));
+                results.resize(count);
+                recv_control(p, results.data(), count * sizeof(RunResult));
+            }
+            for (const auto &result : results)
+            {
+                std::ostringstream text;
+                text << "result " << spec.tag << " party=" << p << " size=" << result.size_bytes << " avg_ms=" << std::fixed
+                     << std::setprecision(3) << result.avg_ms << " egress_gbps=" << result.egress_gbps;
+                write_line(client_fd, text.str());
+            }
+        }
+        std::ostringstream done;
+        done << "done " << spec.tag << " " << std::fixed << std::setprecision(3) << elapsed_s << " s";
+        write_line(client_fd, done.str());
+    }
+
+    if (client_fd >= 0)
+    {
+        write_line(client_fd, "bye");
+        close(client_fd);
+    }
+    if (listen_fd >= 0)
+        close(listen_fd);
+    out << "Daemon stopped" << std::endl;
+}
+
+// 按选定的传输层建立连接并运行测试，运行信息写到 out
+template <typename IO>
+int run_benchmark(int party_id, int num_parties, const std::string &network_mode, const std::vector<std::string> &ips,
+                  const std::vector<SweepPoint> &sweep, const BenchmarkOptions &options, std::ostream &out = std::cout)
+{
+    ShareBenchmark<IO> benchmark(party_id, num_parties, options, out);
+
+    // 设置网络连接
+    if (!benchmark.setup_connections(ips, options.base_port))
+    {
+        std::cerr << "Failed to setup network connections" << std::endl;
+        return 1;
+    }
+
+    if (options.daemon_port > 0)
+    {
+        benchmark.run_daemon(sweep);
+        return 0;
+    }
+
+    // 依次测试所有数据大小，workload=ssle 时改为重复运行选举纪元
+    OutputFiles files = output_files(num_parties, party_id, network_mode);
+    if (options.workload)
+        benchmark.run_workload(files.workload);
+    else
+        benchmark.run_sweep(sweep, files.results, files.connection, files.chunks, files.telemetry, files.phases,
+                            files.gather, files.summary, files.warmup);
+    return 0;
+}
+
+// transport=shm：所有参与方作为线程运行在本进程内，依次绑定到可用的 CPU 上，party 0 的输出照常写到标准输出，
+// 其余参与方各写一个日志文件。每个参与方的引擎持有自己的输出流，格式状态互不影响。一个参与方失败时关闭所有链路，阻塞在上面的其他参与方随之出错退出
+int run_simulation(int num_parties, const std::string &network_mode, const std::vector<std::string> &ips,
+                   const std::vector<SweepPoint> &sweep, const BenchmarkOptions &options)
+{
+    BenchmarkOptions shared = options;
+    shared.shm_fabric = std::make_shared<ShmFabric>(num_parties, options.network, options.shm_ring_bytes, options.shm_link_model);
+    std::vector<int> cpus = allowed_cpus();
+
+    std::cout << "Simulating " << num_parties << " parties in one process on " << cpus.size() << " CPUs"
+              << (options.sim_pin ? " (pinned)" : "") << ", ring " << shared.shm_fabric->ring_capacity() / 1024
+              << " KB per connection direction, ";
+    if (options.shm_link_model)
+        std::cout << "link model " << network_mode << ": " << options.network.bandwidth_mbps << " Mbit/s egress, "
+                  << options.network.rtt_ms / 2 << " ms one-way delay" << std::endl;
+    else
+        std::cout << "no link model" << std::endl;
+    if (num_parties > 1)
+        std::cout << "Parties 1-" << num_parties - 1 << " log to sim_log_p" << num_parties << "_id<party>.txt" << std::endl;
+
+    std::vector<int> results(num_parties, 1);
+    std::vector<std::thread> parties;
+    for (int p = 0; p < num_parties; p++)
+    {
+        parties.emplace_back([&, p]()
+                             {
+            std::ofstream log;
+            if (p != 0)
+                log.open("sim_log_p" + std::to_string(num_parties) + "_id" + std::to_string(p) + ".txt",
+                         std::ios::out | std::ios::trunc);
+            if (options.sim_pin)
+                pin_current_thread(cpus[p % cpus.size()]);
+            // 模拟的时延靠睡眠到包的可见时间实现，默认 50us 的定时器余量会让每个包晚到
+            if (options.shm_link_model)
+                ::prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL);
+
+            try
+            {
+                results[p] = run_benchmark<ShmIO>(p, num_parties, network_mode, ips, sweep, shared,
+                                                  p == 0 ? std::cout : log);
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << "Party " << p << " error: " << e.what() << std::endl;
+            }
+            if (results[p] != 0)
+                shared.shm_fabric->abort(); });
+    }
+    for (auto &party : parties)
+        party.join();
+
+    int failed = (int)std::count_if(results.begin(), results.end(), [](int rc)
+                                    { return rc != 0; });
+    if (failed > 0)
+    {
+        std::cerr << failed << " of " << num_parties << " parties failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
-    if (argc != 4)
+    if (argc < 4)
     {
-        std::cout << "Usage: ./share_benchmark <party_id> <config_file> [network_mode]" << std::endl;
+        std::cout << "Usage: ./share_benchmark <party_id> <config_file> [network_mode] [key=value ...]" << std::endl;
         std::cout << "Example: ./share_benchmark 0 config.txt lan" << std::endl;
+        std::cout << "Example: ./share_benchmark all p256_config.txt lan transport=shm" << std::endl;
         std::cout << "Example: ./share_benchmark 0 config.txt wan" << std::endl;
+        std::cout << "Example: ./share_benchmark 0 config.txt wan exchange=duplex" << std::endl;
+        std::cout << "Example: ./share_benchmark 0 config.txt lan workload=ssle elections=64" << std::endl;
+        std::cout << "Example: ./share_benchmark 0 config.txt lan daemon_port=9000 streams=4" << std::endl;
         return 1;
     }
 
     try
     {
-        int party_id = std::stoi(argv[1]);
+        // party_id 为 all 时在本进程内运行所有参与方（transport=shm）
+        bool simulate = std::string(argv[1]) == "all";
+        int party_id = simulate ? 0 : std::stoi(argv[1]);
         std::string config_file = argv[2];
         std::string network_mode = argv[3];
-        if (network_mode != "lan" && network_mode != "wan")
-        {
-            std::cerr << "警告: 网络模式应该是 'lan' 或 'wan'，使用默认值: " << network_mode << std::endl;
-        }
 
         int num_parties = 0;
         std::vector<std::string> ips;
-        std::vector<size_t> data_sizes_kb;
+        std::vector<SweepPoint> sweep;
+        BenchmarkOptions options;
 
-        if (!read_config(config_file, num_parties, ips, data_sizes_kb))
+        if (!read_config(config_file, num_parties, ips, sweep, options))
         {
             std::cerr << "Failed to read config file" << std::endl;
             return 1;
         }
 
+        // 命令行参数覆盖配置文件中的同名参数
+        for (int i = 4; i < argc; i++)
+        {
+            if (!parse_option(options, argv[i]))
+                return 1;
+        }
+
+        if (!options.profiles.count(network_mode))
+        {
+            std::cerr << "Unknown network mode: " << network_mode << " (define it with " << network_mode
+                      << ".<option>=... in the config file)" << std::endl;
+            return 1;
+        }
+        options.network_mode = network_mode;
+        options.network = options.profiles[network_mode];
+        if (options.streams_override > 0)
+            options.network.streams = options.streams_override;
+
         if (party_id < 0 || party_id >= num_parties)
         {
             std::cerr << "Invalid party ID. Must be between 0 and " << num_parties - 1 << std::endl;
             return 1;
         }
 
-        std::cout << "Starting two-rounds benchmark as party " << party_id << std::endl;
-        std::cout << "Number of parties: " << num_parties << std::endl;
-        std::cout << "Network mode: " << network_mode << std::endl;
-        std::cout << "Data sizes from config: " << data_sizes_kb[0] << " KB, "
-                  << data_sizes_kb[1] << " KB" << std::endl;
-
-        ShareBenchmarkTwoRounds benchmark(party_id, num_parties);
-
-        // 设置网络连接
-        int base_port = 8080;
-        if (!benchmark.setup_connections(ips, base_port))
+        if (simulate != (options.transport == "shm"))
         {
-            std::cerr << "Failed to setup network connections" << std::endl;
+            std::cerr << "transport=shm runs every party in one process and requires party_id all" << std::endl;
             return 1;
         }
 
-        // 将KB转换为字节
-        std::vector<size_t> data_sizes_bytes = {
-            data_sizes_kb[0] * 1024,
-            data_sizes_kb[1] * 1024};
-
-        // 生成CSV文件名（包含party信息）
-        std::stringstream csv_filename_1;
-        csv_filename_1 << "benchmark_results_p" << num_parties
-                       << "_id" << party_id
-                       << "_" << network_mode
-                       << ".csv";
+        // 模拟中每个参与方线程由 sim_pin 绑定，cpus 只描述一个参与方的线程
+        if (simulate && !options.cpus.empty())
+        {
+            std::cerr << "cpus pins one party's threads and cannot be used with party_id all (see sim_pin)" << std::endl;
+            return 1;
+        }
 
-        std::stringstream csv_filename_2;
-        csv_filename_2 << "connection_p" << num_parties
-                       << "_id" << party_id
-                       << "_" << network_mode
-                       << ".csv";
+        // 守护进程在全连接上按请求换算法；请求之间重新应用网络配置，quic 的设置在建连时确定
+        if (options.daemon_port > 0)
+        {
+            if (simulate || options.transport == "quic" || options.auto_plan || options.reroute)
+            {
+                std::cerr << "daemon_port requires transport=socket, raw, uring or netio without plan=auto or reroute" << std::endl;
+                return 1;
+            }
+            options.full_mesh = true;
+        }
 
-        // 运行两轮测试
-        benchmark.run_two_rounds_test(data_sizes_bytes, csv_filename_1.str(), csv_filename_2.str());
+        if (simulate)
+            std::cout << "Starting share benchmark as all parties" << std::endl;
+        else
+            std::cout << "Starting share benchmark as party " << party_id << std::endl;
+        std::cout << "Number of parties: " << num_parties << std::endl;
+        std::cout << "Network mode: " << network_mode << std::endl;
+        std::cout << "Data sizes from config:";
+        for (const auto &point : sweep)
+            std::cout << " " << (point.size_bytes % 1024 ? std::to_string(point.size_bytes) + " B"
+                                                         : std::to_string(point.size_bytes / 1024) + " KB");
+        std::cout << std::endl;
+
+        std::cout << "Transport: " << options.transport << std::endl;
+
+        int rc;
+        if (simulate)
+            rc = run_simulation(num_parties, network_mode, ips, sweep, options);
+        else if (options.transport == "netio")
+            rc = run_benchmark<emp::NetIO>(party_id, num_parties, network_mode, ips, sweep, options);
+        else if (options.transport == "raw")
+            rc = run_benchmark<RawSocketIO>(party_id, num_parties, network_mode, ips, sweep, options);
+#ifdef HAVE_IO_URING
+        else if (options.transport == "uring")
+            rc = run_benchmark<UringIO>(party_id, num_parties, network_mode, ips, sweep, options);
+#endif
+#ifdef HAVE_MSQUIC
+        else if (options.transport == "quic")
+            rc = run_benchmark<QuicIO>(party_id, num_parties, network_mode, ips, sweep, options);
+#endif
+        else
+            rc = run_benchmark<SocketIO>(party_id, num_parties, network_mode, ips, sweep, options);
+        if (rc != 0)
+            return rc;
 
-        std::cout << "Two-rounds benchmark completed!" << std::endl;
+        std::cout << "Share benchmark completed!" << std::endl;
     }
     catch (const std::exception &e)
     {
@@ -7,6 +7,11 @@ EMP Share Benchmark 运行脚本
 
 2. 运行脚本:
    python3 run.py
+
+3. 守护进程模式（LOCAL_PROGRAM=./share_benchmark）:
+   各参与方设置 DAEMON_PORT 后运行 run.py，程序建连后常驻；
+   协调端设置 DAEMON_SPECS=<请求文件>（每行一次运行，格式见 README）与 DAEMON_HOST=<party 0 的IP> 后运行 run.py，
+   逐行提交请求并打印各方流式返回的结果
 """
 
 import os
@@ -248,6 +253,7 @@ def run_benchmark(
     print_info(f"  Network Mode: {network_mode}")
 
     base_port = os.environ.get("BASE_PORT", "12367")
+    daemon_port = os.environ.get("DAEMON_PORT")
 
     # 检查程序文件
     if not os.path.exists(program_path):
@@ -255,7 +261,19 @@ def run_benchmark(
         return False
 
     # 构建命令
-    if scheme == "qelect":
+    if os.path.basename(program_path) == "share_benchmark":
+        # share_benchmark 内置 tree/pairwise/hypercube/ring/bruck，拓扑通过 algorithm 参数选择
+        cmd = [
+            program_path,
+            str(party_id),
+            config_path,
+            network_mode,
+            f"algorithm={topology}",
+            f"base_port={base_port}",
+        ]
+        if daemon_port:
+            cmd.append(f"daemon_port={daemon_port}")
+    elif scheme == "qelect":
         cmd = [
             program_path,
             "-i",
@@ -291,7 +309,7 @@ def run_benchmark(
                 stdout=log_file,  # 标准输出重定向到文件
                 stderr=log_file,  # 标准错误也重定向到同一个文件
                 text=True,
-                timeout=60 * 5,  # 超时
+                timeout=None if daemon_port else 60 * 5,  # 超时，守护进程常驻直到协调端发送 shutdown
             )
 
         if result.returncode == 0:
@@ -314,9 +332,50 @@ def run_benchmark(
         return False
 
 
+def submit_daemon_runs(host, port, spec_path, shutdown):
+    """作为协调端把请求文件中的每一行提交给 party 0 的守护进程，打印流式返回的结果"""
+    with open(spec_path, "r") as f:
+        specs = [
+            line.strip()
+            for line in f
+            if line.strip() and not line.strip().startswith("#")
+        ]
+    if shutdown:
+        specs.append("shutdown")
+
+    print_info(f"连接守护进程 {host}:{port}，共 {len(specs)} 个请求")
+    success = True
+    with socket.create_connection((host, int(port))) as conn:
+        reader = conn.makefile("r")
+        for spec in specs:
+            print_info(f"提交: {spec}")
+            conn.sendall((spec + "\n").encode())
+            # 每个请求以 done / error 结束，shutdown 以 bye 结束
+            for line in reader:
+                line = line.rstrip("\n")
+                if line.startswith("error "):
+                    print_error(line)
+                    success = False
+                    break
+                print(line)
+                if line.startswith("done ") or line == "bye":
+                    break
+    return success
+
+
 def main():
     print_info("EMP Share Benchmark 运行脚本")
 
+    # 协调端：只提交请求，不在本机运行参与方
+    daemon_specs = os.environ.get("DAEMON_SPECS")
+    if daemon_specs:
+        return submit_daemon_runs(
+            os.environ.get("DAEMON_HOST", "127.0.0.1"),
+            os.environ.get("DAEMON_PORT", "9000"),
+            daemon_specs,
+            os.environ.get("DAEMON_SHUTDOWN", "1") == "1",
+        )
+
     dufs_server = os.environ.get("DUFS_SERVER", "http://148.135.88.228:5000")
 
     # 配置路径
@@ -325,6 +384,7 @@ def main():
     topology = os.environ.get("TOPOLOGY", "tree")  # pairwise
     network_mode = os.environ.get("NETWORK_MODE", "lan")  # wan
     local_config = os.environ.get("LOCAL_CONFIG", "./config.txt")
+    # 设置 LOCAL_PROGRAM=./share_benchmark 使用仓库内构建的各拓扑实现
     local_program = os.environ.get("LOCAL_PROGRAM", f"./{transport}_{topology}")
 
     # # 验证配置文件并获取参与方数量
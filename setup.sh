@@ -34,8 +34,12 @@ fi
 
 wget -O config.txt "${CONFIG_URL}"
 
-# wget -O share_benchmark "${PROGRAM_URL}"
-# chmod +x share_benchmark
+# tree / pairwise 现在由 share_benchmark 的 algorithm=tree|pairwise 提供，与递归倍增共用同一套计时和CSV格式。
+# share_benchmark 由本仓库用 cmake 构建；只有设置了 PROGRAM_URL 时才下载预先构建的版本
+if [ -n "${PROGRAM_URL:-}" ]; then
+    wget -O share_benchmark "${PROGRAM_URL}"
+    chmod +x share_benchmark
+fi
 
 wget -O tcp_tree "${TCP_TREE_PROGRAM_URL}"
 chmod +x tcp_tree
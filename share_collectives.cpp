@@ -0,0 +1,499 @@
+#include "share_collectives.h"
+
+#include <immintrin.h>
+
+class HypercubeAllGather : public AllGatherAlgorithm
+{
+public:
+    const char *name() const override { return "hypercube"; }
+
+    bool supports(int num_parties) const override
+    {
+        return num_parties >= 1 && (num_parties & (num_parties - 1)) == 0;
+    }
+
+    std::vector<ScheduleStep> schedule(int party_id, int num_parties) const override
+    {
+        std::vector<ScheduleStep> steps;
+        int dimension = 0;
+        for (int mask = 1; mask < num_parties; mask <<= 1, dimension++)
+        {
+            int peer_id = party_id ^ mask;
+            ScheduleStep step;
+            step.send_peer = peer_id;
+            step.recv_peer = peer_id;
+            step.send_blocks = stream(party_id, dimension);
+            step.recv_blocks = stream(peer_id, dimension);
+            step.send_first = party_id < peer_id;
+            steps.push_back(step);
+        }
+        return steps;
+    }
+
+private:
+    // 第i维发送的块序列 S(x, i) = [x] ++ S(x^1, 0) ++ S(x^2, 1) ++ ... ++ S(x^(2^(i-1)), i-1)，
+    // 即先发自己的块，再按到达顺序依次转发之前各维度收到的块，流水线模式可以边收边转发
+    static std::vector<int> stream(int owner, int dimension)
+    {
+        std::vector<int> blocks{owner};
+        for (int j = 0; j < dimension; j++)
+        {
+            std::vector<int> sub = stream(owner ^ (1 << j), j);
+            blocks.insert(blocks.end(), sub.begin(), sub.end());
+        }
+        return blocks;
+    }
+};
+
+// 环形：第k步把k步前收到的块转发给右邻居，共 N-1 步，每步只传一个块，适合大消息、带宽受限的链路
+class RingAllGather : public AllGatherAlgorithm
+{
+public:
+    const char *name() const override { return "ring"; }
+
+    std::vector<ScheduleStep> schedule(int party_id, int num_parties) const override
+    {
+        std::vector<ScheduleStep> steps;
+        for (int k = 0; k + 1 < num_parties; k++)
+        {
+            ScheduleStep step;
+            step.send_peer = (party_id + 1) % num_parties;
+            step.recv_peer = (party_id + num_parties - 1) % num_parties;
+            step.send_blocks = {(party_id + num_parties - k) % num_parties};
+            step.recv_blocks = {(party_id + num_parties - 1 - k) % num_parties};
+            // party 0 先收，打破环上所有人同时阻塞在发送的情况
+            step.send_first = party_id != 0;
+            steps.push_back(step);
+        }
+        return steps;
+    }
+};
+
+// Bruck：第k步把从自己开始的 min(2^k, N-2^k) 个连续块发给 party_id-2^k，
+// 并从 party_id+2^k 收同样多的块，任意N都只需 ceil(log N) 步
+class BruckAllGather : public AllGatherAlgorithm
+{
+public:
+    const char *name() const override { return "bruck"; }
+
+    std::vector<ScheduleStep> schedule(int party_id, int num_parties) const override
+    {
+        std::vector<ScheduleStep> steps;
+        for (int distance = 1; distance < num_parties; distance <<= 1)
+        {
+            int count = std::min(distance, num_parties - distance);
+            ScheduleStep step;
+            step.send_peer = (party_id + num_parties - distance) % num_parties;
+            step.recv_peer = (party_id + distance) % num_parties;
+            for (int b = 0; b < count; b++)
+            {
+                step.send_blocks.push_back((party_id + b) % num_parties);
+                step.recv_blocks.push_back((step.recv_peer + b) % num_parties);
+            }
+            // 按 -distance 平移构成 gcd(N, distance) 个环，每个环中编号最小的一方先收
+            step.send_first = party_id >= std::gcd(num_parties, distance);
+            steps.push_back(step);
+        }
+        return steps;
+    }
+};
+
+// 多端口 Bruck：每轮同时使用 k 个端口，第 r 轮的距离 d = (k+1)^r，第 j 个端口 (j = 1..k) 把从自己开始的
+// min(d, N-j*d) 个块发给 party_id-j*d，并从 party_id+j*d 收同样多的块。一轮结束后持有的连续块数乘以 k+1，
+// 共 ceil(log_{k+1} N) 轮；同一轮的 k 步标记为 concurrent，由各自的线程在不同连接上同时收发
+class MultiportBruckAllGather : public AllGatherAlgorithm
+{
+public:
+    explicit MultiportBruckAllGather(int ports) : ports(ports) {}
+
+    const char *name() const override { return "multiport"; }
+
+    std::vector<ScheduleStep> schedule(int party_id, int num_parties) const override
+    {
+        std::vector<ScheduleStep> steps;
+        for (long distance = 1; distance < num_parties; distance *= ports + 1)
+        {
+            for (int j = 1; j <= ports && j * distance < num_parties; j++)
+            {
+                int offset = (int)(j * distance);
+                int count = (int)std::min<long>(distance, num_parties - offset);
+                ScheduleStep step;
+                step.send_peer = (party_id + num_parties - offset) % num_parties;
+                step.recv_peer = (party_id + offset) % num_parties;
+                for (int b = 0; b < count; b++)
+                {
+                    step.send_blocks.push_back((party_id + b) % num_parties);
+                    step.recv_blocks.push_back((step.recv_peer + b) % num_parties);
+                }
+                step.send_first = party_id >= std::gcd(num_parties, offset);
+                step.concurrent = j > 1;
+                steps.push_back(step);
+            }
+        }
+        return steps;
+    }
+
+private:
+    int ports;
+};
+
+// 二项树：先沿二项树把所有块汇聚到 party 0，再沿同一棵树广播回去，共 2*ceil(log N) 步。
+// 空闲的步骤也保留在调度中，保证各方的步骤编号与CSV列一致
+class TreeAllGather : public AllGatherAlgorithm
+{
+public:
+    const char *name() const override { return "tree"; }
+
+    std::vector<ScheduleStep> schedule(int party_id, int num_parties) const override
+    {
+        std::vector<int> distances;
+        for (int distance = 1; distance < num_parties; distance <<= 1)
+            distances.push_back(distance);
+
+        std::vector<ScheduleStep> steps;
+
+        // 汇聚：第k步中 party_id % 2^(k+1) == 2^k 的一方把自己子树的块交给父节点 party_id - 2^k
+        for (int distance : distances)
+        {
+            ScheduleStep step;
+            if (party_id % (2 * distance) == distance)
+            {
+                step.send_peer = party_id - distance;
+                step.send_blocks = subtree(party_id, distance, num_parties);
+            }
+            else if (party_id % (2 * distance) == 0 && party_id + distance < num_parties)
+            {
+                step.recv_peer = party_id + distance;
+                step.recv_blocks = subtree(party_id + distance, distance, num_parties);
+                step.send_first = false;
+            }
+            steps.push_back(step);
+        }
+
+        // 广播：逆序遍历，父节点把子节点子树以外的所有块发给子节点
+        for (auto it = distances.rbegin(); it != distances.rend(); ++it)
+        {
+            int distance = *it;
+            ScheduleStep step;
+            if (party_id % (2 * distance) == 0 && party_id + distance < num_parties)
+            {
+                step.send_peer = party_id + distance;
+                step.send_blocks = broadcast_stream(party_id + distance, num_parties);
+            }
+            else if (party_id % (2 * distance) == distance)
+            {
+                step.recv_peer = party_id - distance;
+                step.recv_blocks = broadcast_stream(party_id, num_parties);
+                step.send_first = false;
+            }
+            steps.push_back(step);
+        }
+        return steps;
+    }
+
+private:
+    // 以 root 为根、跨度为 distance 的子树包含的块 [root, min(root + distance, N))
+    static std::vector<int> subtree(int root, int distance, int num_parties)
+    {
+        std::vector<int> blocks;
+        for (int b = root; b < std::min(root + distance, num_parties); b++)
+            blocks.push_back(b);
+        return blocks;
+    }
+
+    // 子节点 child 在广播阶段收到的块序列：先是父节点汇聚到的、不属于 child 子树的块，
+    // 再按父节点自己收到广播的顺序转发其余块，流水线模式下父节点可以边收边转发
+    static std::vector<int> broadcast_stream(int child, int num_parties)
+    {
+        int distance = child & -child;
+        int parent = child - distance;
+        int parent_span = parent == 0 ? num_parties : (parent & -parent);
+
+        std::vector<int> blocks;
+        for (int b = parent; b < std::min(parent + parent_span, num_parties); b++)
+        {
+            if (b < child || b >= child + distance)
+                blocks.push_back(b);
+        }
+        if (parent != 0)
+        {
+            std::vector<int> outside = broadcast_stream(parent, num_parties);
+            blocks.insert(blocks.end(), outside.begin(), outside.end());
+        }
+        return blocks;
+    }
+};
+
+// 两两直连（全连接）：第k步把自己的块直接发给 party_id+k，并从 party_id-k 接收，共 N-1 步
+class PairwiseAllGather : public AllGatherAlgorithm
+{
+public:
+    const char *name() const override { return "pairwise"; }
+
+    std::vector<ScheduleStep> schedule(int party_id, int num_parties) const override
+    {
+        std::vector<ScheduleStep> steps;
+        for (int k = 1; k < num_parties; k++)
+        {
+            ScheduleStep step;
+            step.send_peer = (party_id + k) % num_parties;
+            step.recv_peer = (party_id + num_parties - k) % num_parties;
+            step.send_blocks = {party_id};
+            step.recv_blocks = {step.recv_peer};
+            // 与 Bruck 相同：按 +k 平移构成 gcd(N, k) 个环，每个环中编号最小的一方先收
+            step.send_first = party_id >= std::gcd(num_parties, k);
+            steps.push_back(step);
+        }
+        return steps;
+    }
+};
+
+// 种子压缩的分享分发（与 all-gather 对照）：每方 j 把自己的秘密 x_j 加法分享给所有参与方。建连时 j 与每个对端 k
+// 交换 16 字节种子 s_{j,k}，k != j+1 的分享 x_{j,k} = PRG(s_{j,k}) 由 k 在本地展开，线上只有发给 j+1 的修正项
+// x_j - sum_{k != j+1} PRG(s_{j,k})。一步、每方只发一个块，发送量是 all-gather 的 1/(N-1)，代价是本地展开 2N-3 个块。
+// 修正项放在自己的块上发送，调度与环形的单步相同；分发之后块 i 为 i 给本方的分享，自己的块为发给 j+1 的修正项
+class SeededShareDistribution : public AllGatherAlgorithm
+{
+public:
+    const char *name() const override { return "seeded"; }
+
+    std::vector<ScheduleStep> schedule(int party_id, int num_parties) const override
+    {
+        if (num_parties < 2)
+            return {};
+        ScheduleStep step;
+        step.send_peer = (party_id + 1) % num_parties;
+        step.recv_peer = (party_id + num_parties - 1) % num_parties;
+        step.send_blocks = {party_id};
+        step.recv_blocks = {step.recv_peer};
+        step.send_first = party_id != 0;
+        return {step};
+    }
+};
+
+std::unique_ptr<AllGatherAlgorithm> make_algorithm(const std::string &name, int ports)
+{
+    if (name == "hypercube")
+        return std::make_unique<HypercubeAllGather>();
+    if (name == "ring")
+        return std::make_unique<RingAllGather>();
+    if (name == "bruck")
+        return std::make_unique<BruckAllGather>();
+    if (name == "multiport")
+        return std::make_unique<MultiportBruckAllGather>(ports);
+    if (name == "tree")
+        return std::make_unique<TreeAllGather>();
+    if (name == "pairwise")
+        return std::make_unique<PairwiseAllGather>();
+    if (name == "seeded")
+        return std::make_unique<SeededShareDistribution>();
+    return nullptr;
+}
+
+std::vector<std::pair<int, int>> block_runs(std::vector<int> blocks)
+{
+    std::sort(blocks.begin(), blocks.end());
+    std::vector<std::pair<int, int>> runs;
+    for (int block : blocks)
+    {
+        if (!runs.empty() && runs.back().first + runs.back().second == block)
+            runs.back().second++;
+        else
+            runs.push_back({block, 1});
+    }
+    return runs;
+}
+
+std::vector<ReduceStep> reduce_schedule(int party_id, int num_parties, bool allreduce)
+{
+    std::vector<ReduceStep> steps;
+    int lo = 0, hi = num_parties;
+    for (int mask = num_parties / 2; mask >= 1; mask /= 2)
+    {
+        int mid = (lo + hi) / 2;
+        bool upper = party_id & mask;
+        ReduceStep step{party_id ^ mask, upper ? lo : mid, upper ? mid : hi, upper ? mid : lo, upper ? hi : mid, true};
+        steps.push_back(step);
+        lo = step.recv_lo;
+        hi = step.recv_hi;
+    }
+    if (!allreduce)
+        return steps;
+    for (int mask = 1; mask < num_parties; mask *= 2)
+    {
+        int width = hi - lo;
+        bool upper = party_id & mask;
+        ReduceStep step{party_id ^ mask, lo, hi, upper ? lo - width : hi, upper ? lo : hi + width, false};
+        steps.push_back(step);
+        lo = std::min(lo, step.recv_lo);
+        hi = std::max(hi, step.recv_hi);
+    }
+    return steps;
+}
+
+const char *exchange_mode_name(ExchangeMode mode)
+{
+    switch (mode)
+    {
+    case ExchangeMode::Duplex:
+        return "duplex";
+    case ExchangeMode::Pipelined:
+        return "pipelined";
+    default:
+        return "pingpong";
+    }
+}
+
+const char *collective_name(Collective collective)
+{
+    switch (collective)
+    {
+    case Collective::ReduceScatter:
+        return "reduce_scatter";
+    case Collective::AllReduce:
+        return "allreduce";
+    default:
+        return "allgather";
+    }
+}
+
+const char *reduce_op_name(ReduceOp op)
+{
+    switch (op)
+    {
+    case ReduceOp::Xor:
+        return "xor";
+    case ReduceOp::Add64:
+        return "add64";
+    case ReduceOp::Mersenne61:
+        return "mersenne61";
+    default:
+        return "auto";
+    }
+}
+
+const char *payload_kind_name(PayloadKind kind)
+{
+    switch (kind)
+    {
+    case PayloadKind::Mersenne61:
+        return "mersenne61";
+    case PayloadKind::Block:
+        return "block";
+    case PayloadKind::Shares:
+        return "shares";
+    default:
+        return "bytes";
+    }
+}
+
+bool parse_payload_kind(const std::string &value, PayloadKind &kind)
+{
+    for (PayloadKind candidate : {PayloadKind::Bytes, PayloadKind::Mersenne61, PayloadKind::Block, PayloadKind::Shares})
+    {
+        if (value == payload_kind_name(candidate))
+        {
+            kind = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t payload_element_size(PayloadKind kind)
+{
+    switch (kind)
+    {
+    case PayloadKind::Mersenne61:
+    case PayloadKind::Shares:
+        return sizeof(uint64_t);
+    case PayloadKind::Block:
+        return sizeof(emp::block);
+    default:
+        return 1;
+    }
+}
+
+uint64_t block_checksum(const uint8_t *data, size_t len)
+{
+    uint64_t hash = 1469598103934665603ULL;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * 1099511628211ULL;
+    }
+    for (; i < len; i++)
+        hash = (hash ^ data[i]) * 1099511628211ULL;
+    return hash;
+}
+
+const char *combine_kernel_name()
+{
+#if defined(__AVX512F__)
+    return "avx512";
+#elif defined(__AVX2__)
+    return "avx2";
+#else
+    return "scalar";
+#endif
+}
+
+void combine_buffers(ReduceOp op, uint8_t *out, const uint8_t *a, const uint8_t *b, size_t len)
+{
+    constexpr uint64_t kPrime = (uint64_t(1) << 61) - 1;
+    size_t i = 0;
+#if defined(__AVX512F__)
+    const __m512i prime512 = _mm512_set1_epi64(kPrime);
+    for (; i + 64 <= len; i += 64)
+    {
+        __m512i x = _mm512_loadu_si512(a + i);
+        __m512i y = _mm512_loadu_si512(b + i);
+        __m512i z;
+        if (op == ReduceOp::Xor)
+            z = _mm512_xor_si512(x, y);
+        else if (op == ReduceOp::Add64)
+            z = _mm512_add_epi64(x, y);
+        else
+        {
+            __m512i sum = _mm512_add_epi64(x, y);
+            z = _mm512_min_epu64(sum, _mm512_sub_epi64(sum, prime512));
+        }
+        _mm512_storeu_si512(out + i, z);
+    }
+#elif defined(__AVX2__)
+    const __m256i prime256 = _mm256_set1_epi64x(kPrime);
+    const __m256i below256 = _mm256_set1_epi64x(kPrime - 1);
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+        __m256i z;
+        if (op == ReduceOp::Xor)
+            z = _mm256_xor_si256(x, y);
+        else if (op == ReduceOp::Add64)
+            z = _mm256_add_epi64(x, y);
+        else
+        {
+            // AVX2 没有无符号 64 位比较，和小于 2^62，按有符号比较即可
+            __m256i sum = _mm256_add_epi64(x, y);
+            z = _mm256_sub_epi64(sum, _mm256_and_si256(_mm256_cmpgt_epi64(sum, below256), prime256));
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), z);
+    }
+#endif
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t))
+    {
+        uint64_t x, y;
+        std::memcpy(&x, a + i, sizeof(x));
+        std::memcpy(&y, b + i, sizeof(y));
+        uint64_t z = op == ReduceOp::Xor ? x ^ y : x + y;
+        if (op == ReduceOp::Mersenne61 && z >= kPrime)
+            z -= kPrime;
+        std::memcpy(out + i, &z, sizeof(z));
+    }
+    // 只有异或允许不足 8 字节的尾部（其余方式要求数据大小是 8 的倍数）
+    for (; i < len; i++)
+        out[i] = a[i] ^ b[i];
+}
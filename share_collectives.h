@@ -0,0 +1,315 @@
+// 集合操作：all-gather 调度、reduce-scatter/all-reduce 的段调度、测试数据的生成与校验，以及 reduce 的合并内核
+#pragma once
+
+#include <emp-tool/emp-tool.h>
+#include <vector>
+#include <string>
+#include <memory>
+#include <utility>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+// all-gather 调度中的一步：向 send_peer 发送 send_blocks，同时从 recv_peer 接收 recv_blocks。
+// 块编号即party编号，块 b 固定位于缓冲区偏移 b * data_size 处；列表顺序就是线上的字节流顺序，
+// 一方的 send_blocks 必须与对端同一步的 recv_blocks 完全一致
+struct ScheduleStep
+{
+    int send_peer = -1; // -1 表示本步不发送
+    int recv_peer = -1; // -1 表示本步不接收
+    std::vector<int> send_blocks;
+    std::vector<int> recv_blocks;
+    bool send_first = true; // 半双工模式下先发后收还是先收后发，需保证整个环上不会互相等待
+    bool concurrent = false; // 与前一步同时进行（多端口调度中同一轮的其余端口），同一组内各步的发送对端互不相同
+};
+
+class AllGatherAlgorithm
+{
+public:
+    virtual ~AllGatherAlgorithm() = default;
+    virtual const char *name() const = 0;
+    virtual bool supports(int num_parties) const { return num_parties >= 1; }
+    virtual std::vector<ScheduleStep> schedule(int party_id, int num_parties) const = 0;
+};
+
+// 按名称创建 all-gather 调度：hypercube / ring / bruck / multiport / tree / pairwise / seeded，未知的名称返回空。
+// ports 只对 multiport 有效，为每轮同时使用的端口数
+std::unique_ptr<AllGatherAlgorithm> make_algorithm(const std::string &name, int ports = 2);
+
+// 把块列表排序后合并成连续区间（起始块, 块数），半双工/全双工模式按区间整段收发。
+// 收发双方对同一组块排序，得到的顺序一致
+std::vector<std::pair<int, int>> block_runs(std::vector<int> blocks);
+
+// reduce-scatter/all-reduce 的一步，以段为单位：数据按元素均分成 N 段，段 i 为元素 [i*E/N, (i+1)*E/N)。
+// 向 peer 发送段 [send_lo, send_hi)，同时从 peer 接收段 [recv_lo, recv_hi)；combine 为真时收到的段先放进临时区，
+// 再与本方的同一段合并（递归减半），否则直接写入结果（递归倍增）
+struct ReduceStep
+{
+    int peer;
+    int send_lo, send_hi;
+    int recv_lo, recv_hi;
+    bool combine;
+};
+
+// 递归减半：第 k 步与 p ^ (N/2^(k+1)) 交换，当前持有的段区间对半分，对应位为 1 的一方保留上半，
+// log N 步后 party p 持有段 p 的完整和；all-reduce 再按相反的维度顺序把区间逐步倍增回全部 N 段
+std::vector<ReduceStep> reduce_schedule(int party_id, int num_parties, bool allreduce);
+
+// 每一步的收发方式
+enum class ExchangeMode
+{
+    PingPong, // 半双工：低ID先发后收，高ID先收后发
+    Duplex,   // 全双工：发送线程与接收同时进行
+    Pipelined // 流水线：按分块收发，收到的分块立即在后续维度上转发
+};
+
+const char *exchange_mode_name(ExchangeMode mode);
+
+// 集合操作：all-gather，或在超立方体连接上用递归减半做 reduce-scatter（party p 最后持有所有块之和的第 p 段），
+// 再用递归倍增把各段 all-gather 回来得到 all-reduce（每方都持有完整的和）
+enum class Collective
+{
+    AllGather,
+    ReduceScatter,
+    AllReduce
+};
+
+const char *collective_name(Collective collective);
+
+// reduce 的合并方式：按位异或、64 位字模 2^64 相加、2^61-1 上的域元素相加。Auto 按测试数据类型选择
+// （mersenne61/shares 用域加法，shares 的和即秘密，其余类型用异或）
+enum class ReduceOp
+{
+    Auto,
+    Xor,
+    Add64,
+    Mersenne61
+};
+
+const char *reduce_op_name(ReduceOp op);
+
+// 测试数据的类型：随机字节、2^61-1 上的域元素（每个 8 字节）、emp 的 128 位 block，
+// 或 2^61-1 上的加法秘密分享（所有参与方的块逐元素相加等于一个公共的秘密向量）
+enum class PayloadKind
+{
+    Bytes,
+    Mersenne61,
+    Block,
+    Shares
+};
+
+const char *payload_kind_name(PayloadKind kind);
+
+bool parse_payload_kind(const std::string &value, PayloadKind &kind);
+
+// 块大小必须是元素大小的整数倍
+size_t payload_element_size(PayloadKind kind);
+
+// 块内容的 64 位校验和（按 8 字节字做 FNV-1a），各参与方收到的同一块应得到相同的值
+uint64_t block_checksum(const uint8_t *data, size_t len);
+
+// 按顺序生成一个party的块。数据来自 emp::PRG（AES-NI 计数器模式），party p 的块只由 (seed, p) 决定，
+// 任何一方都能在本地重新生成任意一块，收齐后的校验不需要额外通信。
+// 分享模式下 x_p = r_p - r_{p+1}（下标模 N），party 0 再加上秘密 s，各方之和即 s
+class PayloadStream
+{
+public:
+    static constexpr size_t kChunk = 1 << 20; // 单次生成的最大字节数，16 的倍数，分块生成与一次生成的结果相同
+
+    PayloadStream(PayloadKind kind, uint64_t seed, int party, int num_parties)
+        : kind(kind), keys{key(seed, party), key(seed, (party + 1) % num_parties), key(seed, num_parties)},
+          own(&keys[0]), next_party(&keys[1]), secret(&keys[2]), add_secret(party == 0)
+    {
+    }
+
+    // 生成接下来的 len 字节（除最后一次外须为 16 的倍数，且不超过 kChunk），out 须按 16 字节对齐
+    void next(uint8_t *out, size_t len)
+    {
+        own.random_data(out, len);
+        if (kind == PayloadKind::Bytes || kind == PayloadKind::Block)
+            return;
+
+        uint64_t *values = reinterpret_cast<uint64_t *>(out);
+        size_t count = len / sizeof(uint64_t);
+        for (size_t i = 0; i < count; i++)
+            values[i] = reduce(values[i]);
+        if (kind == PayloadKind::Mersenne61)
+            return;
+
+        scratch.resize((count * sizeof(uint64_t) + sizeof(Aligned16) - 1) / sizeof(Aligned16));
+        const uint64_t *other = reinterpret_cast<const uint64_t *>(scratch.data());
+        next_party.random_data(scratch.data(), count * sizeof(uint64_t));
+        for (size_t i = 0; i < count; i++)
+            values[i] = sub(values[i], reduce(other[i]));
+        if (add_secret)
+        {
+            secret.random_data(scratch.data(), count * sizeof(uint64_t));
+            for (size_t i = 0; i < count; i++)
+                values[i] = add(values[i], reduce(other[i]));
+        }
+    }
+
+    // 生成 party 的整块
+    static void fill(PayloadKind kind, uint64_t seed, int party, int num_parties, uint8_t *out, size_t size)
+    {
+        PayloadStream stream(kind, seed, party, num_parties);
+        for (size_t offset = 0; offset < size; offset += kChunk)
+            stream.next(out + offset, std::min(kChunk, size - offset));
+    }
+
+    // 与重新生成的内容逐块比较，返回第一个不一致的字节偏移，全部一致时返回 size
+    static size_t verify(PayloadKind kind, uint64_t seed, int party, int num_parties, const uint8_t *data, size_t size)
+    {
+        PayloadStream stream(kind, seed, party, num_parties);
+        std::vector<Aligned16> buffer((std::min(kChunk, size) + sizeof(Aligned16) - 1) / sizeof(Aligned16));
+        const uint8_t *expected = reinterpret_cast<const uint8_t *>(buffer.data());
+        for (size_t offset = 0; offset < size; offset += kChunk)
+        {
+            size_t len = std::min(kChunk, size - offset);
+            stream.next(reinterpret_cast<uint8_t *>(buffer.data()), len);
+            if (std::memcmp(expected, data + offset, len) != 0)
+            {
+                size_t i = 0;
+                while (expected[i] == data[offset + i])
+                    i++;
+                return offset + i;
+            }
+        }
+        return size;
+    }
+
+    // 以下供 algorithm=seeded 使用。元素为 2^61-1 上的域元素（mersenne61/shares）时按模加减，否则按位异或
+    static bool field(PayloadKind kind) { return kind == PayloadKind::Mersenne61 || kind == PayloadKind::Shares; }
+
+    // 把 16 字节种子展开成 size 字节的伪随机分享，out 须按 16 字节对齐
+    static void expand(PayloadKind kind, const uint8_t *seed, uint8_t *out, size_t size)
+    {
+        emp::PRG prg(seed);
+        for (size_t offset = 0; offset < size; offset += kChunk)
+        {
+            size_t len = std::min(kChunk, size - offset);
+            prg.random_data(out + offset, len);
+            if (field(kind))
+            {
+                uint64_t *values = reinterpret_cast<uint64_t *>(out + offset);
+                for (size_t i = 0; i < len / sizeof(uint64_t); i++)
+                    values[i] = reduce(values[i]);
+            }
+        }
+    }
+
+    // data -= expand(seed)，逐块展开，不需要 size 字节的临时缓冲区
+    static void subtract(PayloadKind kind, const uint8_t *seed, uint8_t *data, size_t size)
+    {
+        emp::PRG prg(seed);
+        std::vector<Aligned16> buffer((std::min(kChunk, size) + sizeof(Aligned16) - 1) / sizeof(Aligned16));
+        const uint8_t *mask = reinterpret_cast<const uint8_t *>(buffer.data());
+        for (size_t offset = 0; offset < size; offset += kChunk)
+        {
+            size_t len = std::min(kChunk, size - offset);
+            prg.random_data(buffer.data(), len);
+            if (field(kind))
+            {
+                uint64_t *values = reinterpret_cast<uint64_t *>(data + offset);
+                const uint64_t *other = reinterpret_cast<const uint64_t *>(mask);
+                for (size_t i = 0; i < len / sizeof(uint64_t); i++)
+                    values[i] = sub(values[i], reduce(other[i]));
+            }
+            else
+            {
+                for (size_t i = 0; i < len; i++)
+                    data[offset + i] ^= mask[i];
+            }
+        }
+    }
+
+    // 线性摘要：与由 challenge 生成的公共随机向量 r 做内积（域元素为 Σ r_k x_k mod p，否则为 64 位字的 XOR_k (r_k & x_k)）。
+    // 摘要对分享是线性的，各方分享的摘要合并（combine）后等于秘密的摘要，校验只需交换 8 字节。
+    // seed 非空时对 expand(seed) 求摘要，不落地展开结果
+    static uint64_t sketch(PayloadKind kind, uint64_t challenge, const uint8_t *data, size_t size,
+                           const uint8_t *seed = nullptr)
+    {
+        emp::block challenge_key = key(challenge, -1); // 与各party的数据流 (seed, 0..N) 不重叠
+        emp::PRG challenge_prg(&challenge_key);
+        std::unique_ptr<emp::PRG> share_prg(seed ? new emp::PRG(seed) : nullptr);
+
+        size_t words = (std::min(kChunk, size) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+        std::vector<Aligned16> r((words * sizeof(uint64_t) + sizeof(Aligned16) - 1) / sizeof(Aligned16));
+        std::vector<Aligned16> x(share_prg ? r.size() : 0);
+        uint64_t result = 0;
+        for (size_t offset = 0; offset < size; offset += kChunk)
+        {
+            size_t len = std::min(kChunk, size - offset);
+            size_t count = (len + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+            challenge_prg.random_data(r.data(), count * sizeof(uint64_t));
+            const uint64_t *rv = reinterpret_cast<const uint64_t *>(r.data());
+            const uint8_t *chunk = data + offset;
+            if (share_prg)
+            {
+                share_prg->random_data(x.data(), len);
+                chunk = reinterpret_cast<const uint8_t *>(x.data());
+            }
+            for (size_t i = 0; i < count; i++)
+            {
+                // 最后一个字不足 8 字节时补零
+                uint64_t value = 0;
+                std::memcpy(&value, chunk + i * sizeof(uint64_t), std::min(sizeof(uint64_t), len - i * sizeof(uint64_t)));
+                if (field(kind))
+                    result = add(result, mul(reduce(rv[i]), share_prg ? reduce(value) : value));
+                else
+                    result ^= rv[i] & value;
+            }
+        }
+        return result;
+    }
+
+    static uint64_t combine(PayloadKind kind, uint64_t a, uint64_t b) { return field(kind) ? add(a, b) : a ^ b; }
+
+    // PRG 按 block 写入，临时缓冲区须按 16 字节对齐
+    struct alignas(16) Aligned16
+    {
+        uint8_t bytes[16];
+    };
+
+private:
+    static constexpr uint64_t kPrime = (uint64_t(1) << 61) - 1;
+
+    PayloadKind kind;
+    emp::block keys[3]; // 三个 PRG 的种子，须在 PRG 之前初始化
+    emp::PRG own;
+    emp::PRG next_party;
+    emp::PRG secret;
+    bool add_secret;
+    std::vector<Aligned16> scratch;
+
+    static emp::block key(uint64_t seed, int stream) { return _mm_set_epi64x(seed, stream); }
+
+    // 取低 61 位映射到 [0, 2^61-1)
+    static uint64_t reduce(uint64_t value)
+    {
+        value &= kPrime;
+        return value == kPrime ? 0 : value;
+    }
+
+    static uint64_t add(uint64_t a, uint64_t b)
+    {
+        uint64_t sum = a + b;
+        return sum >= kPrime ? sum - kPrime : sum;
+    }
+
+    static uint64_t sub(uint64_t a, uint64_t b) { return a >= b ? a - b : a + kPrime - b; }
+
+    static uint64_t mul(uint64_t a, uint64_t b)
+    {
+        __extension__ typedef unsigned __int128 uint128;
+        uint128 product = (uint128)a * b;
+        uint64_t folded = ((uint64_t)product & kPrime) + (uint64_t)(product >> 61);
+        folded = (folded & kPrime) + (folded >> 61);
+        return folded >= kPrime ? folded - kPrime : folded;
+    }
+};
+
+// reduce 的合并内核 out = a (op) b，out 可以与 a 相同。按编译目标（CMakeLists 中的 -march=native）选择 AVX-512 或 AVX2，
+// 不足一个向量的尾部逐字处理。域加法的输入须已约简到 [0, 2^61-1)：两数之和小于 2^62，减去 p 后取较小的无符号值即约简结果
+const char *combine_kernel_name();
+void combine_buffers(ReduceOp op, uint8_t *out, const uint8_t *a, const uint8_t *b, size_t len);
@@ -0,0 +1,289 @@
+#include "share_engine.h"
+
+#include <arpa/inet.h>
+
+bool apply_engine_option(EngineOptions &options, const std::string &key, const std::string &value)
+{
+    if (key == "exchange")
+    {
+        if (value == "pingpong")
+            options.exchange_mode = ExchangeMode::PingPong;
+        else if (value == "duplex")
+            options.exchange_mode = ExchangeMode::Duplex;
+        else if (value == "pipelined")
+            options.exchange_mode = ExchangeMode::Pipelined;
+        else
+        {
+            std::cerr << "Unknown exchange mode: " << value << " (expected pingpong, duplex or pipelined)" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    if (key == "algorithm")
+    {
+        if (!make_algorithm(value))
+        {
+            std::cerr << "Unknown algorithm: " << value << " (expected hypercube, ring, bruck, multiport, tree, pairwise or seeded)" << std::endl;
+            return false;
+        }
+        options.algorithm = value;
+        return true;
+    }
+
+    if (key == "ports")
+    {
+        options.ports = std::stoi(value);
+        if (options.ports <= 0)
+        {
+            std::cerr << "ports must be positive" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    if (key.compare(0, 8, "nic_ips.") == 0)
+    {
+        // nic_ips.<party>=<ip1>,<ip2>,...：该参与方各网卡的地址
+        int party = std::stoi(key.substr(8));
+        if (party < 0)
+        {
+            std::cerr << "nic_ips needs a party id: nic_ips.<party>=<ip>,<ip>,..." << std::endl;
+            return false;
+        }
+        if ((int)options.nic_ips.size() <= party)
+            options.nic_ips.resize(party + 1);
+        std::vector<std::string> &addresses = options.nic_ips[party];
+        addresses.clear();
+        std::istringstream iss(value);
+        std::string address;
+        while (std::getline(iss, address, ','))
+        {
+            in_addr parsed;
+            if (inet_pton(AF_INET, address.c_str(), &parsed) != 1)
+            {
+                std::cerr << "Invalid IP address in " << key << ": " << address << std::endl;
+                return false;
+            }
+            addresses.push_back(address);
+        }
+        return true;
+    }
+
+    if (key == "zerocopy_kb")
+    {
+        options.zerocopy_threshold = std::stoul(value) * 1024;
+        return true;
+    }
+
+    if (key == "uring_sqpoll")
+    {
+        options.uring_sqpoll = value == "1" || value == "true";
+        return true;
+    }
+
+    if (key == "quic_cert")
+    {
+        options.quic.cert_file = value;
+        return true;
+    }
+
+    if (key == "quic_key")
+    {
+        options.quic.key_file = value;
+        return true;
+    }
+
+    if (key == "quic_tickets")
+    {
+        options.quic.ticket_dir = value == "none" ? "" : value;
+        return true;
+    }
+
+    if (key == "telemetry")
+    {
+        options.telemetry = value == "1" || value == "true";
+        return true;
+    }
+
+    if (key == "huge_pages")
+    {
+        if (value != "auto" && value != "off" && value != "2m" && value != "1g")
+        {
+            std::cerr << "huge_pages must be auto, off, 2m or 1g" << std::endl;
+            return false;
+        }
+        options.huge_pages = value;
+        return true;
+    }
+
+    if (key == "numa_node")
+    {
+        if (value == "auto")
+            options.numa_node = kNumaAuto;
+        else if (value == "none")
+            options.numa_node = -1;
+        else
+        {
+            options.numa_node = std::stoi(value);
+            if (options.numa_node < -1)
+            {
+                std::cerr << "numa_node must be auto, none or a node number" << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    if (key == "collective")
+    {
+        for (Collective candidate : {Collective::AllGather, Collective::ReduceScatter, Collective::AllReduce})
+        {
+            if (value == collective_name(candidate))
+            {
+                options.collective = candidate;
+                return true;
+            }
+        }
+        std::cerr << "collective must be allgather, reduce_scatter or allreduce" << std::endl;
+        return false;
+    }
+
+    if (key == "reduce_op")
+    {
+        for (ReduceOp candidate : {ReduceOp::Auto, ReduceOp::Xor, ReduceOp::Add64, ReduceOp::Mersenne61})
+        {
+            if (value == reduce_op_name(candidate))
+            {
+                options.reduce_op = candidate;
+                return true;
+            }
+        }
+        std::cerr << "reduce_op must be auto, xor, add64 or mersenne61" << std::endl;
+        return false;
+    }
+
+    if (key == "payload")
+    {
+        if (!parse_payload_kind(value, options.payload))
+        {
+            std::cerr << "payload must be bytes, mersenne61, block or shares" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    if (key == "sink")
+    {
+        if (value != "none" && value != "file" && value != "callback")
+        {
+            std::cerr << "sink must be none, file or callback" << std::endl;
+            return false;
+        }
+        options.sink = value;
+        return true;
+    }
+
+    if (key == "reroute")
+    {
+        options.reroute = value == "1" || value == "true";
+        return true;
+    }
+
+    if (key == "reroute_factor")
+    {
+        options.reroute_factor = std::stod(value);
+        if (options.reroute_factor <= 0)
+        {
+            std::cerr << "reroute_factor must be positive" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    if (key == "reroute_min_us")
+    {
+        options.reroute_min_us = std::stoll(value);
+        return true;
+    }
+
+    if (key == "plan")
+    {
+        if (value != "fixed" && value != "auto")
+        {
+            std::cerr << "plan must be fixed or auto" << std::endl;
+            return false;
+        }
+        options.auto_plan = value == "auto";
+        return true;
+    }
+
+    if (key == "plan_probe_kb")
+    {
+        size_t probe_kb = std::stoul(value);
+        if (probe_kb == 0)
+        {
+            std::cerr << "plan_probe_kb must be positive" << std::endl;
+            return false;
+        }
+        options.probe_bytes = probe_kb * 1024;
+        return true;
+    }
+
+    if (key == "cpus")
+    {
+        // 逗号分隔的 CPU 编号，每项可以是 <起始>-<结束>
+        std::vector<int> allowed = allowed_cpus();
+        options.cpus.clear();
+        std::istringstream iss(value);
+        std::string item;
+        while (std::getline(iss, item, ','))
+        {
+            size_t dash = item.find('-');
+            int first = std::stoi(item.substr(0, dash));
+            int last = dash == std::string::npos ? first : std::stoi(item.substr(dash + 1));
+            for (int cpu = first; cpu <= last; cpu++)
+            {
+                if (std::find(allowed.begin(), allowed.end(), cpu) == allowed.end())
+                {
+                    std::cerr << "cpu " << cpu << " is not available to this process" << std::endl;
+                    return false;
+                }
+                options.cpus.push_back(cpu);
+            }
+        }
+        if (options.cpus.empty())
+        {
+            std::cerr << "cpus must list at least one cpu" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    if (key == "spin_recv")
+    {
+        options.spin_recv = value == "1" || value == "true";
+        return true;
+    }
+
+    if (key == "connect_timeout_s")
+    {
+        options.connect_timeout_ms = std::stoi(value) * 1000;
+        return true;
+    }
+
+    if (key == "chunk_kb")
+    {
+        size_t chunk_kb = std::stoul(value);
+        if (chunk_kb == 0)
+        {
+            std::cerr << "chunk_kb must be positive" << std::endl;
+            return false;
+        }
+        options.chunk_size = chunk_kb * 1024;
+        return true;
+    }
+
+    std::cerr << "Unknown option: " << key << std::endl;
+    return false;
+}
@@ -0,0 +1,2291 @@
+// 分享引擎：在 share_transport 建立的连接上执行 share_collectives 的调度，share_benchmark 与其他程序共用。
+// 计时通过 Clock 策略注入：默认的 NullClock 不读时钟，只用于测量的等待（发送等到数据上线、接收前 poll）、
+// 流水线分块记录与 TCP_INFO 采样在编译期去掉，生产调用不为测量付出代价；测试程序使用 SteadyClock
+#pragma once
+
+#include "share_transport.h"
+#include "share_collectives.h"
+
+#include <vector>
+#include <string>
+#include <map>
+#include <array>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <deque>
+#include <atomic>
+#include <functional>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+#include <utility>
+#include <stdexcept>
+
+// numa_node=auto：绑定到本机网卡所在的节点
+constexpr int kNumaAuto = -2;
+
+// reroute：每一步先按原样接收这么多次，积累接收时间的估计后才开始按截止时间判断
+constexpr int kRerouteWarmup = 4;
+
+// plan=auto 的标定：每个链路上小消息的大小、每种消息往返的次数（取最短）、测分块开销时每次发送的大小、最多标定的轮数
+constexpr size_t kProbeSmall = 64;
+constexpr int kProbeReps = 5;
+constexpr size_t kProbePiece = 16 * 1024;
+constexpr int kProbeRounds = 3;
+
+// 引擎参数，对应配置文件/命令行中与分享本身有关的 key=value
+struct EngineOptions
+{
+    ExchangeMode exchange_mode = ExchangeMode::PingPong;
+    size_t chunk_size = 64 * 1024; // 流水线模式的分块大小（字节），配置项 chunk_kb
+    std::string algorithm = "hypercube";
+    int connect_timeout_ms = 120000; // 等待所有对端上线的最长时间，配置项 connect_timeout_s
+    size_t zerocopy_threshold = 0;   // raw 传输中达到该大小的发送使用 MSG_ZEROCOPY，0 表示关闭
+    bool uring_sqpoll = false;       // uring 传输使用 SQPOLL 内核轮询线程
+    NetworkProfile network;          // 每一条连接使用的网络配置
+    bool telemetry = false;          // 每一步前后采样各连接的 TCP_INFO，只在带计时的引擎上生效
+    std::string huge_pages = "auto"; // 缓冲区大页：auto / off / 2m / 1g
+    int numa_node = kNumaAuto;       // 缓冲区绑定的 NUMA 节点，-1 表示不绑定
+    Collective collective = Collective::AllGather; // 集合操作
+    ReduceOp reduce_op = ReduceOp::Auto;           // reduce-scatter/all-reduce 的合并方式
+    PayloadKind payload = PayloadKind::Bytes;      // 块数据的类型，决定元素大小与 reduce 的默认合并方式
+    std::string sink = "none";       // 流式输出：none / file / callback
+    QuicSettings quic;               // quic 传输的证书与会话恢复票据目录
+    std::shared_ptr<ShmFabric> shm_fabric; // shm 传输：同一进程内所有参与方线程共用的链路
+    bool reroute = false;            // 某一步的接收超过截止时间时，改从已有这些块的其他参与方取回
+    double reroute_factor = 4;       // 截止时间 = 该步接收时间的平滑均值 + reroute_factor * 平均偏差
+    int64_t reroute_min_us = 1000;   // 截止时间的下限 (us)
+    bool auto_plan = false;          // plan=auto：标定 alpha-beta 模型后自动选择算法、收发方式、分块大小与条带数
+    size_t probe_bytes = 1 << 20;    // 标定时测带宽的消息大小，配置项 plan_probe_kb
+    std::vector<int> cpus;           // 第一个 CPU 绑定构造引擎的线程，其余给收发线程，空表示不绑定
+    bool spin_recv = false;          // raw 传输的接收在用户态自旋等待数据，不在内核中睡眠
+    int ports = 2;                   // algorithm=multiport 每轮同时使用的端口（连接）数
+    std::vector<std::vector<std::string>> nic_ips; // 下标为参与方编号：该方各网卡的地址，连接按编号轮流分到各网卡，空表示只用 ips
+    bool full_mesh = false;          // 与所有参与方建连，之后可以用 reconfigure 换算法（守护进程模式）
+};
+
+// 设置一个引擎参数，未知的 key 或非法取值时打印原因并返回 false
+bool apply_engine_option(EngineOptions &options, const std::string &key, const std::string &value);
+
+// 计时策略：now() 返回纳秒时间戳，enabled 为 false 时引擎跳过所有只用于测量的操作
+struct SteadyClock
+{
+    static constexpr bool enabled = true;
+    static int64_t now() { return monotonic_ns(); }
+};
+
+struct NullClock
+{
+    static constexpr bool enabled = false;
+    static constexpr int64_t now() { return 0; }
+};
+
+// 流水线模式下单个分块的收发记录，时间相对于本次迭代开始
+struct ChunkRecord
+{
+    int step;
+    bool is_send;
+    int chunk_index;
+    size_t bytes;
+    double start_ms;
+    double end_ms;
+};
+
+// 一步中一条连接在收发前后的 TCP_INFO 采样
+struct TelemetryRecord
+{
+    int step;
+    bool is_send;
+    int peer;
+    int stream;
+    TcpInfo before;
+    TcpInfo after;
+};
+
+// 一步的分阶段耗时 (ns)。本步没有该方向时为 0，该阶段在当前传输层/模式下无法单独测量时为 -1；NullClock 下全为 0
+struct StepEvent
+{
+    int64_t send_ns;         // 发送开始到全部数据发到线上；流水线模式下为本步发送完成时刻（相对迭代开始）
+    int64_t recv_ns;         // 接收开始到全部数据写入缓冲区；流水线模式下为本步接收完成时刻（相对迭代开始）
+    int64_t serialize_ns;    // 组装本步收发的 iovec
+    int64_t send_syscall_ns; // 发送调用本身（含 flush），即拷贝进内核的时间
+    int64_t send_wait_ns;    // 等待对端窗口放行剩余数据；流水线模式下还包括等待转发的分块到达
+    int64_t recv_wait_ns;    // 接收开始到第一个字节可读
+    int64_t recv_syscall_ns; // 第一个字节可读到接收完成
+    int64_t combine_ns;      // reduce 时收到的段与本方的段合并，接收完成之后进行，不计入 recv_ns
+};
+
+// 流式输出的消费者：block 为party编号，data/len 为该块本次迭代的最终内容
+using BlockConsumer = std::function<void(int block, const uint8_t *data, size_t len)>;
+
+// 异步分享的每步回调：step 为步骤编号，blocks 为本步收到的块（此后内容不再变化，可以直接读取），调用来自 IO 线程。
+// 流水线模式下各接收线程各自调用，多端口调度中同一轮的各步也各自调用，不同步骤的回调可能并发
+using StepCallback = std::function<void(size_t step, const std::vector<int> &blocks)>;
+
+// 单线程任务队列：异步分享在这个线程上执行（每一步内部的收发线程照旧），调用方线程空出来做本地计算。
+// 所有分享共用一块缓冲区，同一时刻只有一个在进行，一个线程就够了
+class IoWorker
+{
+public:
+    IoWorker() : worker([this]() { pin_worker_thread(); run(); }) {}
+
+    ~IoWorker()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        cv.notify_all();
+        worker.join();
+    }
+
+    // 任务抛出的异常由返回的 future 传出
+    std::future<void> submit(std::function<void()> task)
+    {
+        auto packaged = std::make_shared<std::packaged_task<void()>>(std::move(task));
+        std::future<void> result = packaged->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back([packaged]() { (*packaged)(); });
+        }
+        cv.notify_one();
+        return result;
+    }
+
+private:
+    void run()
+    {
+        for (;;)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                if (tasks.empty())
+                    return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::function<void()>> tasks;
+    bool stopping = false;
+    std::thread worker; // 最后初始化，线程启动时其余成员已就绪
+};
+
+// N 方分享引擎。用法：构造后 setup_connections 建立连接，input 取得本方输入的位置并写入，
+// share（或 share_async / share_batch）完成一次集合操作，之后从 block_data / result 读取结果。
+// 连接、缓冲区和调度在多次分享之间复用；所有参与方须以相同的参数和数据大小调用
+template <typename IO, typename Clock = NullClock>
+class ShareEngine
+{
+public:
+    // 运行信息写到 out；同一进程内的多个引擎（transport=shm 的模拟）各自传入不同的流
+    ShareEngine(int party_id, int num_parties, const EngineOptions &options = EngineOptions(), std::ostream &out = std::cout);
+    ~ShareEngine();
+
+    // 替换 sink=callback 时的消费者，调用可能来自不同的收发线程，同一块不会并发
+    void set_block_consumer(BlockConsumer consumer)
+    {
+        block_consumer = std::move(consumer);
+        block_checksums.clear();
+    }
+
+    // 网络设置
+    bool setup_connections(const std::vector<std::string> &ips, int base_port);
+
+    // 按 data_size 分配缓冲区（已足够大时只检查大小），分配后向传输层注册。变大时重新分配，之前的内容不保留
+    void preallocate_buffers(size_t data_size);
+
+    // 本方输入的位置（data_size 字节）：all-gather 为自己的块，seeded 为本方的秘密，reduce 为参与求和的向量。
+    // 缓冲区不够时先按 data_size 分配
+    uint8_t *input(size_t data_size);
+
+    // 同步完成一次分享
+    void share(size_t data_size);
+
+    // 一次传递完成 M 个独立实例的分享：inputs[m] 为本方第 m 个实例的 instance_size 字节，所有实例拼接成本方的一个块，
+    // 只走一遍调度（每步载荷为 M * instance_size，往返次数与单个实例相同），结束后按实例拆回：outputs[m] 收到
+    // N * instance_size 字节，按party编号排列。须在 setup_connections 之后调用，所有参与方的 M 和实例大小须相同
+    void share_batch(const std::vector<const uint8_t *> &inputs, const std::vector<uint8_t *> &outputs,
+                     size_t instance_size);
+
+    // 在 IO 线程上开始一次分享并立即返回，调用方可以在收到的块上先行计算：on_step 在每一步接收完成后调用，
+    // 返回的 future 在所有步骤完成后就绪（异常也经它传出）。future 就绪前不能开始下一次分享，
+    // 自己的块与发出的块在此之前也不能修改。缓冲区须已按 data_size 分配
+    std::future<void> share_async(size_t data_size, StepCallback on_step = nullptr);
+
+    // 本方拥有的块（party编号索引），share_async 的回调通知某块到达后即可读取
+    const uint8_t *block_data(int block, size_t data_size) const { return recv_buffers.data() + block * data_size; }
+
+    // reduce-scatter/all-reduce 的结果（各方输入之和）：all-reduce 为完整的 data_size 字节，
+    // reduce-scatter 时只有本方的段（按元素均分的第 party_id 段）有效
+    const uint8_t *result() const { return recv_buffers.data(); }
+
+    // 所有参与方都调用后才返回，返回值为所有参与方的 ready 是否都为 true
+    bool barrier(bool ready = true);
+
+    // 每次分享本方发出的字节数
+    size_t wire_bytes(size_t data_size) const;
+
+    // plan=auto：在已建立的连接上标定 alpha-beta 模型，为 data_size 预测每种算法、收发方式、分块大小与条带数的耗时并选用
+    // 最快的，所有参与方得到同样的选择。须在 setup_connections 之后由所有参与方调用，只在第一次调用时生效；
+    // 没有调用时第一次分享按其数据大小选择。plan=fixed 时什么都不做
+    void plan(size_t data_size);
+
+    // 选定的方案对 data_size 的预测耗时 (ns)，没有经过 plan=auto 选择时为 0
+    double predicted_ns(size_t data_size) const;
+
+    // 在已建立的全连接（full_mesh）上换用 next 中的算法、端口数、收发方式、分块大小、网络配置（重新应用到每条连接上，
+    // 条带数不超过建连时的连接数）与遥测开关，其余参数决定连接与缓冲区，保持不变。参数不合法时抛出异常且不做任何更改。
+    // 须在两次分享之间由所有参与方以相同的参数调用
+    void reconfigure(const EngineOptions &next);
+
+protected:
+    int party_id;
+    int num_parties;
+    std::unique_ptr<AllGatherAlgorithm> algorithm;
+    std::vector<ScheduleStep> steps;
+    std::vector<std::vector<IO *>> ios; // [对端编号][连接序号]，未连接的对端为空
+    BufferArena recv_buffers;          // 所有分享共用的收发缓冲区，按最大的数据大小分配
+    int buffer_numa_node = -1;         // 缓冲区绑定的 NUMA 节点，由 numa_node 参数或本机网卡决定
+    EngineOptions options;
+    std::ostream &out;                 // 运行信息的输出流，引擎另起的线程也写到这里
+    double connection_time_ms = 0;     // 建立连接的时间
+
+    // 屏障与时钟同步专用的无缓冲连接，按party编号索引，-1 表示没有。不与数据共用 IO：
+    // 带 stdio 缓冲的 IO 在读写切换时会丢弃预读的数据，对端紧随控制消息发出的数据可能因此丢失
+    std::vector<int> control_fds;
+    std::vector<std::unique_ptr<ShmIO>> shm_control; // shm 传输的控制连接（内存环），按party编号索引
+
+    // 每一步排序合并后的收发区间，半双工/全双工模式使用
+    struct StepRuns
+    {
+        std::vector<std::pair<int, int>> send;
+        std::vector<std::pair<int, int>> recv;
+    };
+    std::vector<StepRuns> step_runs;
+
+    // 流式输出：每个块在一次迭代中的最后一次使用（接收完成、之后不再转发）结束后交给 block_consumer，
+    // 随后释放其内存。可选 block_uses 为每个块在一次迭代中的使用次数（接收一次，加上每个发送它的步骤），
+    // block_pending 为本次迭代剩余的次数，收发线程并发递减
+    std::vector<int> block_uses;
+    std::unique_ptr<std::atomic<int>[]> block_pending;
+    BlockConsumer block_consumer;
+    std::string sink_filename;             // sink=file 时映射的输出文件，最后一次分享收齐的所有块保存在其中
+    std::vector<uint64_t> block_checksums; // sink=callback 时默认消费者计算的每个块的校验和
+
+    // algorithm=seeded：seeds_out[k] 为本方给 k 的分享种子 s_{j,k}（含只有自己知道的 s_{j,j}），seeds_in[i] 为 i 给本方的 s_{i,j}
+    bool seeded = false;
+    std::vector<std::array<uint8_t, 16>> seeds_out;
+    std::vector<std::array<uint8_t, 16>> seeds_in;
+
+    // reduce-scatter/all-reduce 每一步的收发段，与 steps 一一对应；all-gather 时为空。
+    // 结果（各段之和）在 recv_buffers 开头的 data_size 字节，递归减半收到的段先放在其后的临时区
+    std::vector<ReduceStep> reduce_steps;
+
+    // seeded 与 reduce 的本方输入（秘密 x_j / 参与求和的向量）：seeded 时自己的块在每次迭代中被修正项覆盖，
+    // reduce 时缓冲区开头被结果覆盖，输入另存在这里，每次迭代从同样的输入开始
+    BufferArena local_input;
+
+    // 异步分享：step_callback 在分享进行期间有效。share / share_batch / share_async 的步骤记录写入 scratch_*，
+    // 调用方不读取
+    StepCallback step_callback;
+    std::unique_ptr<IoWorker> io_worker;
+    std::vector<StepEvent> scratch_events;
+    std::vector<ChunkRecord> scratch_chunks;
+    std::vector<TelemetryRecord> scratch_telemetry;
+
+    void share_data(size_t size, StepEvent *events, std::vector<ChunkRecord> &chunks,
+                    std::vector<TelemetryRecord> &telemetry);
+    std::future<void> start_share(size_t data_size, StepEvent *events, std::vector<ChunkRecord> &chunks,
+                                  std::vector<TelemetryRecord> &telemetry, StepCallback on_step);
+    void send_control(int peer_id, const void *data, size_t len);
+    void recv_control(int peer_id, void *data, size_t len);
+    void scatter_batch(size_t instance_size, const std::vector<uint8_t *> &outputs);
+    size_t reduce_offset(int segment, size_t data_size) const;
+    void validate_data_size(size_t data_size) const;
+
+private:
+    void exchange_pingpong(size_t step_index, size_t data_size, StepEvent &event);
+    void exchange_duplex(size_t step_index, size_t data_size, StepEvent &event);
+    void share_data_pipelined(size_t data_size, StepEvent *events, std::vector<ChunkRecord> &chunks,
+                              std::vector<TelemetryRecord> &telemetry);
+    bool sampling() const { return Clock::enabled && options.telemetry; }
+    std::vector<TcpInfo> sample_link(int peer_id) const;
+    void append_telemetry(int step, bool is_send, int peer_id, const std::vector<TcpInfo> &before,
+                          std::vector<TelemetryRecord> &telemetry) const;
+    std::vector<iovec> run_segments(const std::vector<std::pair<int, int>> &runs, size_t data_size);
+    std::vector<int> connection_peers() const;
+    void reset_block_pending();
+    void release_blocks(const std::vector<int> &blocks, size_t data_size);
+    void exchange_seeds();
+    int64_t seeded_prepare(size_t data_size);
+    int64_t seeded_expand(size_t data_size);
+    void step_segments(size_t step_index, size_t data_size, std::vector<iovec> &send_segments,
+                       std::vector<iovec> &recv_segments);
+    size_t reduce_element_size() const;
+
+    // reroute：接收超时后向另一个已经收到这些块的参与方取回剩余的字节。每对参与方另有两条取块连接，
+    // 各由一方发起请求，对端的取块服务线程应答；迟到的数据由后台线程读出丢弃，该链路下一次接收前读完
+    struct FetchRequest
+    {
+        uint64_t share_seq; // 请求方当前分享的序号，各方的分享按同样的顺序编号
+        uint64_t data_size;
+        uint32_t count;     // 其后跟 count 个 uint32_t 块号，按本步在线上的顺序
+        uint32_t skip;      // 第一个块中请求方已经收到的字节数
+    };
+
+    // 每一步接收时间的平滑估计，与 TCP 的重传超时相同：均值 + factor * 平均偏差。只用按时完成的接收更新
+    struct StepDeadline
+    {
+        double mean_ns = 0;
+        double deviation_ns = 0;
+        int samples = 0;
+    };
+
+    std::vector<StepDeadline> step_deadlines;
+    std::vector<std::vector<int>> acquired_at; // [参与方][块] 该方在第几步收到该块，自己的块为 -1，收不到为 INT_MAX
+    std::vector<int> fetch_fds;                // [对端] 本方向对端请求的取块连接
+    std::vector<int> serve_fds;                // [对端] 对端向本方请求的取块连接
+    std::vector<bool> fetch_failed;            // [对端] 取块中途出错，该连接不再使用
+    // 每个块最近一次开始写入/写完时的分享序号，取块服务据此判断块是否已经收齐、发送期间是否被下一次分享改写
+    std::unique_ptr<std::atomic<uint64_t>[]> block_writing;
+    std::unique_ptr<std::atomic<uint64_t>[]> block_written;
+    std::atomic<uint64_t> share_seq{0};
+    std::atomic<size_t> share_size{0};
+    std::vector<std::thread> drains;               // [对端] 读出并丢弃该对端迟到的数据
+    std::vector<std::exception_ptr> drain_errors;
+    std::thread assist_thread;
+    int assist_wake[2] = {-1, -1};
+    std::atomic<bool> assist_stopping{false};
+    std::mutex assist_mutex; // 取块服务读取缓冲区期间持有，重新分配缓冲区前须先取得
+    std::condition_variable assist_cv;
+
+    // plan=auto：标定得到的 alpha-beta 模型，[0] 为 1 条连接，[1] 为 streams 条连接条带收发，条带数在两者之间线性插值。
+    // alpha 为单向固定开销 (ns)，beta 为每字节耗时 (ns)，gamma 为一条连接上多发一个分块的开销 (ns)。
+    // 由 party 0 汇总后广播，所有参与方相同
+    struct CostModel
+    {
+        double alpha_ns[2] = {0, 0};
+        double beta_ns[2] = {0, 0};
+        double gamma_ns = 0;
+        int streams = 1;
+    };
+
+    // 每个参与方调度的形状：[party][步] 为 (发送块数, 接收块数)
+    using ScheduleShape = std::vector<std::vector<std::pair<int, int>>>;
+
+    CostModel cost_model;
+    bool planned = false;
+    std::vector<std::vector<IO *>> spare_ios; // [对端编号] 当前条带数之外的连接（序号从大到小），保持打开直到析构
+
+    void index_schedule();
+    void set_stripes(int stripes);
+    void check_concurrent_steps(const AllGatherAlgorithm &schedule_algorithm, const std::vector<ScheduleStep> &schedule,
+                                ExchangeMode exchange) const;
+    int probe_partner(int round) const;
+    int64_t probe_rtt(bool initiator, const std::vector<IO *> &link, uint8_t *buffer, size_t bytes, size_t piece);
+    ScheduleShape schedule_shape(const AllGatherAlgorithm &candidate) const;
+    double predict(const ScheduleShape &shape, ExchangeMode exchange, size_t chunk_size, int stripes,
+                   size_t data_size) const;
+
+    void recv_rerouted(size_t step_index, size_t data_size, const std::vector<iovec> &segments);
+    int reroute_holder(size_t step_index, const std::vector<int> &blocks, int late_peer) const;
+    bool fetch_blocks(int holder, size_t data_size, const std::vector<int> &blocks, size_t skip);
+    void join_drain(int peer_id);
+    void serve_assists();
+    void serve_request(int fd);
+};
+
+template <typename IO, typename Clock>
+ShareEngine<IO, Clock>::ShareEngine(int pid, int nparties, const EngineOptions &opts, std::ostream &os)
+    : party_id(pid), num_parties(nparties), options(opts), out(os)
+{
+    // plan=auto：先按全连接建连，标定后再选定算法与收发方式，在此之前用 ring 占位
+    if (options.auto_plan)
+    {
+        if (options.collective != Collective::AllGather || options.algorithm == "seeded" || options.reroute)
+            throw std::invalid_argument("plan=auto chooses among the all-gather algorithms and does not support reroute");
+        options.algorithm = "ring";
+    }
+
+    algorithm = make_algorithm(options.algorithm, options.ports);
+    if (!algorithm)
+    {
+        throw std::invalid_argument("Unknown algorithm: " + options.algorithm);
+    }
+    if (!algorithm->supports(num_parties))
+    {
+        throw std::invalid_argument(std::string("Algorithm ") + algorithm->name() +
+                                    " does not support " + std::to_string(num_parties) + " parties" +
+                                    " (hypercube requires a power of two)");
+    }
+#ifdef HAVE_IO_URING
+    // 流水线模式每条连接各占一个收发线程，ring 不能被多个线程同时使用，只能退回普通的 sendmsg/recvmsg，测的就不是 io_uring 了
+    if (std::is_same_v<IO, UringIO> && options.exchange_mode == ExchangeMode::Pipelined)
+        throw std::invalid_argument("transport=uring supports exchange=pingpong or duplex");
+#endif
+
+    seeded = options.algorithm == "seeded";
+    if (seeded && options.sink != "none")
+    {
+        // 本地展开的块不经过收发，不会交给流式输出
+        throw std::invalid_argument("Algorithm seeded does not support sink=" + options.sink);
+    }
+
+    steps = algorithm->schedule(party_id, num_parties);
+    if (options.collective != Collective::AllGather)
+    {
+        if (options.algorithm != "hypercube")
+            throw std::invalid_argument(std::string("collective=") + collective_name(options.collective) +
+                                        " runs on the hypercube links (algorithm=hypercube)");
+        if (options.exchange_mode == ExchangeMode::Pipelined || options.sink != "none")
+            throw std::invalid_argument(std::string("collective=") + collective_name(options.collective) +
+                                        " supports exchange=pingpong or duplex without sink");
+        if (options.reduce_op == ReduceOp::Auto)
+            options.reduce_op = PayloadStream::field(options.payload) ? ReduceOp::Mersenne61 : ReduceOp::Xor;
+        if (options.reduce_op == ReduceOp::Mersenne61 && !PayloadStream::field(options.payload))
+            throw std::invalid_argument("reduce_op=mersenne61 requires payload=mersenne61 or shares");
+
+        // 与超立方体 all-gather 使用同样的维度和先后顺序，只是每步收发的是段而不是块
+        reduce_steps = reduce_schedule(party_id, num_parties, options.collective == Collective::AllReduce);
+        steps.clear();
+        for (const auto &reduce : reduce_steps)
+        {
+            ScheduleStep step;
+            step.send_peer = reduce.peer;
+            step.recv_peer = reduce.peer;
+            step.send_first = party_id < reduce.peer;
+            steps.push_back(step);
+        }
+        out << "Collective " << collective_name(options.collective) << ", combine " << reduce_op_name(options.reduce_op)
+                  << " (" << combine_kernel_name() << " kernel)" << std::endl;
+    }
+
+    check_concurrent_steps(*algorithm, steps, options.exchange_mode);
+
+    if (!options.nic_ips.empty())
+    {
+        // 只有 connect_mesh 建立的连接可以指定源地址和目的地址
+        bool meshed = !std::is_same_v<IO, emp::NetIO> && !std::is_same_v<IO, ShmIO>;
+#ifdef HAVE_MSQUIC
+        meshed = meshed && !std::is_same_v<IO, QuicIO>;
+#endif
+        if (!meshed)
+            throw std::invalid_argument("nic_ips requires transport=socket, raw or uring");
+        if ((int)options.nic_ips.size() > num_parties)
+            throw std::invalid_argument("nic_ips lists party " + std::to_string(options.nic_ips.size() - 1) +
+                                        " but there are only " + std::to_string(num_parties) + " parties");
+    }
+
+    index_schedule();
+    block_pending.reset(new std::atomic<int>[num_parties]);
+    sink_filename = "benchmark_shares_p" + std::to_string(num_parties) + "_id" + std::to_string(party_id) + ".bin";
+    if (options.sink == "callback")
+    {
+        block_checksums.assign(num_parties, 0);
+        block_consumer = [this](int block, const uint8_t *data, size_t len)
+        { block_checksums[block] = block_checksum(data, len); };
+    }
+
+    if (options.reroute)
+    {
+        // 截止时间依赖可以限时读取的无缓冲连接；取回的块须与直接收到的相同，发送方也须逐块在步骤之间保留内容
+        if (!std::is_same_v<IO, RawSocketIO> || options.exchange_mode != ExchangeMode::PingPong ||
+            options.collective != Collective::AllGather || seeded || options.sink != "none")
+            throw std::invalid_argument("reroute supports transport=raw with exchange=pingpong and the all-gather algorithms without sink");
+        if (options.network.streams != 1)
+            throw std::invalid_argument("reroute requires streams=1");
+
+        acquired_at.assign(num_parties, std::vector<int>(num_parties, INT_MAX));
+        for (int holder = 0; holder < num_parties; holder++)
+        {
+            acquired_at[holder][holder] = -1;
+            std::vector<ScheduleStep> schedule = algorithm->schedule(holder, num_parties);
+            for (size_t i = 0; i < schedule.size(); i++)
+            {
+                for (int block : schedule[i].recv_blocks)
+                    acquired_at[holder][block] = std::min(acquired_at[holder][block], (int)i);
+            }
+        }
+        step_deadlines.resize(steps.size());
+        block_writing.reset(new std::atomic<uint64_t>[num_parties]);
+        block_written.reset(new std::atomic<uint64_t>[num_parties]);
+        for (int block = 0; block < num_parties; block++)
+        {
+            block_writing[block] = 0;
+            block_written[block] = 0;
+        }
+        fetch_fds.assign(num_parties, -1);
+        serve_fds.assign(num_parties, -1);
+        fetch_failed.assign(num_parties, false);
+        drains.resize(num_parties);
+        drain_errors.resize(num_parties);
+        out << "Reroute: deadline mean + " << options.reroute_factor << " * deviation, at least "
+                  << options.reroute_min_us << " us" << std::endl;
+    }
+
+    if (options.spin_recv && (!std::is_same_v<IO, RawSocketIO> || options.reroute))
+        throw std::invalid_argument("spin_recv requires transport=raw without reroute");
+
+    // 调用方线程（测试主线程或模拟中的参与方线程）绑定到第一个 CPU，各收发线程在其余的 CPU 上调度
+    if (!options.cpus.empty())
+    {
+        std::vector<int> workers(options.cpus.begin() + (options.cpus.size() > 1), options.cpus.end());
+        if (!pin_current_thread(options.cpus[0]))
+            throw std::invalid_argument("cannot pin to cpu " + std::to_string(options.cpus[0]));
+        set_worker_cpus(workers);
+        out << "CPU pinning: share thread on cpu " << options.cpus[0] << ", I/O threads on";
+        for (int cpu : workers)
+            out << " " << cpu;
+        out << std::endl;
+    }
+
+    if (options.auto_plan)
+        out << "Plan auto: algorithm, exchange, chunk size and stripes are chosen after calibration" << std::endl;
+    else
+        out << "Algorithm " << algorithm->name() << ", " << steps.size() << " steps" << std::endl;
+    ios.resize(num_parties);
+    spare_ios.resize(num_parties);
+    control_fds.resize(num_parties, -1);
+}
+
+// 同时进行的步骤各占一个线程，只能用直接读写 socket 的并发收发；uring 的提交队列不能被多个线程同时使用，不支持这类调度
+template <typename IO, typename Clock>
+void ShareEngine<IO, Clock>::check_concurrent_steps(const AllGatherAlgorithm &schedule_algorithm,
+                                                    const std::vector<ScheduleStep> &schedule, ExchangeMode exchange) const
+{
+    if (std::none_of(schedule.begin(), schedule.end(), [](const ScheduleStep &step)
+                     { return step.concurrent; }))
+        return;
+    if (exchange == ExchangeMode::PingPong)
+        throw std::invalid_argument(std::string("Algorithm ") + schedule_algorithm.name() + " requires exchange=duplex or pipelined");
+#ifdef HAVE_IO_URING
+    if (std::is_same_v<IO, UringIO>)
+        throw std::invalid_argument(std::string("Algorithm ") + schedule_algorithm.name() + " does not support transport=uring");
+#endif
+}
+
+// 由 steps 得到每一步合并后的收发区间与每个块的使用次数
+template <typename IO, typename Clock>
+void ShareEngine<IO, Clock>::index_schedule()
+{
+    step_runs.clear();
+    for (const auto &step : steps)
+    {
+        step_runs.push_back({block_runs(step.send_blocks), block_runs(step.recv_blocks)});
+    }
+
+    block_uses.assign(num_parties, 0);
+    for (const auto &step : steps)
+    {
+        for (int block : step.send_blocks)
+            block_uses[block]++;
+        for (int block : step.recv_blocks)
+            block_uses[block]++;
+    }
+}
+
+// 每次迭代开始时重置各块剩余的使用次数。没有任何收发的块（只有一个参与方时自己的块）不会交给消费者
+template <typename IO, typename Clock>
+void ShareEngine<IO, Clock>::reset_block_pending()
+{
+    for (int block = 0; block < num_parties; block++)
+        block_pending[block].store(block_uses[block], std::memory_order_relaxed);
+}
+
+// 一步的发送或接收完成后调用，块的最后一次使用结束时交给消费者并释放其内存
+template <typename IO, typename Clock>
+void ShareEngine<IO, Clock>::release_blocks(const std::vector<int> &blocks, size_t data_size)
+{
+    if (options.sink == "none")
+        return;
+    for (int block : blocks)
+    {
+        if (block_pending[block].fetch_sub(1, std::memory_order_acq_rel) != 1)
+            continue;
+        if (block_consumer)
+            block_consumer(block, recv_buffers.data() + block * data_size, data_size);
+        // 匿名内存释放后内容即丢失，自己的块下一次迭代还要发送，保留在内存中
+        if (options.sink == "file" || block != party_id)
+            recv_buffers.release_range(block * data_size, data_size);
+    }
+}
+
+template <typename IO, typename Clock>
+void ShareEngine<IO, Clock>::validate_data_size(size_t data_size) const
+{
+    if (data_size == 0)
+    {
+        throw std::invalid_argument("Data size cannot be zero");
+    }
+
+    // 检查缓冲区大小不会溢出
+    if (num_parties > SIZE_MAX / data_size)
+    {
+        throw std::overflow_error("Buffer size would overflow");
+    }
+
+    if (data_size % payload_element_size(options.payload) != 0)
+    {
+        throw std::invalid_argument("Data size must be a multiple of the " + std::string(payload_kind_name(options.payload)) +
+                                    " element size");
+    }
+
+    if (options.collective != Collective::AllGather)
+    {
+        if (data_size % reduce_element_size() != 0 || data_size / reduce_element_size() < (size_t)num_parties)
+        {
+            throw std::invalid_argument("Data size must be a multiple of " + std::to_string(reduce_element_size()) +
+                                        " bytes with at least one element per party for " + collective_name(options.collective));
+        }
+    }
+}
+
+template <typename IO, typename Clock>
+ShareEngine<IO, Clock>::~ShareEngine()
+{
+    if (assist_thread.joinable())
+    {
+        assist_stopping = true;
+        assist_cv.notify_all();
+        uint8_t wake = 0;
+        ssize_t res = ::write(assist_wake[1], &wake, 1);
+        (void)res;
+        assist_thread.join();
+    }
+    for (int fd : assist_wake)
+    {
+        if (fd >= 0)
+            close(fd);
+    }
+    for (auto &drain : drains)
+    {
+        if (drain.joinable())
+            drain.join();
+    }
+    for (const auto &fds : {fetch_fds, serve_fds})
+    {
+        for (int fd : fds)
+        {
+            if (fd >= 0)
+                close(fd);
+        }
+    }
+    for (auto &link : ios)
+    {
+        for (auto io : link)
+            delete io;
+    }
+    for (auto &link : spare_ios)
+    {
+        for (auto io : link)
+            delete io;
+    }
+    for (int fd : control_fds)
+    {
+        if (fd >= 0)
+            close(fd);
+    }
+}
+
+// 调度中出现的所有对端，按编号升序
+template <typename IO, typename Clock>
+std::vector<int> ShareEngine<IO, Clock>::connection_peers() const
+{
+    std::vector<int> peers;
+    for (const auto &step : steps)
+    {
+        for (int peer_id : {step.send_peer, step.recv_peer})
+        {
+            if (peer_id >= 0 && peer_id != party_id)
+                peers.push_back(peer_id);
+        }
+    }
+
+    // seeded 在建连时与每个对端交换种子，reroute 可能向任何一方取块，plan=auto 建连时还不知道用哪个算法，
+    // full_mesh 之后还要换算法，都需要全连接
+    if (seeded || options.reroute || options.auto_plan || options.full_mesh)
+    {
+        for (int peer_id = 0; peer_id < num_parties; peer_id++)
+            peers.push_back(peer_id);
+        peers.erase(std::remove(peers.begin(), peers.end(), party_id), peers.end());
+    }
+
+    // 屏障与时钟同步使用的 p ± 2^k 链路（二项树的父子链路包含在内）
+    for (int distance = 1; distance < num_parties; distance *= 2)
+    {
+        peers.push_back((party_id + distance) % num_parties);
+        peers.push_back((party_id - distance + num_parties) % num_parties);
+    }
+
+    std::sort(peers.begin(), peers.end());
+    peers.erase(std::unique(peers.begin(), peers.end()), peers.end());
+    return peers;
+}
+
+// 控制消息（屏障、时钟同步）在控制连接上直接收发
+template <typename IO, typename Clock>
+void ShareEngine<IO, Clock>::send_control(int peer_id, const void *data, size_t len)
+{
+    if constexpr (std::is_same_v<IO, ShmIO>)
+        send_segments(shm_control[peer_id].get(), {{const_cast<void *>(data), len}});
+    else
+        send_vectored(control_fds[peer_id], {{const_cast<void *>(data), len}});
+}
+
+template <typename IO, typename Clock>
+void ShareEngine<IO, Clock>::recv_control(int peer_id, void *data, size_t len)
+{
+    if constexpr (std::is_same_v<IO, ShmIO>)
+        recv_segments(shm_control[peer_id].get(), {{data, len}});
+    else
+        recv_vectored(control_fds[peer_id], {{data, len}});
+}
+
+// 传播式屏障：第 k 轮向 p + 2^k 发送、从 p - 2^k 接收，ceil(log N) 轮后所有参与方都已到达。
+// 令牌携带目前为止见到的 ready 之与，第 k 轮后覆盖 p 之前的 2^(k+1) 个参与方，结束时即所有参与方的与
+template <typename IO, typename Clock>
+bool ShareEngine<IO, Clock>::barrier(bool ready)
+{
+    uint8_t token = ready;
+    for (int distance = 1; distance < num_parties; distance *= 2)
+    {
+        uint8_t received = 0;
+        send_control((party_id + distance) % num_parties, &token, 1);
+        recv_control((party_id - distance + num_parties) % num_parties, &received, 1);
+        token &= received;
+    }
+    return token != 0;
+}
+
+// 把块区间转换成 recv_buffers 上的 iovec
+template <typename IO, typename Clock>
+std::vector<iovec> ShareEngine<IO, Clock>::run_segments(const std::vector<std::pair<int, int>> &runs,
+                                                        size_t data_size)
+{
+    std::vector<iovec> segments;
+    for (const auto &run : runs)
+        segments.push_back({recv_buffers.data() + run.first * data_size, run.second * data_size});
+    return segments;
+}
+
+// 一步的收发 iovec：all-gather 为按区间合并的块；reduce 时递归减半第一步直接从输入发送，
+// 之后从结果区发送，收到的段放进临时区（递归减半）或直接写入结果区（递归倍增）
+template <typename IO, typename Clock>
+void ShareEngine<IO, Clock>::step_segments(size_t step_index, size_t data_size, std::vector<iovec> &send_segments,
+                                           std::vector<iovec> &recv_segments)
+{
+    if (reduce_steps.empty())
+    {
+        send_segments = run_segments(step_runs[step_index].send, data_size);
+        recv_segments = run_segments(step_runs[step_index].recv, data_size);
+        return;
+    }
+
+    const ReduceStep &reduce = reduce_steps[step_index];
+    uint8_t *source = step_index == 0 ? local_input.data() : recv_buffers.data();
+    size_t send_begin = reduce_offset(reduce.send_lo, data_size);
+    size_t recv_begin = reduce_offset(reduce.recv_lo, data_size);
+    send_segments = {{source + send_begin, reduce_offset(reduce.send_hi, data_size) - send_begin}};
+    recv_segments = {{recv_buffers.data() + (reduce.combine ? data_size : recv_begin),
+                      reduce_offset(reduce.recv_hi, data_size) - recv_begin}};
+}
+
+// 段 segment 在结果区中的起始偏移，按元素均分，段之间最多相差一个元素
+template <typename IO, typename Clock>
+size_t ShareEngine<IO, Clock>::reduce_offset(int segment, size_t data_size) const
+{
+    size_t element = reduce_element_size();
+    return segment * (data_size / element) / num_parties * element;
+}
+
+// 段的边界须落在元素上：测试数据的元素，以及加法合并的 64 位字
+template <typename IO, typename Clock>
+size_t ShareEngine<IO, Clock>::reduce_element_size() const
+{
+    size_t element = payload_element_size(options.payload);
+    if (options.reduce_op != ReduceOp::Xor)
+        element = std::max(element, sizeof(uint64_t));
+    return element;
+}
+
+template <typename IO, typename Clock>
+bool ShareEngine<IO, Clock>::setup_connections(const std::vector<std::string> &ips, int base_port)
+{
+    auto connection_start = std::chrono::high_resolution_clock::now();
+
+    try
+    {
+        std::vector<int> peers = connection_peers();
+        out << "Party " << party_id << " connecting to " << peers.size() << " parties, "
+                  << options.network.streams << " connection(s) per link" << std::endl;
+
+        if constexpr (std::is_same_v<IO, emp::NetIO>)
+        {
+            // emp::NetIO 自己监听/拨号，每对参与方 (i, j), i < j 的第 k 条连接使用独立端口
+            // base_port + (k * N + j) * N + i，编号小的一方监听。所有参与方按同一全局顺序建连，避免相互等待
+            // NetIO 内部把端口截断为 16 位，越界的端口会回绕并与其他连接冲突，因此连同其后的控制端口段一起检查
+            if ((long long)base_port + (long long)options.network.streams * num_parties * num_parties + num_parties - 1 > 65535)
+                throw std::invalid_argument("Port out of range: transport=netio uses ports up to base_port + streams * N * N + N - 1, "
+                                            "which must not exceed 65535 (use fewer streams or a smaller base_port)");
+            for (int i = 0; i < num_parties; i++)
+            {
+                for (int j = i + 1; j < num_parties; j++)
+                {
+                    if (party_id != i && party_id != j)
+                        continue;
+                    int peer = party_id == i ? j : i;
+                    if (!std::binary_search(peers.begin(), peers.end(), peer))
+                        continue;
+                    for (int k = 0; k < options.network.streams; k++)
+                    {
+                        int port = base_port + (k * num_parties + j) * num_parties + i;
+                        ios[peer].push_back(new emp::NetIO(party_id == i ? nullptr : ips[i].c_str(), port, true));
+                        // NetIO 内部完成连接，配置只能在连接建立后应用
+                        apply_network_profile(ios[peer].back()->consocket, options.network);
+                    }
+                }
+            }
+
+            // 控制连接用单端口建连，端口段紧接在 NetIO 使用的端口之后
+            NetworkProfile control_profile = options.network;
+            control_profile.streams = 1;
+            std::map<int, std::vector<int>> control = connect_mesh(
+                party_id, num_parties, ips, base_port + options.network.streams * num_parties * num_parties, peers,
+                control_profile, options.connect_timeout_ms);
+            for (const auto &entry : control)
+                control_fds[entry.first] = entry.second[0];
+        }
+#ifdef HAVE_MSQUIC
+        else if constexpr (std::is_same_v<IO, QuicIO>)
+        {
+            // 数据走 QUIC（UDP 端口 base_port + i），屏障与时钟同步仍使用同一端口号上的 TCP 控制连接
+            bool accepts = std::any_of(peers.begin(), peers.end(), [&](int peer)
+                                       { return peer > party_id; });
+            auto context = std::make_shared<QuicContext>(options.network, options.quic, party_id, accepts);
+
+            NetworkProfile control_profile = options.network;
+            control_profile.streams = 1;
+            std::map<int, std::vector<int>> control = connect_mesh(party_id, num_parties, ips, base_port, peers,
+                                                                   control_profile, options.connect_timeout_ms);
+            for (const auto &entry : control)
+                control_fds[entry.first] = entry.second[0];
+
+            for (const auto &entry : connect_quic_mesh(context, party_id, num_parties, ips, base_port, peers,
+                                                       options.network.streams, options.connect_timeout_ms))
+                ios[entry.first] = entry.second;
+        }
+#endif
+        else if constexpr (std::is_same_v<IO, ShmIO>)
+        {
+            // 参与方是同一进程内的线程：数据与控制消息都走内存环
+            if (!options.shm_fabric)
+                throw std::invalid_argument("transport=shm requires a ShmFabric shared by all parties");
+            shm_control.resize(num_parties);
+            for (auto &entry : options.shm_fabric->connect(party_id, peers, options.network.streams))
+            {
+                ios[entry.first] = entry.second.streams;
+                shm_control[entry.first].reset(entry.second.control);
+            }
+        }
+        else
+        {
+            // 每个对端多建一条连接作为控制连接；reroute 时控制连接之前再加两条取块连接，
+            // 前一条由编号小的一方请求，后一条由编号大的一方请求
+            NetworkProfile mesh_profile = options.network;
+            mesh_profile.streams += options.reroute ? 3 : 1;
+            if (party_id < (int)options.nic_ips.size() && !options.nic_ips[party_id].empty())
+                out << "Party " << party_id << " spreads its connections over "
+                          << options.nic_ips[party_id].size() << " local address(es)" << std::endl;
+            std::map<int, std::vector<int>> sockets = connect_mesh(party_id, num_parties, ips, base_port, peers,
+                                                                   mesh_profile, options.connect_timeout_ms,
+                                                                   options.nic_ips);
+            for (auto &entry : sockets)
+            {
+                control_fds[entry.first] = entry.second.back();
+                entry.second.pop_back();
+                if (!options.reroute)
+                    continue;
+                int from_higher = entry.second.back();
+                entry.second.pop_back();
+                int from_lower = entry.second.back();
+                entry.second.pop_back();
+                fetch_fds[entry.first] = party_id < entry.first ? from_lower : from_higher;
+                serve_fds[entry.first] = party_id < entry.first ? from_higher : from_lower;
+            }
+            if (options.reroute)
+            {
+                if (::pipe(assist_wake) != 0)
+                    throw std::runtime_error(std::string("pipe failed: ") + std::strerror(errno));
+                assist_thread = std::thread([this]() { serve_assists(); });
+            }
+#ifdef HAVE_IO_URING
+            std::shared_ptr<IoUring> ring;
+            if constexpr (std::is_same_v<IO, UringIO>)
+                ring = std::make_shared<IoUring>(64, options.uring_sqpoll);
+#endif
+            for (const auto &entry : sockets)
+            {
+                for (int fd : entry.second)
+                {
+                    if constexpr (std::is_same_v<IO, RawSocketIO>)
+                        ios[entry.first].push_back(new RawSocketIO(fd, options.zerocopy_threshold, options.spin_recv));
+#ifdef HAVE_IO_URING
+                    else if constexpr (std::is_same_v<IO, UringIO>)
+                        ios[entry.first].push_back(new UringIO(fd, ring));
+#endif
+                    else
+                        ios[entry.first].push_back(new IO(fd));
+                }
+            }
+        }
+
+        auto connection_end = std::chrono::high_resolution_clock::now();
+        auto connection_duration = std::chrono::duration_cast<std::chrono::microseconds>(connection_end - connection_start);
+        connection_time_ms = connection_duration.count() / 1000.0;
+        out << "Connection setup time: " << connection_time_ms << " ms" << std::endl;
+
+        // 缓冲区默认放在本机网卡所在的 NUMA 节点上，网卡 DMA 与收发拷贝都不跨节点。
+        // shm 传输不经过网卡，不绑定时缓冲区由预先缺页的参与方线程按首次写入落在其所在节点
+        buffer_numa_node = options.numa_node != kNumaAuto   ? options.numa_node
+                           : std::is_same_v<IO, ShmIO> ? -1
+                                                       : nic_numa_node(ips[party_id]);
+
+        if (seeded)
+            exchange_seeds();
+
+        return true;
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Network setup error: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+// 在控制连接上与每个对端交换一次种子（16 字节的消息不会阻塞在发送上，先全部发出再依次接收）。
+// 种子由不带种子的 emp::PRG 生成，与公共的 payload_seed 无关
+template <typename IO, typename Clock>
+void ShareEngine<IO, Clock>::exchange_seeds()
+{
+    emp::PRG prg;
+    seeds_out.resize(num_parties);
+    seeds_in.resize(num_parties);
+    for (auto &seed : seeds_out)
+        prg.random_data(seed.data(), seed.size());
+    for (int peer_id = 0; peer_id < num_parties; peer_id++)
+    {
+        if (peer_id != party_id)
+            send_control(peer_id, seeds_out[peer_id].data(), seeds_out[peer_id].size());
+    }
+    for (int peer_id = 0; peer_id < num_parties; peer_id++)
+    {
+        if (peer_id != party_id)
+            recv_control(peer_id, seeds_in[peer_id].data(), seeds_in[peer_id].size());
+    }
+    seeds_in[party_id] = seeds_out[party_id];
+    out << "Exchanged share seeds with " << num_parties - 1 << " parties" << std::endl;
+}
+
+// 发送前在自己的块上算出发给 j+1 的修正项 x_j - sum_{k != j+1} PRG(s_{j,k})，返回耗时 (ns)
+template <typename IO, typename Clock>
+int64_t ShareEngine<IO, Clock>::seeded_prepare(size_t data_size)
+{
+    int64_t start = Clock::now();
+    uint8_t *correction = recv_buffers.data() + party_id * data_size;
+    std::memcpy(correction, local_input.data(), data_size);
+    for (int peer_id = 0; peer_id < num_parties; peer_id++)
+    {
+        if (peer_id != steps[0].send_peer)
+            PayloadStream::subtract(options.payload, seeds_out[peer_id].data(), correction, data_size);
+    }
+    return Clock::now() - start;
+}
+
+// 收到修正项后在本地展开其余参与方给本方的分享，返回耗时 (ns)
+template <typename IO, typename Clock>
+int64_t ShareEngine<IO, Clock>::seeded_expand(size_t data_size)
+{
+    int64_t start = Clock::now();
+    for (int block = 0; block < num_parties; block++)
+    {
+        if (block != party_id && block != steps[0].recv_peer)
+            PayloadStream::expand(options.payload, seeds_in[block].data(), recv_buffers.data() + block * data_size,
+                                  data_size);
+    }
+    return Clock::now() - start;
+}
+
+// 每次迭代本方发出的字节数
+template <typename IO, typename Clock>
+size_t ShareEngine<IO, Clock>::wire_bytes(size_t data_size) const
+{
+    size_t bytes = 0;
+    for (const auto &reduce : reduce_steps)
+        bytes += reduce_offset(reduce.send_hi, data_size) - reduce_offset(reduce.send_lo, data_size);
+    for (const auto &step : steps)
+    {
+        if (step.send_peer >= 0)
+            bytes += step.send_blocks.size() * data_size;
+    }
+    return bytes;
+}
+
+// 标定按圆桌法配对：N 为奇数时补一个虚拟参与方，第 r 轮 M-1 号与 r 号配对，其余 p 与 (2r - p) mod (M-1) 配对，
+// 同一轮中各对互不相交，可以同时测。与虚拟参与方配对（轮空）时返回 -1
+template <typename IO, typename Clock>
+int ShareEngine<IO, Clock>::probe_partner(int round) const
+{
+    int slots = num_parties % 2 == 0 ? num_parties : num_parties + 1;
+    int partner;
+    if (party_id == slots - 1)
+        partner = round;
+    else if (party_id == round)
+        partner = slots - 1;
+    else
+        partner = ((2 * round - party_id) % (slots - 1) + slots - 1) % (slots - 1);
+    return partner < num_parties ? partner : -1;
+}
+
+// 在 link 上往返 bytes 字节 kProbeReps 次，每次按 piece 字节分开发送，发起方返回最短的往返时间 (ns)，应答方原样发回
+template <typename IO, typename Clock>
+int64_t ShareEngine<IO, Clock>::probe_rtt(bool initiator, const std::vector<IO *> &link, uint8_t *buffer, size_t bytes,
+                                          size_t piece)
+{
+    auto transfer = [&](bool sending)
+    {
+        for (size_t pos = 0; pos < bytes; pos += piece)
+        {
+            std::vector<iovec> segments = {{buffer + pos, std::min(piece, bytes - pos)}};
+            if (sending)
+                send_striped(link, segments);
+            else
+                recv_striped(link, segments);
+        }
+    };
+
+    int64_t best = INT64_MAX;
+    for (int rep = 0; rep < kProbeReps; rep++)
+    {
+        int64_t start = monotonic_ns();
+        transfer(initiator);
+        transfer(!initiator);
+        best = std::min(best, monotonic_ns() - start);
+    }
+    return best;
+}
+
+// 在每个候选调度下每个参与方每一步收发的块数
+template <typename IO, typename Clock>
+typename ShareEngine<IO, Clock>::ScheduleShape ShareEngine<IO, Clock>::schedule_shape(const AllGatherAlgorithm &candidate) const
+{
+    ScheduleShape shape(num_parties);
+    for (int p = 0; p < num_parties; p++)
+    {
+        for (const auto &step : candidate.schedule(p, num_parties))
+            shape[p].push_back({step.send_peer >= 0 ? (int)step.send_blocks.size() : 0,
+                                step.recv_peer >= 0 ? (int)step.recv_blocks.size() : 0});
+    }
+    return shape;
+}
+
+// 按 alpha-beta 模型预测一次分享的耗时 (ns)。半双工与全双工每一步等最慢的参与方：半双工一步先后完成两个方向，
+// 全双工两个方向同时进行；流水线没有步骤间的同步，每个参与方的时间为沿 S 步依赖链逐跳转发第一个分块，
+// 加上其余字节按带宽发完，以及每个分块的开销，取最慢的参与方
+template <typename IO, typename Clock>
+double ShareEngine<IO, Clock>::predict(const ScheduleShape &shape, ExchangeMode exchange, size_t chunk_size, int stripes,
+                                       size_t data_size) const
+{
+    double share = cost_model.streams > 1 ? double(stripes - 1) / (cost_model.streams - 1) : 0;
+    double alpha = cost_model.alpha_ns[0] + share * (cost_model.alpha_ns[1] - cost_model.alpha_ns[0]);
+    double beta = cost_model.beta_ns[0] + share * (cost_model.beta_ns[1] - cost_model.beta_ns[0]);
+    double bytes = double(data_size);
+
+    if (exchange == ExchangeMode::Pipelined)
+    {
+        double slowest = 0;
+        for (const auto &steps_of_party : shape)
+        {
+            double hops = 0, sent = 0, received = 0;
+            for (const auto &step : steps_of_party)
+            {
+                hops += step.first > 0 || step.second > 0;
+                sent += step.first * bytes;
+                received += step.second * bytes;
+            }
+            if (hops == 0)
+                continue;
+            double volume = std::max(sent, received);
+            double first_chunk = std::min(double(chunk_size), bytes);
+            double time = hops * cost_model.alpha_ns[0] + (hops - 1) * cost_model.beta_ns[0] * first_chunk + beta * volume +
+                          std::ceil(volume / chunk_size) * cost_model.gamma_ns;
+            slowest = std::max(slowest, time);
+        }
+        return slowest;
+    }
+
+    size_t num_steps = 0;
+    for (const auto &steps_of_party : shape)
+        num_steps = std::max(num_steps, steps_of_party.size());
+    double total = 0;
+    for (size_t i = 0; i < num_steps; i++)
+    {
+        double slowest = 0;
+        for (const auto &steps_of_party : shape)
+        {
+            if (i >= steps_of_party.size())
+                continue;
+            double send = steps_of_party[i].first * bytes;
+            double recv = steps_of_party[i].second * bytes;
+            double time;
+            if (exchange == ExchangeMode::Duplex)
+                time = send > 0 || recv > 0 ? alpha + beta * std::max(send, recv) : 0;
+            else
+                time = (send > 0 ? alpha + beta * send : 0) + (recv > 0 ? alpha + beta * recv : 0);
+            slowest = std::max(slowest, time);
+        }
+        total += slowest;
+    }
+    return total;
+}
+
+template <typename IO, typename Clock>
+double ShareEngine<IO, Clock>::predicted_ns(size_t data_size) const
+{
+    if (!options.auto_plan || !planned)
+        return 0;
+    return predict(schedule_shape(*algorithm), options.exchange_mode, options.chunk_size, options.network.streams, data_size);
+}
+
+// 标定分三步：各对参与方按圆桌法轮流往返小消息与 probe_bytes，拟合每条链路的 alpha/beta（单条连接与全部连接条带）
+// 以及分块开销；party 0 汇总平均后对所有候选方案预测 data_size 的耗时，选出最快的广播给所有参与方；
+// 各方按选定的方案重建调度，多余的连接留到析构时关闭
+template <typename IO, typename Clock>
+void ShareEngine<IO, Clock>::plan(size_t data_size)
+{
+    if (!options.auto_plan || planned)
+        return;
+    planned = true;
+
+    const int streams = options.network.streams;
+    auto format = [](double value)
+    {
+        std::ostringstream text;
+        text << std::fixed << std::setprecision(3) << value;
+        return text.str();
+    };
+
+    // 本方作为发起方（编号小的一方）测得的链路：alpha/beta 各两组、分块开销、链路数
+    std::array<double, 6> fits = {0, 0, 0, 0, 0, 0};
+    const size_t large = std::max(options.probe_bytes, 2 * kProbeSmall);
+    std::vector<uint8_t> buffer(large);
+    int slots = num_parties % 2 == 0 ? num_parties : num_parties + 1;
+    for (int round = 0; round < std::min(slots - 1, kProbeRounds); round++)
+    {
+        int peer_id = probe_partner(round);
+        if (peer_id < 0)
+            continue;
+        bool initiator = party_id < peer_id;
+        std::vector<IO *> single = {ios[peer_id][0]};
+
+        auto fit = [&](const std::vector<IO *> &link, double &alpha, double &beta)
+        {
+            int64_t small_rtt = probe_rtt(initiator, link, buffer.data(), kProbeSmall, kProbeSmall);
+            int64_t large_rtt = probe_rtt(initiator, link, buffer.data(), large, large);
+            beta = std::max(0.0, double(large_rtt - small_rtt) / (2.0 * (large - kProbeSmall)));
+            alpha = std::max(0.0, small_rtt / 2.0 - beta * kProbeSmall);
+            return large_rtt;
+        };
+        double alpha[2], beta[2];
+        int64_t whole_rtt = fit(single, alpha[0], beta[0]);
+        int64_t pieces_rtt = probe_rtt(initiator, single, buffer.data(), large, kProbePiece);
+        size_t pieces = (large + kProbePiece - 1) / kProbePiece;
+        double gamma = pieces > 1 ? std::max(0.0, double(pieces_rtt - whole_rtt) / (2.0 * (pieces - 1))) : 0;
+        alpha[1] = alpha[0];
+        beta[1] = beta[0];
+        if (streams > 1)
+            fit(ios[peer_id], alpha[1], beta[1]);
+        if (!initiator)
+            continue;
+
+        fits[0] += alpha[0];
+        fits[1] += beta[0];
+        fits[2] += alpha[1];
+        fits[3] += beta[1];
+        fits[4] += gamma;
+        fits[5] += 1;
+        out << "Probe link " << party_id << "-" << peer_id << ": alpha " << format(alpha[0] / 1e3) << " us, "
+                  << format(beta[0] > 0 ? 1 / beta[0] : 0) << " GB/s on 1 connection, alpha " << format(alpha[1] / 1e3)
+                  << " us, " << format(beta[1] > 0 ? 1 / beta[1] : 0) << " GB/s on " << streams
+                  << " connection(s), chunk overhead " << format(gamma / 1e3) << " us" << std::endl;
+    }
+
+    // 选定的方案：候选算法的下标、收发方式、分块大小、条带数，以及所有参与方共用的模型
+    static const char *const candidates[] = {"hypercube", "ring", "bruck", "tree", "pairwise"};
+    struct PlanMessage
+    {
+        int32_t algorithm;
+        int32_t exchange;
+        uint64_t chunk_size;
+        int32_t stripes;
+        CostModel model;
+    } message{};
+
+    if (party_id != 0)
+    {
+        send_control(0, fits.data(), sizeof(fits));
+        recv_control(0, &message, sizeof(message));
+    }
+    else
+    {
+        for (int peer_id = 1; peer_id < num_parties; peer_id++)
+        {
+            std::array<double, 6> remote;
+            recv_control(peer_id, remote.data(), sizeof(remote));
+            for (size_t k = 0; k < fits.size(); k++)
+                fits[k] += remote[k];
+        }
+        CostModel model;
+        if (fits[5] > 0)
+        {
+            model.alpha_ns[0] = fits[0] / fits[5];
+            model.beta_ns[0] = fits[1] / fits[5];
+            model.alpha_ns[1] = fits[2] / fits[5];
+            model.beta_ns[1] = fits[3] / fits[5];
+            model.gamma_ns = fits[4] / fits[5];
+        }
+        model.streams = streams;
+        cost_model = model;
+        out << "Cost model over " << (int)fits[5] << " link(s): alpha " << format(model.alpha_ns[0] / 1e3)
+                  << " us, beta " << format(model.beta_ns[0] * 1024) << " ns/KB on 1 connection; alpha "
+                  << format(model.alpha_ns[1] / 1e3) << " us, beta " << format(model.beta_ns[1] * 1024) << " ns/KB on "
+                  << streams << " connection(s); chunk overhead " << format(model.gamma_ns / 1e3) << " us" << std::endl;
+
+        struct Candidate
+        {
+            PlanMessage plan;
+            double predicted_ns;
+        };
+        std::vector<Candidate> ranked;
+        // uring 不支持流水线模式
+        bool pipelined_candidates = true;
+#ifdef HAVE_IO_URING
+        pipelined_candidates = !std::is_same_v<IO, UringIO>;
+#endif
+        for (int32_t index = 0; index < (int32_t)(sizeof(candidates) / sizeof(candidates[0])); index++)
+        {
+            std::unique_ptr<AllGatherAlgorithm> candidate = make_algorithm(candidates[index]);
+            if (!candidate->supports(num_parties))
+                continue;
+            ScheduleShape shape = schedule_shape(*candidate);
+            for (int stripes = 1; stripes <= streams; stripes++)
+            {
+                for (ExchangeMode exchange : {ExchangeMode::PingPong, ExchangeMode::Duplex})
+                    ranked.push_back({{index, (int32_t)exchange, options.chunk_size, stripes, model},
+                                      predict(shape, exchange, options.chunk_size, stripes, data_size)});
+                if (!pipelined_candidates)
+                    continue;
+                for (size_t chunk_kb : {16, 64, 256, 1024})
+                    ranked.push_back({{index, (int32_t)ExchangeMode::Pipelined, chunk_kb * 1024, stripes, model},
+                                      predict(shape, ExchangeMode::Pipelined, chunk_kb * 1024, stripes, data_size)});
+            }
+        }
+        // 预测相同时保留靠前（条带少、算法在前）的方案
+        std::stable_sort(ranked.begin(), ranked.end(), [](const Candidate &a, const Candidate &b)
+                         { return a.predicted_ns < b.predicted_ns; });
+        for (size_t i = 0; i < std::min<size_t>(ranked.size(), 5); i++)
+        {
+            const PlanMessage &candidate = ranked[i].plan;
+            out << "Plan candidate " << i + 1 << ": " << candidates[candidate.algorithm] << ", exchange "
+                      << exchange_mode_name((ExchangeMode)candidate.exchange);
+            if ((ExchangeMode)candidate.exchange == ExchangeMode::Pipelined)
+                out << " chunk " << candidate.chunk_size / 1024 << " KB";
+            out << ", " << candidate.stripes << " stripe(s): predicted " << format(ranked[i].predicted_ns / 1e6)
+                      << " ms" << std::endl;
+        }
+        message = ranked.front().plan;
+        for (int peer_id = 1; peer_id < num_parties; peer_id++)
+            send_control(peer_id, &message, sizeof(message));
+    }
+
+    cost_model = message.model;
+    options.algorithm = candidates[message.algorithm];
+    options.exchange_mode = (ExchangeMode)message.exchange;
+    options.chunk_size = message.chunk_size;
+    set_stripes(message.stripes);
+    algorithm = make_algorithm(options.algorithm);
+    steps = algorithm->schedule(party_id, num_parties);
+    index_schedule();
+
+    out << "Plan: algorithm " << algorithm->name() << ", " << steps.size() << " steps, exchange "
+              << exchange_mode_name(options.exchange_mode);
+    if (options.exchange_mode == ExchangeMode::Pipelined)
+        out << " chunk " << options.chunk_size / 1024 << " KB";
+    out << ", " << options.network.streams << " stripe(s); predicted " << format(predicted_ns(data_size) / 1e6)
+              << " ms at " << data_size << " bytes" << std::endl;
+}
+
+// 每条链路只用前 stripes 条连接，其余的留在 spare_ios 中，之后可以再换回来（两端按同样的序号取舍）
+template <typename IO, typename Clock>
+void ShareEngine<IO, Clock>::set_stripes(int stripes)
+{
+    for (int peer_id = 0; peer_id < num_parties; peer_id++)
+    {
+        std::vector<IO *> &link = ios[peer_id];
+        std::vector<IO *> &spare = spare_ios[peer_id];
+        while ((int)link.size() > stripes)
+        {
+            spare.push_back(link.back());
+            link.pop_back();
+        }
+        while ((int)link.size() < stripes && !spare.empty())
+        {
+            link.push_back(spare.back());
+            spare.pop_back();
+        }
+    }
+    options.network.streams = stripes;
+}
+
+template <typename IO, typename Clock>
+void ShareEngine<IO, Clock>::reconfigure(const EngineOptions &next)
+{
+    // 先检查所有参数，通过后再更改
+    if (!options.full_mesh || options.reroute || options.auto_plan)
+        throw std::invalid_argument("reconfigure requires full_mesh without reroute or plan=auto");
+    if ((next.algorithm == "seeded") != seeded)
+        throw std::invalid_argument("algorithm seeded exchanges seeds while connecting and cannot be switched to or from");
+    std::unique_ptr<AllGatherAlgorithm> candidate = make_algorithm(next.algorithm, next.ports);
+    if (!candidate || !candidate->supports(num_parties))
+        throw std::invalid_argument("Algorithm " + next.algorithm + " does not support " + std::to_string(num_parties) +
+                                    " parties");
+    if (options.collective != Collective::AllGather &&
+        (next.algorithm != "hypercube" || next.exchange_mode == ExchangeMode::Pipelined))
+        throw std::invalid_argument(std::string("collective=") + collective_name(options.collective) +
+                                    " runs on the hypercube links with exchange=pingpong or duplex");
+#ifdef HAVE_IO_URING
+    if (std::is_same_v<IO, UringIO> && next.exchange_mode == ExchangeMode::Pipelined)
+        throw std::invalid_argument("transport=uring supports exchange=pingpong or duplex");
+#endif
+    std::vector<ScheduleStep> schedule = candidate->schedule(party_id, num_parties);
+    if (options.collective == Collective::AllGather)
+        check_concurrent_steps(*candidate, schedule, next.exchange_mode);
+    int opened = 0;
+    for (int peer_id = 0; peer_id < num_parties; peer_id++)
+        opened = std::max(opened, (int)(ios[peer_id].size() + spare_ios[peer_id].size()));
+    if (next.network.streams > opened)
+        throw std::invalid_argument("streams=" + std::to_string(next.network.streams) + " exceeds the " +
+                                    std::to_string(opened) + " connection(s) per link opened at startup");
+
+    options.algorithm = next.algorithm;
+    options.ports = next.ports;
+    options.exchange_mode = next.exchange_mode;
+    options.chunk_size = next.chunk_size;
+    options.telemetry = next.telemetry;
+    options.network = next.network;
+    if (options.collective == Collective::AllGather)
+    {
+        algorithm = std::move(candidate);
+        steps = std::move(schedule);
+        index_schedule();
+    }
+    set_stripes(next.network.streams);
+    for (auto *links : {&ios, &spare_ios})
+    {
+        for (const auto &link : *links)
+        {
+            for (auto io : link)
+                apply_network_profile(io, options.network);
+        }
+    }
+    out << "Reconfigured: algorithm " << algorithm->name() << ", " << steps.size() << " steps, exchange "
+              << exchange_mode_name(options.exchange_mode) << ", " << options.network.streams << " stripe(s)" << std::endl;
+}
+
+template <typename IO, typename Clock>
+void ShareEngine<IO, Clock>::preallocate_buffers(size_t data_size)
+{
+    validate_data_size(data_size);
+
+    // 缓冲区只在不够大时重新分配（测试程序开始时按最大的数据大小分配一次），每次都向传输层注册（同一区域重复注册直接返回）。
+    // 流式输出时缓冲区不预先缺页、不用大页（按页释放），也不注册给 io_uring：注册会固定物理页，释放后重新缺页的
+    // 新页面与已注册的旧页面不再是同一块内存
+    bool streaming = options.sink != "none";
+    std::lock_guard<std::mutex> lock(assist_mutex);
+    if (recv_buffers.size() < num_parties * data_size)
+    {
+        recv_buffers.allocate(num_parties * data_size, streaming ? "off" : options.huge_pages, buffer_numa_node,
+                              options.sink == "file" ? sink_filename : "", !streaming);
+        out << "Buffer arena: " << recv_buffers.size() / 1024 << " KB, " << recv_buffers.pages() << " pages, NUMA node "
+                  << recv_buffers.numa_node() << std::endl;
+    }
+    if ((seeded || options.collective != Collective::AllGather) && local_input.size() < data_size)
+        local_input.allocate(data_size, options.huge_pages, buffer_numa_node);
+    if (streaming)
+        return;
+    for (auto &link : ios)
+    {
+        for (auto io : link)
+            register_buffer(io, recv_buffers.data(), recv_buffers.size());
+    }
+}
+
+template <typename IO, typename Clock>
+void ShareEngine<IO, Clock>::share_data_pipelined(size_t data_size, StepEvent *events, std::vector<ChunkRecord> &chunks,
+                                                  std::vector<TelemetryRecord> &telemetry)
+{
+    const size_t chunk_size = options.chunk_size;
+
+    // 同一条连接上的步骤必须按顺序收发，所以每个发送对端和每个接收对端各一个线程，
+    // 线程内依次处理用到这条连接的所有步骤
+    std::map<int, std::vector<size_t>> send_plan;
+    std::map<int, std::vector<size_t>> recv_plan;
+    for (size_t i = 0; i < steps.size(); i++)
+    {
+        if (steps[i].send_peer >= 0)
+            send_plan[steps[i].send_peer].push_back(i);
+        if (steps[i].recv_peer >= 0)
+            recv_plan[steps[i].recv_peer].push_back(i);
+    }
+
+    // 每个party块已到达的字节数，发送线程据此判断分块是否可以转发
+    std::vector<size_t> block_ready(num_parties, 0);
+    block_ready[party_id] = data_size;
+    bool aborted = false;
+    std::mutex ready_mutex;
+    std::condition_variable ready_cv;
+
+    size_t num_threads = send_plan.size() + recv_plan.size();
+    std::vector<std::vector<ChunkRecord>> thread_chunks(num_threads);
+    std::vector<std::vector<TelemetryRecord>> thread_telemetry(num_threads);
+    std::vector<std::exception_ptr> thread_errors(num_threads);
+
+    std::fill(events, events + steps.size(), StepEvent{});
+    int64_t iteration_start = Clock::now();
+
+    // 把块序列中 [begin, end) 的字节拆成若干段（块编号、块内偏移、长度）
+    auto for_each_piece = [&](const std::vector<int> &stream, size_t begin, size_t end, auto &&fn)
+    {
+        for (size_t pos = begin; pos < end;)
+        {
+            int block = stream[pos / data_size];
+            size_t offset = pos % data_size;
+            size_t len = std::min(end - pos, data_size - offset);
+            fn(block, offset, len);
+            pos += len;
+        }
+    };
+
+    // 一个分块可能跨越多个块，整理成 iovec 后一次 sendmsg/recvmsg
+    auto stream_segments = [&](const std::vector<int> &stream, size_t begin, size_t end)
+    {
+        std::vector<iovec> segments;
+        for_each_piece(stream, begin, end, [&](int block, size_t offset, size_t len)
+                       { segments.push_back({recv_buffers.data() + block * data_size + offset, len}); });
+        return segments;
+    };
+
+    // 多连接时第 c 个分块走第 c % K 条连接，两端用同样的规则，无需额外线程：
+    // 一条连接的发送缓冲区写满阻塞时，其余连接已缓冲的数据仍在各自的拥塞窗口内并行传输
+    auto link_stream = [&](int peer_id, int chunk_index)
+    {
+        return ios[peer_id][chunk_index % ios[peer_id].size()];
+    };
+
+    // 出错时关闭所有连接，避免其余线程永久阻塞
+    auto abort_all = [&]()
+    {
+        {
+            std::lock_guard<std::mutex> lock(ready_mutex);
+            aborted = true;
+        }
+        ready_cv.notify_all();
+        for (auto &link : ios)
+        {
+            for (auto io : link)
+                shutdown_io(io);
+        }
+    };
+
+    auto send_worker = [&](int peer_id, const std::vector<size_t> &step_indices, size_t thread_index)
+    {
+        pin_worker_thread();
+        try
+        {
+            for (size_t i : step_indices)
+            {
+                const std::vector<int> &stream = steps[i].send_blocks;
+                size_t total = stream.size() * data_size;
+                StepEvent &event = events[i];
+                std::vector<TcpInfo> link_before = sampling() ? sample_link(peer_id) : std::vector<TcpInfo>();
+                int chunk_index = 0;
+                for (size_t pos = 0; pos < total; pos += chunk_size, chunk_index++)
+                {
+                    size_t end = std::min(total, pos + chunk_size);
+                    int64_t wait_start = Clock::now();
+                    {
+                        std::unique_lock<std::mutex> lock(ready_mutex);
+                        ready_cv.wait(lock, [&]()
+                                      {
+                            bool ready = true;
+                            for_each_piece(stream, pos, end, [&](int block, size_t offset, size_t len)
+                                           { ready = ready && block_ready[block] >= offset + len; });
+                            return ready || aborted; });
+                        if (aborted)
+                            return;
+                    }
+
+                    int64_t ready = Clock::now();
+                    std::vector<iovec> segments = stream_segments(stream, pos, end);
+                    int64_t serialized = Clock::now();
+                    send_segments_concurrent(link_stream(peer_id, chunk_index), segments);
+                    int64_t sent = Clock::now();
+                    event.send_wait_ns += ready - wait_start;
+                    event.serialize_ns += serialized - ready;
+                    event.send_syscall_ns += sent - serialized;
+                    if constexpr (Clock::enabled)
+                        thread_chunks[thread_index].push_back({(int)i, true, chunk_index, end - pos,
+                                                               (ready - iteration_start) / 1e6, (sent - iteration_start) / 1e6});
+                }
+                int64_t sent = Clock::now();
+                if constexpr (Clock::enabled)
+                    wait_transmitted(ios[peer_id]);
+                int64_t transmitted = Clock::now();
+                event.send_wait_ns += transmitted - sent;
+                event.send_ns = transmitted - iteration_start;
+                release_blocks(stream, data_size);
+                append_telemetry(i, true, peer_id, link_before, thread_telemetry[thread_index]);
+            }
+        }
+        catch (...)
+        {
+            thread_errors[thread_index] = std::current_exception();
+            abort_all();
+        }
+    };
+
+    auto recv_worker = [&](int peer_id, const std::vector<size_t> &step_indices, size_t thread_index)
+    {
+        pin_worker_thread();
+        try
+        {
+            for (size_t i : step_indices)
+            {
+                const std::vector<int> &stream = steps[i].recv_blocks;
+                size_t total = stream.size() * data_size;
+                StepEvent &event = events[i];
+                std::vector<TcpInfo> link_before = sampling() ? sample_link(peer_id) : std::vector<TcpInfo>();
+
+                // 第一个分块走第 0 条连接，等待它可读的时间即等待对端开始发送
+                int64_t wait_start = Clock::now();
+                if constexpr (Clock::enabled)
+                    wait_readable(std::vector<IO *>{link_stream(peer_id, 0)});
+                event.recv_wait_ns = Clock::now() - wait_start;
+
+                int chunk_index = 0;
+                for (size_t pos = 0; pos < total; pos += chunk_size, chunk_index++)
+                {
+                    size_t end = std::min(total, pos + chunk_size);
+                    int64_t recv_start = Clock::now();
+                    recv_segments_concurrent(link_stream(peer_id, chunk_index), stream_segments(stream, pos, end));
+                    int64_t received = Clock::now();
+                    event.recv_syscall_ns += received - recv_start;
+                    {
+                        std::lock_guard<std::mutex> lock(ready_mutex);
+                        for_each_piece(stream, pos, end, [&](int block, size_t offset, size_t len)
+                                       { block_ready[block] = offset + len; });
+                    }
+                    ready_cv.notify_all();
+                    if constexpr (Clock::enabled)
+                        thread_chunks[thread_index].push_back({(int)i, false, chunk_index, end - pos,
+                                                               (recv_start - iteration_start) / 1e6, (received - iteration_start) / 1e6});
+                }
+                event.recv_ns = Clock::now() - iteration_start;
+                release_blocks(stream, data_size);
+                if (step_callback)
+                    step_callback(i, stream);
+                append_telemetry(i, false, peer_id, link_before, thread_telemetry[thread_index]);
+            }
+        }
+        catch (...)
+        {
+            thread_errors[thread_index] = std::current_exception();
+            abort_all();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    size_t thread_index = 0;
+    for (const auto &plan : send_plan)
+        workers.emplace_back(send_worker, plan.first, std::cref(plan.second), thread_index++);
+    for (const auto &plan : recv_plan)
+        workers.emplace_back(recv_worker, plan.first, std::cref(plan.second), thread_index++);
+
+    for (auto &worker : workers)
+        worker.join();
+
+    for (auto &error : thread_errors)
+    {
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    chunks.clear();
+    for (auto &records : thread_chunks)
+        chunks.insert(chunks.end(), records.begin(), records.end());
+    telemetry.clear();
+    for (auto &records : thread_telemetry)
+        telemetry.insert(telemetry.end(), records.begin(), records.end());
+}
+
+template <typename IO, typename Clock>
+void ShareEngine<IO, Clock>::share_data(size_t data_size, StepEvent *events, std::vector<ChunkRecord> &chunks,
+                                        std::vector<TelemetryRecord> &telemetry)
+{
+    // seeded：本地计算修正项与展开分享的时间计入第一步（唯一一步）的 serialize_ns
+    bool local_shares = seeded && !steps.empty();
+    int64_t local_ns = local_shares ? seeded_prepare(data_size) : 0;
+
+    if (options.sink != "none")
+        reset_block_pending();
+
+    // 新的分享开始：自己的块已经写好，取块服务可以提供。数据大小变化后接收时间重新估计
+    if (options.reroute)
+    {
+        std::lock_guard<std::mutex> lock(assist_mutex);
+        if (share_size != data_size)
+            std::fill(step_deadlines.begin(), step_deadlines.end(), StepDeadline{});
+        share_size = data_size;
+        share_seq++;
+        block_writing[party_id] = share_seq.load();
+        block_written[party_id] = share_seq.load();
+    }
+
+    if (options.exchange_mode == ExchangeMode::Pipelined)
+    {
+        share_data_pipelined(data_size, events, chunks, telemetry);
+    }
+    else
+    {
+        auto run_step = [&](size_t i, std::vector<TelemetryRecord> &step_telemetry)
+        {
+            std::vector<TcpInfo> send_before, recv_before;
+            if (sampling())
+            {
+                send_before = sample_link(steps[i].send_peer);
+                recv_before = sample_link(steps[i].recv_peer);
+            }
+
+            events[i] = StepEvent{};
+            if (options.exchange_mode == ExchangeMode::Duplex)
+                exchange_duplex(i, data_size, events[i]);
+            else
+                exchange_pingpong(i, data_size, events[i]);
+
+            // 递归减半收到的是对端对本方保留的那一半的部分和，与本方的同一段合并
+            if (!reduce_steps.empty() && reduce_steps[i].combine)
+            {
+                int64_t combine_start = Clock::now();
+                size_t begin = reduce_offset(reduce_steps[i].recv_lo, data_size);
+                size_t len = reduce_offset(reduce_steps[i].recv_hi, data_size) - begin;
+                const uint8_t *own = (i == 0 ? local_input.data() : recv_buffers.data()) + begin;
+                combine_buffers(options.reduce_op, recv_buffers.data() + begin, own, recv_buffers.data() + data_size, len);
+                events[i].combine_ns = Clock::now() - combine_start;
+            }
+
+            if (step_callback)
+                step_callback(i, steps[i].recv_blocks);
+
+            append_telemetry(i, true, steps[i].send_peer, send_before, step_telemetry);
+            append_telemetry(i, false, steps[i].recv_peer, recv_before, step_telemetry);
+        };
+
+        telemetry.clear();
+        for (size_t first = 0; first < steps.size();)
+        {
+            size_t last = first + 1;
+            while (last < steps.size() && steps[last].concurrent)
+                last++;
+            if (last - first == 1)
+            {
+                run_step(first, telemetry);
+                first = last;
+                continue;
+            }
+
+            // 多端口：同一组的步骤各占一个线程同时收发，出错时关闭所有连接，避免其余线程永久阻塞
+            std::vector<std::vector<TelemetryRecord>> group_telemetry(last - first);
+            for_each_stream(last - first, [&](size_t k)
+                            {
+                try
+                {
+                    run_step(first + k, group_telemetry[k]);
+                }
+                catch (...)
+                {
+                    for (auto &link : ios)
+                    {
+                        for (auto io : link)
+                            shutdown_io(io);
+                    }
+                    throw;
+                } });
+            for (auto &records : group_telemetry)
+                telemetry.insert(telemetry.end(), records.begin(), records.end());
+            first = last;
+        }
+    }
+
+    // 分享结束后调用方可能改写自己的块，不再提供
+    if (options.reroute)
+        block_writing[party_id] = share_seq + 1;
+
+    if (local_shares)
+        events[0].serialize_ns += local_ns + seeded_expand(data_size);
+    if (!reduce_steps.empty())
+        return;
+    // 只有一个参与方时 reduce 没有任何步骤，结果即输入
+    if (options.collective != Collective::AllGather)
+        std::memcpy(recv_buffers.data(), local_input.data(), data_size);
+}
+
+// 对端链路上每条连接的 TCP_INFO，peer_id < 0 时为空
+template <typename IO, typename Clock>
+std::vector<TcpInfo> ShareEngine<IO, Clock>::sample_link(int peer_id) const
+{
+    std::vector<TcpInfo> samples;
+    if (peer_id < 0)
+        return samples;
+    for (auto io : ios[peer_id])
+        samples.push_back(read_tcp_info(io));
+    return samples;
+}
+
+// 用步骤结束时的采样与 before 配对，before 为空（未开启遥测或本步没有该方向）时不记录
+template <typename IO, typename Clock>
+void ShareEngine<IO, Clock>::append_telemetry(int step, bool is_send, int peer_id, const std::vector<TcpInfo> &before,
+                                              std::vector<TelemetryRecord> &telemetry) const
+{
+    if (before.empty())
+        return;
+    std::vector<TcpInfo> after = sample_link(peer_id);
+    for (size_t k = 0; k < before.size(); k++)
+        telemetry.push_back({step, is_send, peer_id, (int)k, before[k], after[k]});
+}
+
+template <typename IO, typename Clock>
+void ShareEngine<IO, Clock>::exchange_pingpong(size_t step_index, size_t data_size, StepEvent &event)
+{
+    const ScheduleStep &step = steps[step_index];
+
+    int64_t serialize_start = Clock::now();
+    std::vector<iovec> send_segments, recv_segments;
+    step_segments(step_index, data_size, send_segments, recv_segments);
+    event.serialize_ns = Clock::now() - serialize_start;
+
+    auto do_send = [&]()
+    {
+        if (step.send_peer < 0)
+            return;
+        int64_t send_start = Clock::now();
+        send_striped(ios[step.send_peer], send_segments);
+        int64_t sent = Clock::now();
+        if constexpr (Clock::enabled)
+            wait_transmitted(ios[step.send_peer]);
+        int64_t transmitted = Clock::now();
+        event.send_syscall_ns = sent - send_start;
+        event.send_wait_ns = transmitted - sent;
+        event.send_ns = transmitted - send_start;
+        release_blocks(step.send_blocks, data_size);
+    };
+
+    // 带缓冲的 IO 上数据可能已在用户态缓冲区中，只能测总时间
+    auto do_recv = [&]()
+    {
+        if (step.recv_peer < 0)
+            return;
+        int64_t recv_start = Clock::now();
+        // 限时接收无法区分等待与读取
+        if constexpr (std::is_same_v<IO, RawSocketIO>)
+        {
+            if (options.reroute)
+            {
+                recv_rerouted(step_index, data_size, recv_segments);
+                event.recv_wait_ns = -1;
+                event.recv_syscall_ns = -1;
+                event.recv_ns = Clock::now() - recv_start;
+                release_blocks(step.recv_blocks, data_size);
+                return;
+            }
+        }
+        int64_t readable = recv_start;
+        if constexpr (Clock::enabled && !is_buffered_io<IO>::value)
+        {
+            wait_readable(ios[step.recv_peer]);
+            readable = Clock::now();
+        }
+        recv_striped(ios[step.recv_peer], recv_segments);
+        int64_t received = Clock::now();
+        event.recv_wait_ns = is_buffered_io<IO>::value ? -1 : readable - recv_start;
+        event.recv_syscall_ns = is_buffered_io<IO>::value ? -1 : received - readable;
+        event.recv_ns = received - recv_start;
+        release_blocks(step.recv_blocks, data_size);
+    };
+
+    if (step.send_first)
+    {
+        do_send();
+        do_recv();
+    }
+    else
+    {
+        do_recv();
+        do_send();
+    }
+}
+
+// reroute 下的接收：在截止时间内没有收齐时，从截止时已收到的字节之后改向其他参与方请求，
+// 取不到（没有合适的参与方或对方的块已经过期）时照常等待原对端
+template <typename IO, typename Clock>
+void ShareEngine<IO, Clock>::recv_rerouted(size_t step_index, size_t data_size, const std::vector<iovec> &segments)
+{
+    const ScheduleStep &step = steps[step_index];
+    int peer_id = step.recv_peer;
+    int fd = ios[peer_id][0]->consocket;
+    join_drain(peer_id);
+
+    uint64_t seq = share_seq;
+    for (int block : step.recv_blocks)
+        block_writing[block] = seq;
+
+    StepDeadline &estimate = step_deadlines[step_index];
+    size_t total = step.recv_blocks.size() * data_size;
+    int64_t start = monotonic_ns();
+    int64_t deadline_ns = std::max<int64_t>(options.reroute_min_us * 1000,
+                                            estimate.mean_ns + options.reroute_factor * estimate.deviation_ns);
+    size_t received = total;
+    if (estimate.samples < kRerouteWarmup)
+        recv_vectored(fd, segments);
+    else
+        received = recv_vectored_until(fd, segments, start + deadline_ns);
+
+    if (received == total)
+    {
+        double sample = monotonic_ns() - start;
+        if (estimate.samples++ == 0)
+        {
+            estimate.mean_ns = sample;
+            estimate.deviation_ns = sample / 2;
+        }
+        else
+        {
+            estimate.deviation_ns = 0.75 * estimate.deviation_ns + 0.25 * std::abs(sample - estimate.mean_ns);
+            estimate.mean_ns = 0.875 * estimate.mean_ns + 0.125 * sample;
+        }
+    }
+    else
+    {
+        // 线上按块号升序排列；截止时收到一半的块从中断处继续取
+        std::vector<int> blocks(step.recv_blocks);
+        std::sort(blocks.begin(), blocks.end());
+        blocks.erase(blocks.begin(), blocks.begin() + received / data_size);
+        size_t skip = received % data_size;
+        std::vector<iovec> remaining;
+        size_t offset = received;
+        for (const auto &segment : segments)
+        {
+            if (offset >= segment.iov_len)
+            {
+                offset -= segment.iov_len;
+                continue;
+            }
+            remaining.push_back({static_cast<uint8_t *>(segment.iov_base) + offset, segment.iov_len - offset});
+            offset = 0;
+        }
+
+        std::ostringstream line;
+        line << std::fixed << std::setprecision(3) << "Reroute: share " << seq << " step " << step_index << " party "
+             << peer_id << " missed the " << deadline_ns / 1e6 << " ms deadline with " << received << "/" << total
+             << " bytes";
+        int holder = reroute_holder(step_index, blocks, peer_id);
+        int64_t fetch_start = monotonic_ns();
+        if (holder >= 0 && fetch_blocks(holder, data_size, blocks, skip))
+        {
+            line << ", fetched " << blocks.size() << " block(s) from party " << holder << " in "
+                 << (monotonic_ns() - fetch_start) / 1e6 << " ms";
+            out << line.str() << std::endl;
+            // 原对端的剩余数据仍会到达，后台读出丢弃
+            size_t late_bytes = total - received;
+            drains[peer_id] = std::thread([this, peer_id, fd, late_bytes]()
+                                          {
+                try
+                {
+                    std::vector<uint8_t> discard(std::min<size_t>(late_bytes, 1 << 20));
+                    for (size_t left = late_bytes; left > 0;)
+                    {
+                        size_t len = std::min(left, discard.size());
+                        recv_vectored(fd, {{discard.data(), len}});
+                        left -= len;
+                    }
+                }
+                catch (...)
+                {
+                    drain_errors[peer_id] = std::current_exception();
+                } });
+        }
+        else
+        {
+            line << ", " << (holder < 0 ? "no other party holds the blocks yet" : "party " + std::to_string(holder) + " could not serve them")
+                 << ", waiting";
+            out << line.str() << std::endl;
+            recv_vectored(fd, remaining);
+        }
+    }
+
+    for (int block : step.recv_blocks)
+        block_written[block] = seq;
+    assist_cv.notify_all();
+}
+
+// 在本步之前已经收到所有这些块的参与方中选最早收齐的一个（不含本方与迟到的对端），没有时返回 -1
+template <typename IO, typename Clock>
+int ShareEngine<IO, Clock>::reroute_holder(size_t step_index, const std::vector<int> &blocks, int late_peer) const
+{
+    int best = -1;
+    int best_step = (int)step_index;
+    for (int holder = 0; holder < num_parties; holder++)
+    {
+        if (holder == party_id || holder == late_peer || fetch_failed[holder])
+            continue;
+        int last = -1;
+        for (int block : blocks)
+            last = std::max(last, acquired_at[holder][block]);
+        if (last < best_step)
+        {
+            best = holder;
+            best_step = last;
+        }
+    }
+    return best;
+}
+
+// 向 holder 请求 blocks（第一个块跳过 skip 字节）直接写入缓冲区，对方确认发送期间块未被改写时返回 true。
+// 返回 false 时写入的内容可能已经过期，调用方从原对端重新接收同一范围即可覆盖
+template <typename IO, typename Clock>
+bool ShareEngine<IO, Clock>::fetch_blocks(int holder, size_t data_size, const std::vector<int> &blocks, size_t skip)
+{
+    int fd = fetch_fds[holder];
+    try
+    {
+        FetchRequest request{share_seq, data_size, (uint32_t)blocks.size(), (uint32_t)skip};
+        std::vector<uint32_t> ids(blocks.begin(), blocks.end());
+        send_vectored(fd, {{&request, sizeof(request)}, {ids.data(), ids.size() * sizeof(uint32_t)}});
+
+        uint32_t ready = 0;
+        recv_vectored(fd, {{&ready, sizeof(ready)}});
+        if (!ready)
+            return false;
+        std::vector<iovec> segments;
+        for (size_t i = 0; i < blocks.size(); i++)
+        {
+            size_t offset = i == 0 ? skip : 0;
+            segments.push_back({recv_buffers.data() + blocks[i] * data_size + offset, data_size - offset});
+        }
+        uint32_t intact = 0;
+        segments.push_back({&intact, sizeof(intact)});
+        recv_vectored(fd, segments);
+        return intact != 0;
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Reroute: fetch from party " << holder << " failed: " << e.what() << std::endl;
+        fetch_failed[holder] = true;
+        return false;
+    }
+}
+
+template <typename IO, typename Clock>
+void ShareEngine<IO, Clock>::join_drain(int peer_id)
+{
+    if (!drains[peer_id].joinable())
+        return;
+    drains[peer_id].join();
+    if (drain_errors[peer_id])
+        std::rethrow_exception(std::exchange(drain_errors[peer_id], nullptr));
+}
+
+// 取块服务线程：依次应答各对端的请求，析构时经 assist_wake 唤醒退出。连接出错的对端不再应答
+template <typename IO, typename Clock>
+void ShareEngine<IO, Clock>::serve_assists()
+{
+    std::vector<int> peers;
+    for (int peer_id = 0; peer_id < num_parties; peer_id++)
+    {
+        if (serve_fds[peer_id] >= 0)
+            peers.push_back(peer_id);
+    }
+    while (!assist_stopping)
+    {
+        std::vector<pollfd> pfds{{assist_wake[0], POLLIN, 0}};
+        for (int peer_id : peers)
+            pfds.push_back({serve_fds[peer_id], POLLIN, 0});
+        if (::poll(pfds.data(), pfds.size(), -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+        if (pfds[0].revents)
+            return;
+        std::vector<int> alive;
+        for (size_t i = 0; i < peers.size(); i++)
+        {
+            try
+            {
+                if (pfds[i + 1].revents)
+                    serve_request(pfds[i + 1].fd);
+                alive.push_back(peers[i]);
+            }
+            catch (const std::exception &)
+            {
+                // 对端已关闭连接（正常退出时也会如此）
+            }
+        }
+        peers = alive;
+    }
+}
+
+// 等到请求的块在本方收齐后发送；本方的块已属于之后的分享或数据大小不同时回复无法提供。
+// 发送后再告知对方发送期间块是否仍属于请求的分享
+template <typename IO, typename Clock>
+void ShareEngine<IO, Clock>::serve_request(int fd)
+{
+    FetchRequest request;
+    recv_vectored(fd, {{&request, sizeof(request)}});
+    std::vector<uint32_t> blocks(request.count);
+    recv_vectored(fd, {{blocks.data(), blocks.size() * sizeof(uint32_t)}});
+    for (uint32_t block : blocks)
+    {
+        if (block >= (uint32_t)num_parties || request.skip >= request.data_size)
+            throw std::runtime_error("malformed fetch request");
+    }
+
+    std::unique_lock<std::mutex> lock(assist_mutex);
+    uint32_t ready = 0;
+    while (!assist_stopping)
+    {
+        bool stale = share_size != request.data_size;
+        bool complete = true;
+        for (uint32_t block : blocks)
+        {
+            stale = stale || block_writing[block] > request.share_seq || block_written[block] > request.share_seq;
+            complete = complete && block_written[block] == request.share_seq;
+        }
+        if (stale || complete)
+        {
+            ready = !stale;
+            break;
+        }
+        assist_cv.wait_for(lock, std::chrono::milliseconds(1));
+    }
+
+    send_vectored(fd, {{&ready, sizeof(ready)}});
+    if (!ready)
+        return;
+    std::vector<iovec> segments;
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        size_t offset = i == 0 ? request.skip : 0;
+        segments.push_back({recv_buffers.data() + blocks[i] * request.data_size + offset, request.data_size - offset});
+    }
+    send_vectored(fd, segments);
+    uint32_t intact = 1;
+    for (uint32_t block : blocks)
+        intact = intact && block_writing[block] == request.share_seq;
+    send_vectored(fd, {{&intact, sizeof(intact)}});
+}
+
+template <typename IO, typename Clock>
+void ShareEngine<IO, Clock>::exchange_duplex(size_t step_index, size_t data_size, StepEvent &event)
+{
+    const ScheduleStep &step = steps[step_index];
+
+    int64_t serialize_start = Clock::now();
+    std::vector<iovec> send_segments, recv_segments;
+    step_segments(step_index, data_size, send_segments, recv_segments);
+
+    // 两个方向同时开始，发送和接收各自计时
+    int64_t step_start = Clock::now();
+    event.serialize_ns = step_start - serialize_start;
+#ifdef HAVE_IO_URING
+    if constexpr (std::is_same_v<IO, UringIO>)
+    {
+        // 收发在同一次提交中完成，无法区分等待与拷贝；发送时间只到请求完成（数据进入内核），不含等待发到线上
+        int64_t send_end = step_start;
+        int64_t recv_end = step_start;
+        exchange_striped(step.send_peer >= 0 ? ios[step.send_peer] : std::vector<UringIO *>(), send_segments,
+                         step.recv_peer >= 0 ? ios[step.recv_peer] : std::vector<UringIO *>(), recv_segments,
+                         send_end, recv_end);
+        if (step.send_peer >= 0)
+        {
+            event.send_ns = send_end - step_start;
+            event.send_syscall_ns = send_end - step_start;
+            event.send_wait_ns = -1;
+        }
+        if (step.recv_peer >= 0)
+        {
+            event.recv_ns = recv_end - step_start;
+            event.recv_wait_ns = -1;
+            event.recv_syscall_ns = -1;
+        }
+        release_blocks(step.send_blocks, data_size);
+        release_blocks(step.recv_blocks, data_size);
+        return;
+    }
+#endif
+    std::exception_ptr send_error;
+
+    std::thread sender([&]()
+                       {
+        if (step.send_peer < 0)
+            return;
+        pin_worker_thread();
+        try
+        {
+            send_striped_concurrent(ios[step.send_peer], send_segments);
+            int64_t sent = Clock::now();
+            if constexpr (Clock::enabled)
+                wait_transmitted(ios[step.send_peer]);
+            int64_t transmitted = Clock::now();
+            event.send_syscall_ns = sent - step_start;
+            event.send_wait_ns = transmitted - sent;
+            event.send_ns = transmitted - step_start;
+            release_blocks(step.send_blocks, data_size);
+        }
+        catch (...)
+        {
+            send_error = std::current_exception();
+        } });
+
+    // 并发收发直接读 socket，不经过 IO 的缓冲，可以用 poll 等待数据到达
+    if (step.recv_peer >= 0)
+    {
+        try
+        {
+            if constexpr (Clock::enabled)
+                wait_readable(ios[step.recv_peer]);
+            int64_t readable = Clock::now();
+            recv_striped_concurrent(ios[step.recv_peer], recv_segments);
+            int64_t received = Clock::now();
+            event.recv_wait_ns = readable - step_start;
+            event.recv_syscall_ns = received - readable;
+            event.recv_ns = received - step_start;
+            release_blocks(step.recv_blocks, data_size);
+        }
+        catch (...)
+        {
+            sender.join();
+            throw;
+        }
+    }
+
+    sender.join();
+    if (send_error)
+        std::rethrow_exception(send_error);
+}
+
+template <typename IO, typename Clock>
+uint8_t *ShareEngine<IO, Clock>::input(size_t data_size)
+{
+    preallocate_buffers(data_size);
+    if (seeded || options.collective != Collective::AllGather)
+        return local_input.data();
+    return recv_buffers.data() + party_id * data_size;
+}
+
+template <typename IO, typename Clock>
+void ShareEngine<IO, Clock>::share(size_t data_size)
+{
+    plan(data_size);
+    preallocate_buffers(data_size);
+    scratch_events.assign(steps.size(), StepEvent{});
+    share_data(data_size, scratch_events.data(), scratch_chunks, scratch_telemetry);
+}
+
+template <typename IO, typename Clock>
+void ShareEngine<IO, Clock>::share_batch(const std::vector<const uint8_t *> &inputs, const std::vector<uint8_t *> &outputs,
+                                         size_t instance_size)
+{
+    if (options.collective != Collective::AllGather || seeded || options.sink != "none")
+        throw std::invalid_argument("share_batch supports the all-gather algorithms without sink");
+    if (inputs.size() != outputs.size() || inputs.empty())
+        throw std::invalid_argument("share_batch needs one output per input");
+
+    size_t data_size = inputs.size() * instance_size;
+    plan(data_size);
+    preallocate_buffers(data_size);
+    uint8_t *own = recv_buffers.data() + party_id * data_size;
+    for (size_t m = 0; m < inputs.size(); m++)
+        std::memcpy(own + m * instance_size, inputs[m], instance_size);
+
+    scratch_events.assign(steps.size(), StepEvent{});
+    share_data(data_size, scratch_events.data(), scratch_chunks, scratch_telemetry);
+    scatter_batch(instance_size, outputs);
+}
+
+template <typename IO, typename Clock>
+std::future<void> ShareEngine<IO, Clock>::share_async(size_t data_size, StepCallback on_step)
+{
+    validate_data_size(data_size);
+    if (recv_buffers.size() < num_parties * data_size)
+        throw std::invalid_argument("share_async needs buffers preallocated for the data size");
+    plan(data_size);
+    scratch_events.assign(steps.size(), StepEvent{});
+    return start_share(data_size, scratch_events.data(), scratch_chunks, scratch_telemetry, std::move(on_step));
+}
+
+// 在 IO 线程上执行 share_data，回调只在这次分享期间有效
+template <typename IO, typename Clock>
+std::future<void> ShareEngine<IO, Clock>::start_share(size_t data_size, StepEvent *events, std::vector<ChunkRecord> &chunks,
+                                                      std::vector<TelemetryRecord> &telemetry, StepCallback on_step)
+{
+    if (!io_worker)
+        io_worker.reset(new IoWorker());
+    return io_worker->submit([this, data_size, events, &chunks, &telemetry, on_step]()
+                             {
+        step_callback = on_step;
+        try
+        {
+            share_data(data_size, events, chunks, telemetry);
+        }
+        catch (...)
+        {
+            step_callback = nullptr;
+            throw;
+        }
+        step_callback = nullptr; });
+}
+
+// 合并传输后块 b 中第 m 个实例位于 (b * M + m) * 实例大小，拷贝到 outputs[m] + b * 实例大小
+template <typename IO, typename Clock>
+void ShareEngine<IO, Clock>::scatter_batch(size_t instance_size, const std::vector<uint8_t *> &outputs)
+{
+    size_t batch = outputs.size();
+    for (size_t m = 0; m < batch; m++)
+    {
+        for (int block = 0; block < num_parties; block++)
+            std::memcpy(outputs[m] + block * instance_size, recv_buffers.data() + (block * batch + m) * instance_size,
+                        instance_size);
+    }
+}
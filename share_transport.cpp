@@ -0,0 +1,1936 @@
+#include "share_transport.h"
+
+#include <chrono>
+#include <fstream>
+#include <random>
+#include <arpa/inet.h>
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
+#include <ifaddrs.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <pthread.h>
+#include <linux/futex.h>
+
+static inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+std::map<std::string, NetworkProfile> default_network_profiles()
+{
+    NetworkProfile lan;
+    lan.bandwidth_mbps = 10000;
+    lan.rtt_ms = 0.1;
+
+    NetworkProfile wan;
+    wan.bandwidth_mbps = 1000;
+    wan.rtt_ms = 60;
+    wan.congestion = "bbr";
+    wan.streams = 4;
+
+    return {{"lan", lan}, {"wan", wan}};
+}
+
+bool apply_profile_option(NetworkProfile &profile, const std::string &key, const std::string &value)
+{
+    if (key == "bandwidth_mbps")
+        profile.bandwidth_mbps = std::stod(value);
+    else if (key == "rtt_ms")
+        profile.rtt_ms = std::stod(value);
+    else if (key == "buffer_kb")
+        profile.buffer_bytes = std::stoul(value) * 1024;
+    else if (key == "nodelay")
+        profile.nodelay = value == "1" || value == "true";
+    else if (key == "congestion")
+        profile.congestion = value == "default" ? "" : value;
+    else if (key == "busy_poll_us")
+        profile.busy_poll_us = std::stoi(value);
+    else if (key == "streams")
+    {
+        profile.streams = std::stoi(value);
+        if (profile.streams <= 0)
+        {
+            std::cerr << "streams must be positive" << std::endl;
+            return false;
+        }
+    }
+    else
+    {
+        std::cerr << "Unknown network profile option: " << key << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// 建连握手：拨号方发送自己的身份和连接序号，监听方校验后回复同样格式的消息
+const uint32_t handshake_magic = 0x53534c45; // "SSLE"
+const size_t handshake_size = 16;
+
+void encode_handshake(uint8_t *buf, int party_id, int num_parties, int stream)
+{
+    uint32_t fields[4] = {htonl(handshake_magic), htonl((uint32_t)party_id), htonl((uint32_t)num_parties),
+                          htonl((uint32_t)stream)};
+    std::memcpy(buf, fields, handshake_size);
+}
+
+bool decode_handshake(const uint8_t *buf, int num_parties, int &party_id, int &stream)
+{
+    uint32_t fields[4];
+    std::memcpy(fields, buf, handshake_size);
+    if (ntohl(fields[0]) != handshake_magic || (int)ntohl(fields[2]) != num_parties)
+        return false;
+    party_id = (int)ntohl(fields[1]);
+    stream = (int)ntohl(fields[3]);
+    return party_id >= 0 && party_id < num_parties;
+}
+
+void set_blocking(int fd, bool blocking)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, blocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK));
+}
+
+void apply_network_profile(int fd, const NetworkProfile &profile)
+{
+    static bool buffer_warned = false;
+    static bool congestion_warned = false;
+    static bool busy_poll_warned = false;
+
+    size_t buffer = profile.socket_buffer_bytes();
+    if (buffer > 0)
+    {
+        int value = (int)std::min<size_t>(buffer, INT_MAX / 2);
+        // SO_*BUFFORCE 需要 CAP_NET_ADMIN，否则退回受 net.core.wmem_max/rmem_max 限制的普通设置
+        bool ok = true;
+        if (setsockopt(fd, SOL_SOCKET, SO_SNDBUFFORCE, &value, sizeof(value)) < 0)
+            ok = setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &value, sizeof(value)) == 0 && ok;
+        if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &value, sizeof(value)) < 0)
+            ok = setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &value, sizeof(value)) == 0 && ok;
+        if (!ok && !buffer_warned)
+        {
+            std::cerr << "Failed to set socket buffers to " << value << " bytes: " << std::strerror(errno) << std::endl;
+            buffer_warned = true;
+        }
+    }
+
+    int nodelay = profile.nodelay ? 1 : 0;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+    if (!profile.congestion.empty() &&
+        setsockopt(fd, IPPROTO_TCP, TCP_CONGESTION, profile.congestion.c_str(), profile.congestion.size()) < 0 &&
+        !congestion_warned)
+    {
+        std::cerr << "Failed to select congestion control " << profile.congestion << ": " << std::strerror(errno) << std::endl;
+        congestion_warned = true;
+    }
+
+#ifdef SO_BUSY_POLL
+    if (profile.busy_poll_us > 0 &&
+        setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &profile.busy_poll_us, sizeof(profile.busy_poll_us)) < 0 &&
+        !busy_poll_warned)
+    {
+        std::cerr << "Failed to enable SO_BUSY_POLL: " << std::strerror(errno) << std::endl;
+        busy_poll_warned = true;
+    }
+#endif
+}
+
+SocketSettings read_socket_settings(int fd)
+{
+    SocketSettings settings;
+    socklen_t len = sizeof(int);
+    getsockopt(fd, SOL_SOCKET, SO_SNDBUF, &settings.sndbuf, &len);
+    len = sizeof(int);
+    getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &settings.rcvbuf, &len);
+    len = sizeof(int);
+    getsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &settings.nodelay, &len);
+#ifdef SO_BUSY_POLL
+    len = sizeof(int);
+    getsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &settings.busy_poll_us, &len);
+#endif
+    char name[32] = {};
+    len = sizeof(name) - 1;
+    if (getsockopt(fd, IPPROTO_TCP, TCP_CONGESTION, name, &len) == 0)
+        settings.congestion = name;
+    return settings;
+}
+
+TcpInfo read_tcp_info(int fd)
+{
+    TcpInfo info{};
+    socklen_t len = sizeof(info);
+    getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len);
+    return info;
+}
+
+// 参与方多时每个参与方要打开的 socket 超过默认的 1024 个软限制，建连前提高到硬限制
+static void raise_fd_limit()
+{
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+std::map<int, std::vector<int>> connect_mesh(int party_id, int num_parties, const std::vector<std::string> &ips,
+                                             int base_port, const std::vector<int> &peers, const NetworkProfile &profile,
+                                             int timeout_ms, const std::vector<std::vector<std::string>> &nic_ips)
+{
+    raise_fd_limit();
+
+    const int streams = profile.streams;
+    using clock = std::chrono::steady_clock;
+    const auto deadline = clock::now() + std::chrono::milliseconds(timeout_ms);
+    const int initial_backoff_ms = 10;
+    const int max_backoff_ms = 250;
+
+    for (int peer_id : peers)
+    {
+        if (base_port + peer_id > 65535 || base_port + party_id > 65535)
+            throw std::invalid_argument("Port out of range: base_port + party_id must not exceed 65535");
+    }
+
+    enum class DialState
+    {
+        Waiting,
+        Connecting,
+        AwaitingAck,
+        Done
+    };
+
+    struct Dial
+    {
+        int peer_id;
+        int stream;
+        int fd = -1;
+        DialState state = DialState::Waiting;
+        clock::time_point next_attempt;
+        int backoff_ms;
+        uint8_t reply[handshake_size];
+        size_t received = 0;
+        int attempts = 0;
+    };
+
+    struct Accepted
+    {
+        int fd;
+        uint8_t hello[handshake_size];
+        size_t received = 0;
+    };
+
+    std::map<std::pair<int, int>, int> connected; // (对端编号, 连接序号) -> socket
+    std::vector<Dial> dials;
+    std::vector<int> expected_accepts;
+    for (int peer_id : peers)
+    {
+        if (peer_id < party_id)
+        {
+            for (int stream = 0; stream < streams; stream++)
+                dials.push_back({peer_id, stream, -1, DialState::Waiting, clock::now(), initial_backoff_ms, {}, 0, 0});
+        }
+        else
+            expected_accepts.push_back(peer_id);
+    }
+    std::vector<Accepted> accepted;
+
+    int listen_fd = -1;
+    auto cleanup = [&]()
+    {
+        if (listen_fd >= 0)
+            close(listen_fd);
+        for (auto &dial : dials)
+        {
+            if (dial.fd >= 0 && dial.state != DialState::Done)
+                close(dial.fd);
+        }
+        for (auto &conn : accepted)
+            close(conn.fd);
+    };
+
+    if (!expected_accepts.empty())
+    {
+        listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        int reuse = 1;
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        apply_network_profile(listen_fd, profile);
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(base_port + party_id);
+        if (bind(listen_fd, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_fd, SOMAXCONN) < 0)
+        {
+            std::string error = std::strerror(errno);
+            cleanup();
+            throw std::runtime_error("Failed to listen on port " + std::to_string(base_port + party_id) + ": " + error);
+        }
+        std::cout << "Party " << party_id << " listening on port " << base_port + party_id
+                  << " for " << expected_accepts.size() << " parties" << std::endl;
+    }
+
+    // party 的第 index 个网卡地址，没有配置网卡时为 ips 中的地址
+    auto nic_address = [&](int party, int index) -> const std::string &
+    {
+        if (party < (int)nic_ips.size() && !nic_ips[party].empty())
+            return nic_ips[party][index % nic_ips[party].size()];
+        return ips[party];
+    };
+    const bool bind_source = party_id < (int)nic_ips.size() && !nic_ips[party_id].empty();
+
+    auto retry_later = [&](Dial &dial)
+    {
+        if (dial.fd >= 0)
+            close(dial.fd);
+        dial.fd = -1;
+        dial.state = DialState::Waiting;
+        dial.next_attempt = clock::now() + std::chrono::milliseconds(dial.backoff_ms);
+        dial.backoff_ms = std::min(dial.backoff_ms * 2, max_backoff_ms);
+    };
+
+    auto send_hello = [&](Dial &dial)
+    {
+        uint8_t hello[handshake_size];
+        encode_handshake(hello, party_id, num_parties, dial.stream);
+        // 新建连接的发送缓冲区是空的，16字节的握手一次就能写完
+        if (::send(dial.fd, hello, handshake_size, MSG_NOSIGNAL) != (ssize_t)handshake_size)
+            retry_later(dial);
+        else
+            dial.state = DialState::AwaitingAck;
+    };
+
+    try
+    {
+        while (connected.size() < peers.size() * streams)
+        {
+            auto now = clock::now();
+            if (now > deadline)
+            {
+                std::string missing;
+                for (int peer_id : peers)
+                {
+                    for (int stream = 0; stream < streams; stream++)
+                    {
+                        if (!connected.count({peer_id, stream}))
+                        {
+                            missing += " " + std::to_string(peer_id);
+                            break;
+                        }
+                    }
+                }
+                throw std::runtime_error("Timed out waiting for parties:" + missing);
+            }
+
+            // 发起到期的拨号
+            int poll_timeout_ms = 100;
+            for (auto &dial : dials)
+            {
+                if (dial.state != DialState::Waiting)
+                    continue;
+                if (dial.next_attempt > now)
+                {
+                    auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(dial.next_attempt - now).count();
+                    poll_timeout_ms = std::min<int>(poll_timeout_ms, std::max<int>(1, wait));
+                    continue;
+                }
+
+                const std::string &remote = nic_address(dial.peer_id, party_id + dial.stream);
+                sockaddr_in addr{};
+                addr.sin_family = AF_INET;
+                addr.sin_port = htons(base_port + dial.peer_id);
+                if (inet_pton(AF_INET, remote.c_str(), &addr.sin_addr) != 1)
+                    throw std::invalid_argument("Invalid IP address for party " + std::to_string(dial.peer_id) + ": " + remote);
+
+                dial.attempts++;
+                dial.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+                if (dial.fd < 0)
+                    throw std::runtime_error("Failed to create a socket to party " + std::to_string(dial.peer_id) + ": " +
+                                             std::strerror(errno) + " (" + std::to_string(connected.size()) +
+                                             " connections open, check ulimit -n)");
+                apply_network_profile(dial.fd, profile);
+                if (bind_source)
+                {
+                    // 固定源地址，出口走该地址所在的网卡
+                    const std::string &local = nic_address(party_id, dial.peer_id + dial.stream);
+                    sockaddr_in source{};
+                    source.sin_family = AF_INET;
+                    inet_pton(AF_INET, local.c_str(), &source.sin_addr);
+                    if (bind(dial.fd, (sockaddr *)&source, sizeof(source)) < 0)
+                        throw std::runtime_error("Failed to bind source address " + local + ": " + std::strerror(errno));
+                }
+                if (connect(dial.fd, (sockaddr *)&addr, sizeof(addr)) == 0)
+                    send_hello(dial);
+                else if (errno == EINPROGRESS)
+                    dial.state = DialState::Connecting;
+                else
+                    retry_later(dial);
+            }
+
+            std::vector<pollfd> fds;
+            std::vector<std::pair<int, size_t>> owners; // 0: 监听, 1: 拨号, 2: 已接受
+            if (listen_fd >= 0)
+            {
+                fds.push_back({listen_fd, POLLIN, 0});
+                owners.push_back({0, 0});
+            }
+            for (size_t i = 0; i < dials.size(); i++)
+            {
+                if (dials[i].state == DialState::Connecting)
+                    fds.push_back({dials[i].fd, POLLOUT, 0});
+                else if (dials[i].state == DialState::AwaitingAck)
+                    fds.push_back({dials[i].fd, POLLIN, 0});
+                else
+                    continue;
+                owners.push_back({1, i});
+            }
+            for (size_t i = 0; i < accepted.size(); i++)
+            {
+                fds.push_back({accepted[i].fd, POLLIN, 0});
+                owners.push_back({2, i});
+            }
+
+            int ready = poll(fds.data(), fds.size(), poll_timeout_ms);
+            if (ready < 0 && errno != EINTR)
+                throw std::runtime_error(std::string("poll failed: ") + std::strerror(errno));
+            if (ready <= 0)
+                continue;
+
+            std::vector<size_t> finished_accepts;
+            for (size_t k = 0; k < fds.size(); k++)
+            {
+                if (!fds[k].revents)
+                    continue;
+
+                if (owners[k].first == 0)
+                {
+                    int fd;
+                    while ((fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK)) >= 0)
+                        accepted.push_back({fd, {}, 0});
+                    // 对端在握手前断开（ECONNABORTED）不影响其余连接；其他错误（如 EMFILE）下监听 socket 一直可读，重试只会空转
+                    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNABORTED)
+                        throw std::runtime_error(std::string("Failed to accept a connection: ") + std::strerror(errno) +
+                                                 " (" + std::to_string(connected.size()) + " connections open, check ulimit -n)");
+                }
+                else if (owners[k].first == 1)
+                {
+                    Dial &dial = dials[owners[k].second];
+                    if (dial.state == DialState::Connecting)
+                    {
+                        int error = 0;
+                        socklen_t len = sizeof(error);
+                        getsockopt(dial.fd, SOL_SOCKET, SO_ERROR, &error, &len);
+                        if (error == 0)
+                            send_hello(dial);
+                        else
+                            retry_later(dial);
+                        continue;
+                    }
+
+                    ssize_t res = ::recv(dial.fd, dial.reply + dial.received, handshake_size - dial.received, 0);
+                    if (res <= 0)
+                    {
+                        if (res < 0 && (errno == EAGAIN || errno == EINTR))
+                            continue;
+                        dial.received = 0;
+                        retry_later(dial);
+                        continue;
+                    }
+                    dial.received += res;
+                    if (dial.received < handshake_size)
+                        continue;
+
+                    int acked_id = -1;
+                    int acked_stream = -1;
+                    if (!decode_handshake(dial.reply, num_parties, acked_id, acked_stream) || acked_id != dial.peer_id ||
+                        acked_stream != dial.stream)
+                        throw std::runtime_error("Unexpected handshake reply from " + ips[dial.peer_id] + ":" +
+                                                 std::to_string(base_port + dial.peer_id));
+                    dial.state = DialState::Done;
+                    connected[{dial.peer_id, dial.stream}] = dial.fd;
+                }
+                else
+                {
+                    Accepted &conn = accepted[owners[k].second];
+                    ssize_t res = ::recv(conn.fd, conn.hello + conn.received, handshake_size - conn.received, 0);
+                    if (res <= 0)
+                    {
+                        if (res < 0 && (errno == EAGAIN || errno == EINTR))
+                            continue;
+                        finished_accepts.push_back(owners[k].second);
+                        close(conn.fd);
+                        continue;
+                    }
+                    conn.received += res;
+                    if (conn.received < handshake_size)
+                        continue;
+
+                    int peer_id = -1;
+                    int stream = -1;
+                    bool expected = decode_handshake(conn.hello, num_parties, peer_id, stream) &&
+                                    std::find(expected_accepts.begin(), expected_accepts.end(), peer_id) != expected_accepts.end() &&
+                                    stream >= 0 && stream < streams;
+                    uint8_t ack[handshake_size];
+                    encode_handshake(ack, party_id, num_parties, stream);
+                    finished_accepts.push_back(owners[k].second);
+                    if (!expected || ::send(conn.fd, ack, handshake_size, MSG_NOSIGNAL) != (ssize_t)handshake_size)
+                    {
+                        std::cerr << "Party " << party_id << " rejected an unexpected connection" << std::endl;
+                        close(conn.fd);
+                        continue;
+                    }
+                    // 拨号方没有收到上一次的应答而重试时，之前记下的连接已被它放弃，换成新的
+                    auto previous = connected.find({peer_id, stream});
+                    if (previous != connected.end())
+                    {
+                        std::cerr << "Party " << party_id << " replaced connection " << stream << " from party " << peer_id
+                                  << " after the dialer retried" << std::endl;
+                        close(previous->second);
+                    }
+                    connected[{peer_id, stream}] = conn.fd;
+                }
+            }
+
+            std::sort(finished_accepts.rbegin(), finished_accepts.rend());
+            for (size_t index : finished_accepts)
+                accepted.erase(accepted.begin() + index);
+        }
+    }
+    catch (...)
+    {
+        cleanup();
+        for (auto &entry : connected)
+            close(entry.second);
+        throw;
+    }
+
+    cleanup();
+
+    std::map<int, std::vector<int>> links;
+    for (auto &entry : connected)
+    {
+        set_blocking(entry.second, true);
+        apply_network_profile(entry.second, profile);
+        links[entry.first.first].push_back(entry.second);
+    }
+    return links;
+}
+
+int64_t monotonic_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+size_t send_vectored(int fd, std::vector<iovec> segments, int flags)
+{
+    size_t calls = 0;
+    size_t first = 0;
+    while (first < segments.size())
+    {
+        msghdr msg{};
+        msg.msg_iov = segments.data() + first;
+        msg.msg_iovlen = std::min<size_t>(segments.size() - first, IOV_MAX);
+        ssize_t res = ::sendmsg(fd, &msg, flags | MSG_NOSIGNAL);
+        if (res < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            throw std::runtime_error(std::string("send failed: ") + std::strerror(errno));
+        }
+        calls++;
+
+        // 跳过已经写完的分段，调整写了一半的分段
+        size_t done = res;
+        while (first < segments.size() && done >= segments[first].iov_len)
+            done -= segments[first++].iov_len;
+        if (done > 0)
+        {
+            segments[first].iov_base = static_cast<uint8_t *>(segments[first].iov_base) + done;
+            segments[first].iov_len -= done;
+        }
+    }
+    return calls;
+}
+
+void recv_vectored(int fd, std::vector<iovec> segments)
+{
+    size_t first = 0;
+    while (first < segments.size())
+    {
+        msghdr msg{};
+        msg.msg_iov = segments.data() + first;
+        msg.msg_iovlen = std::min<size_t>(segments.size() - first, IOV_MAX);
+        ssize_t res = ::recvmsg(fd, &msg, MSG_WAITALL);
+        if (res < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            throw std::runtime_error(std::string("recv failed: ") + std::strerror(errno));
+        }
+        if (res == 0)
+        {
+            throw std::runtime_error("recv failed: connection closed by peer");
+        }
+
+        size_t done = res;
+        while (first < segments.size() && done >= segments[first].iov_len)
+            done -= segments[first++].iov_len;
+        if (done > 0)
+        {
+            segments[first].iov_base = static_cast<uint8_t *>(segments[first].iov_base) + done;
+            segments[first].iov_len -= done;
+        }
+    }
+}
+
+void recv_vectored_spin(int fd, std::vector<iovec> segments)
+{
+    size_t first = 0;
+    while (first < segments.size())
+    {
+        msghdr msg{};
+        msg.msg_iov = segments.data() + first;
+        msg.msg_iovlen = std::min<size_t>(segments.size() - first, IOV_MAX);
+        ssize_t res = ::recvmsg(fd, &msg, MSG_DONTWAIT);
+        if (res < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                cpu_relax();
+            else if (errno != EINTR)
+                throw std::runtime_error(std::string("recv failed: ") + std::strerror(errno));
+            continue;
+        }
+        if (res == 0)
+        {
+            throw std::runtime_error("recv failed: connection closed by peer");
+        }
+
+        size_t done = res;
+        while (first < segments.size() && done >= segments[first].iov_len)
+            done -= segments[first++].iov_len;
+        if (done > 0)
+        {
+            segments[first].iov_base = static_cast<uint8_t *>(segments[first].iov_base) + done;
+            segments[first].iov_len -= done;
+        }
+    }
+}
+
+size_t recv_vectored_until(int fd, std::vector<iovec> segments, int64_t deadline_ns)
+{
+    size_t received = 0;
+    size_t first = 0;
+    while (first < segments.size())
+    {
+        int64_t remaining = deadline_ns - monotonic_ns();
+        if (remaining <= 0)
+            return received;
+        timespec timeout{remaining / 1000000000, remaining % 1000000000};
+        pollfd pfd{fd, POLLIN, 0};
+        int ready = ::ppoll(&pfd, 1, &timeout, nullptr);
+        if (ready < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            throw std::runtime_error(std::string("poll failed: ") + std::strerror(errno));
+        }
+        if (ready == 0)
+            continue;
+
+        msghdr msg{};
+        msg.msg_iov = segments.data() + first;
+        msg.msg_iovlen = std::min<size_t>(segments.size() - first, IOV_MAX);
+        ssize_t res = ::recvmsg(fd, &msg, MSG_DONTWAIT);
+        if (res < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+                continue;
+            throw std::runtime_error(std::string("recv failed: ") + std::strerror(errno));
+        }
+        if (res == 0)
+        {
+            throw std::runtime_error("recv failed: connection closed by peer");
+        }
+
+        received += res;
+        size_t done = res;
+        while (first < segments.size() && done >= segments[first].iov_len)
+            done -= segments[first++].iov_len;
+        if (done > 0)
+        {
+            segments[first].iov_base = static_cast<uint8_t *>(segments[first].iov_base) + done;
+            segments[first].iov_len -= done;
+        }
+    }
+    return received;
+}
+
+void wait_readable(const std::vector<int> &fds)
+{
+    std::vector<pollfd> pfds;
+    for (int fd : fds)
+        pfds.push_back({fd, POLLIN, 0});
+    while (::poll(pfds.data(), pfds.size(), -1) < 0)
+    {
+        if (errno != EINTR)
+            throw std::runtime_error(std::string("poll failed: ") + std::strerror(errno));
+    }
+}
+
+void spin_readable(const std::vector<int> &fds)
+{
+    std::vector<pollfd> pfds;
+    for (int fd : fds)
+        pfds.push_back({fd, POLLIN, 0});
+    for (;;)
+    {
+        int ready = ::poll(pfds.data(), pfds.size(), 0);
+        if (ready > 0)
+            return;
+        if (ready < 0 && errno != EINTR)
+            throw std::runtime_error(std::string("poll failed: ") + std::strerror(errno));
+        cpu_relax();
+    }
+}
+
+void wait_transmitted(int fd)
+{
+    int pending = 0;
+    while (::ioctl(fd, SIOCOUTQNSD, &pending) == 0 && pending > 0)
+        std::this_thread::yield();
+}
+
+void send_segments(RawSocketIO *io, const std::vector<iovec> &segments) { io->send_segments(segments); }
+void recv_segments(RawSocketIO *io, const std::vector<iovec> &segments) { io->recv_segments(segments); }
+void send_segments_concurrent(RawSocketIO *io, const std::vector<iovec> &segments) { io->send_segments(segments); }
+void recv_segments_concurrent(RawSocketIO *io, const std::vector<iovec> &segments) { io->recv_segments(segments); }
+
+void wait_readable(const std::vector<RawSocketIO *> &link)
+{
+    std::vector<int> fds;
+    for (auto io : link)
+        fds.push_back(io->consocket);
+    if (link[0]->spin_recv)
+        spin_readable(fds);
+    else
+        wait_readable(fds);
+}
+
+std::vector<std::vector<iovec>> split_segments(const std::vector<iovec> &segments, size_t parts)
+{
+    size_t total = 0;
+    for (const auto &segment : segments)
+        total += segment.iov_len;
+
+    std::vector<std::vector<iovec>> result(parts);
+    size_t share = (total + parts - 1) / parts;
+    size_t part = 0;
+    size_t room = share;
+    for (const auto &segment : segments)
+    {
+        uint8_t *base = static_cast<uint8_t *>(segment.iov_base);
+        size_t len = segment.iov_len;
+        while (len > 0)
+        {
+            if (room == 0)
+            {
+                part++;
+                room = share;
+            }
+            size_t take = std::min(len, room);
+            result[part].push_back({base, take});
+            base += take;
+            len -= take;
+            room -= take;
+        }
+    }
+    return result;
+}
+
+#ifdef HAVE_IO_URING
+
+void register_buffer(UringIO *io, void *base, size_t len) { io->ring->register_buffer(base, len); }
+
+void send_striped(const std::vector<UringIO *> &link, const std::vector<iovec> &segments)
+{
+    auto parts = split_segments(segments, link.size());
+    std::vector<IoUring::Transfer> transfers;
+    for (size_t k = 0; k < link.size(); k++)
+        transfers.push_back({link[k]->consocket, true, parts[k]});
+    link[0]->ring->transfer(std::move(transfers));
+}
+
+void recv_striped(const std::vector<UringIO *> &link, const std::vector<iovec> &segments)
+{
+    auto parts = split_segments(segments, link.size());
+    std::vector<IoUring::Transfer> transfers;
+    for (size_t k = 0; k < link.size(); k++)
+        transfers.push_back({link[k]->consocket, false, parts[k]});
+    link[0]->ring->transfer(std::move(transfers));
+}
+
+void exchange_striped(const std::vector<UringIO *> &send_link, const std::vector<iovec> &send,
+                      const std::vector<UringIO *> &recv_link, const std::vector<iovec> &recv,
+                      int64_t &send_end_ns, int64_t &recv_end_ns)
+{
+    // 本步不发送或不接收时对应的链路为空
+    std::vector<IoUring::Transfer> transfers;
+    if (!send_link.empty())
+    {
+        auto send_parts = split_segments(send, send_link.size());
+        for (size_t k = 0; k < send_link.size(); k++)
+            transfers.push_back({send_link[k]->consocket, true, send_parts[k], &send_end_ns});
+    }
+    if (!recv_link.empty())
+    {
+        auto recv_parts = split_segments(recv, recv_link.size());
+        for (size_t k = 0; k < recv_link.size(); k++)
+            transfers.push_back({recv_link[k]->consocket, false, recv_parts[k], &recv_end_ns});
+    }
+    if (transfers.empty())
+        return;
+    (send_link.empty() ? recv_link : send_link)[0]->ring->transfer(std::move(transfers));
+}
+
+#endif
+
+int nic_numa_node(const std::string &ip)
+{
+    in_addr target{};
+    if (inet_pton(AF_INET, ip.c_str(), &target) != 1)
+        return -1;
+
+    ifaddrs *interfaces = nullptr;
+    if (getifaddrs(&interfaces) != 0)
+        return -1;
+    std::string name;
+    for (ifaddrs *entry = interfaces; entry; entry = entry->ifa_next)
+    {
+        if (entry->ifa_addr && entry->ifa_addr->sa_family == AF_INET &&
+            reinterpret_cast<sockaddr_in *>(entry->ifa_addr)->sin_addr.s_addr == target.s_addr)
+        {
+            name = entry->ifa_name;
+            break;
+        }
+    }
+    freeifaddrs(interfaces);
+    if (name.empty())
+        return -1;
+
+    std::ifstream file("/sys/class/net/" + name + "/device/numa_node");
+    int node = -1;
+    if (!(file >> node))
+        return -1;
+    return node;
+}
+
+#ifdef HAVE_MSQUIC
+
+const char quic_alpn[] = "ssle";
+
+std::vector<uint8_t> read_binary_file(const std::string &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+// 票据与票据密钥只应本用户可读
+bool write_binary_file(const std::string &path, const uint8_t *data, size_t len)
+{
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0)
+        return false;
+    bool ok = ::write(fd, data, len) == (ssize_t)len;
+    close(fd);
+    return ok;
+}
+
+QuicContext::QuicContext(const NetworkProfile &profile, const QuicSettings &settings, int party_id, bool accepts)
+    : settings(settings)
+{
+    if (QUIC_FAILED(MsQuicOpen2(&api)))
+        throw std::runtime_error("MsQuicOpen2 failed");
+
+    try
+    {
+        QUIC_REGISTRATION_CONFIG registration_config = {"share_benchmark", QUIC_EXECUTION_PROFILE_TYPE_MAX_THROUGHPUT};
+        if (QUIC_FAILED(api->RegistrationOpen(&registration_config, &registration)))
+            throw std::runtime_error("QUIC RegistrationOpen failed");
+
+        // msquic 要求流接收窗口是 2 的幂
+        recv_window = 64 * 1024;
+        while (recv_window < profile.socket_buffer_bytes() && recv_window < (size_t(1) << 30))
+            recv_window <<= 1;
+        bbr = profile.congestion == "bbr";
+
+        QUIC_SETTINGS quic_settings{};
+        quic_settings.StreamRecvWindowDefault = (uint32_t)recv_window;
+        quic_settings.IsSet.StreamRecvWindowDefault = 1;
+        quic_settings.ConnFlowControlWindow = (uint32_t)(recv_window * 2);
+        quic_settings.IsSet.ConnFlowControlWindow = 1;
+        // 每次发送一条流，流水线模式下同时在途的流较多
+        quic_settings.PeerUnidiStreamCount = 1024;
+        quic_settings.IsSet.PeerUnidiStreamCount = 1;
+        quic_settings.CongestionControlAlgorithm =
+            bbr ? QUIC_CONGESTION_CONTROL_ALGORITHM_BBR : QUIC_CONGESTION_CONTROL_ALGORITHM_CUBIC;
+        quic_settings.IsSet.CongestionControlAlgorithm = 1;
+        // 轮次之间的校验、写CSV可能超过空闲超时
+        quic_settings.KeepAliveIntervalMs = 5000;
+        quic_settings.IsSet.KeepAliveIntervalMs = 1;
+        if (!settings.ticket_dir.empty())
+        {
+            quic_settings.ServerResumptionLevel = QUIC_SERVER_RESUME_AND_ZERORTT;
+            quic_settings.IsSet.ServerResumptionLevel = 1;
+        }
+
+        QUIC_BUFFER alpn = {(uint32_t)(sizeof(quic_alpn) - 1), (uint8_t *)quic_alpn};
+
+        // 拨号方不校验证书：与 TCP 传输一样只用于测试网络，不提供身份认证
+        if (QUIC_FAILED(api->ConfigurationOpen(registration, &alpn, 1, &quic_settings, sizeof(quic_settings), nullptr,
+                                               &client_configuration)))
+            throw std::runtime_error("QUIC ConfigurationOpen failed");
+        QUIC_CREDENTIAL_CONFIG client_credential{};
+        client_credential.Type = QUIC_CREDENTIAL_TYPE_NONE;
+        client_credential.Flags = QUIC_CREDENTIAL_FLAG_CLIENT | QUIC_CREDENTIAL_FLAG_NO_CERTIFICATE_VALIDATION;
+        if (QUIC_FAILED(api->ConfigurationLoadCredential(client_configuration, &client_credential)))
+            throw std::runtime_error("QUIC client credential setup failed");
+
+        if (accepts)
+        {
+            if (settings.cert_file.empty() || settings.key_file.empty())
+                throw std::invalid_argument("transport=quic needs quic_cert and quic_key on parties that accept connections");
+            if (QUIC_FAILED(api->ConfigurationOpen(registration, &alpn, 1, &quic_settings, sizeof(quic_settings), nullptr,
+                                                   &server_configuration)))
+                throw std::runtime_error("QUIC ConfigurationOpen failed");
+            QUIC_CERTIFICATE_FILE certificate = {settings.key_file.c_str(), settings.cert_file.c_str()};
+            QUIC_CREDENTIAL_CONFIG server_credential{};
+            server_credential.Type = QUIC_CREDENTIAL_TYPE_CERTIFICATE_FILE;
+            server_credential.Flags = QUIC_CREDENTIAL_FLAG_NONE;
+            server_credential.CertificateFile = &certificate;
+            if (QUIC_FAILED(api->ConfigurationLoadCredential(server_configuration, &server_credential)))
+                throw std::runtime_error("Failed to load QUIC certificate " + settings.cert_file + " / " + settings.key_file);
+
+            // 票据用服务端的票据密钥加密。密钥默认每个进程随机生成，保存到文件后下一次运行签发的票据仍然有效
+            if (!settings.ticket_dir.empty())
+            {
+                std::string key_file = settings.ticket_dir + "/quic_ticket_key_id" + std::to_string(party_id) + ".bin";
+                QUIC_TICKET_KEY_CONFIG key{};
+                std::vector<uint8_t> stored = read_binary_file(key_file);
+                if (stored.size() == sizeof(key.Id) + sizeof(key.Material))
+                {
+                    std::memcpy(key.Id, stored.data(), sizeof(key.Id));
+                    std::memcpy(key.Material, stored.data() + sizeof(key.Id), sizeof(key.Material));
+                }
+                else
+                {
+                    std::random_device random;
+                    stored.resize(sizeof(key.Id) + sizeof(key.Material));
+                    for (auto &byte : stored)
+                        byte = (uint8_t)random();
+                    std::memcpy(key.Id, stored.data(), sizeof(key.Id));
+                    std::memcpy(key.Material, stored.data() + sizeof(key.Id), sizeof(key.Material));
+                    if (!write_binary_file(key_file, stored.data(), stored.size()))
+                        std::cerr << "Failed to save QUIC ticket key " << key_file << ": " << std::strerror(errno) << std::endl;
+                }
+                key.MaterialLength = sizeof(key.Material);
+                if (QUIC_FAILED(api->SetParam(server_configuration, QUIC_PARAM_CONFIGURATION_TICKET_KEYS, sizeof(key), &key)))
+                    std::cerr << "QUIC ticket keys not accepted, sessions resume only within one run" << std::endl;
+            }
+        }
+    }
+    catch (...)
+    {
+        if (server_configuration)
+            api->ConfigurationClose(server_configuration);
+        if (client_configuration)
+            api->ConfigurationClose(client_configuration);
+        if (registration)
+            api->RegistrationClose(registration);
+        MsQuicClose(api);
+        throw;
+    }
+}
+
+QuicContext::~QuicContext()
+{
+    stop_listening();
+    if (server_configuration)
+        api->ConfigurationClose(server_configuration);
+    api->ConfigurationClose(client_configuration);
+    api->RegistrationClose(registration);
+    MsQuicClose(api);
+}
+
+void QuicContext::listen(int port)
+{
+    if (QUIC_FAILED(api->ListenerOpen(registration, listener_callback, this, &listener)))
+        throw std::runtime_error("QUIC ListenerOpen failed");
+    QUIC_BUFFER alpn = {(uint32_t)(sizeof(quic_alpn) - 1), (uint8_t *)quic_alpn};
+    QUIC_ADDR address{};
+    QuicAddrSetFamily(&address, QUIC_ADDRESS_FAMILY_UNSPEC);
+    QuicAddrSetPort(&address, (uint16_t)port);
+    if (QUIC_FAILED(api->ListenerStart(listener, &alpn, 1, &address)))
+        throw std::runtime_error("QUIC listen on UDP port " + std::to_string(port) + " failed");
+}
+
+std::vector<std::unique_ptr<QuicIO>> QuicContext::take_accepted()
+{
+    std::lock_guard<std::mutex> lock(accepted_mutex);
+    return std::move(accepted);
+}
+
+void QuicContext::stop_listening()
+{
+    // ListenerClose 返回后不会再有新的连接回调
+    if (listener)
+        api->ListenerClose(listener);
+    listener = nullptr;
+    take_accepted();
+}
+
+QUIC_STATUS QUIC_API QuicContext::listener_callback(HQUIC, void *context, QUIC_LISTENER_EVENT *event)
+{
+    auto *self = static_cast<QuicContext *>(context);
+    if (event->Type != QUIC_LISTENER_EVENT_NEW_CONNECTION)
+        return QUIC_STATUS_SUCCESS;
+
+    HQUIC connection = event->NEW_CONNECTION.Connection;
+    std::unique_ptr<QuicIO> io(new QuicIO(self->shared_from_this(), connection));
+    self->api->SetCallbackHandler(connection, (void *)QuicIO::connection_callback, io.get());
+    QUIC_STATUS status = self->api->ConnectionSetConfiguration(connection, self->server_configuration);
+    if (QUIC_FAILED(status))
+    {
+        // 返回失败时连接由 msquic 关闭
+        io->connection = nullptr;
+        return status;
+    }
+    std::lock_guard<std::mutex> lock(self->accepted_mutex);
+    self->accepted.push_back(std::move(io));
+    return QUIC_STATUS_SUCCESS;
+}
+
+QuicIO::QuicIO(std::shared_ptr<QuicContext> context, const std::string &host, int port, const std::string &ticket_file)
+    : context(std::move(context)), accepting(false), ticket_file(ticket_file)
+{
+    const QUIC_API_TABLE *api = this->context->api;
+    if (QUIC_FAILED(api->ConnectionOpen(this->context->registration, connection_callback, this, &connection)))
+        throw std::runtime_error("QUIC ConnectionOpen failed");
+
+    if (!ticket_file.empty())
+    {
+        std::vector<uint8_t> ticket = read_binary_file(ticket_file);
+        if (!ticket.empty() &&
+            QUIC_FAILED(api->SetParam(connection, QUIC_PARAM_CONN_RESUMPTION_TICKET, (uint32_t)ticket.size(), ticket.data())))
+            std::cerr << "Ignoring unusable QUIC resumption ticket " << ticket_file << std::endl;
+    }
+
+    if (QUIC_FAILED(api->ConnectionStart(connection, this->context->client_configuration, QUIC_ADDRESS_FAMILY_UNSPEC,
+                                         host.c_str(), (uint16_t)port)))
+    {
+        api->ConnectionClose(connection);
+        throw std::runtime_error("QUIC connect to " + host + ":" + std::to_string(port) + " failed");
+    }
+}
+
+// 关闭前等待对端确认所有发送流：QUIC 的连接关闭是立即的，尚未送达的数据会被丢弃
+QuicIO::~QuicIO()
+{
+    if (!connection)
+        return;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (connection_state == State::Connected)
+            cv.wait(lock, [&]
+                    { return open_send_streams == 0 || connection_state == State::Closed; });
+    }
+    context->api->ConnectionShutdown(connection, QUIC_CONNECTION_SHUTDOWN_FLAG_NONE, 0);
+    context->api->ConnectionClose(connection);
+}
+
+void QuicIO::start_send(const QUIC_BUFFER *buffers, uint32_t count, SendCompletion *completion)
+{
+    const QUIC_API_TABLE *api = context->api;
+    HQUIC stream = nullptr;
+    if (QUIC_FAILED(api->StreamOpen(connection, QUIC_STREAM_OPEN_FLAG_UNIDIRECTIONAL, send_stream_callback, this, &stream)))
+        throw std::runtime_error("QUIC StreamOpen failed");
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        open_send_streams++;
+    }
+    if (QUIC_FAILED(api->StreamStart(stream, QUIC_STREAM_START_FLAG_IMMEDIATE)))
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            open_send_streams--;
+        }
+        api->StreamClose(stream);
+        throw std::runtime_error("QUIC StreamStart failed");
+    }
+    // 有会话恢复票据时握手完成前的数据随 0-RTT 发出
+    if (QUIC_FAILED(api->StreamSend(stream, buffers, count, QUIC_SEND_FLAG_FIN | QUIC_SEND_FLAG_ALLOW_0_RTT, completion)))
+    {
+        api->StreamShutdown(stream, QUIC_STREAM_SHUTDOWN_FLAG_ABORT, 0);
+        throw std::runtime_error("QUIC StreamSend failed");
+    }
+}
+
+void QuicIO::send_segments(const std::vector<iovec> &segments)
+{
+    // QUIC_BUFFER 的长度只有 32 位
+    const size_t max_buffer = size_t(1) << 30;
+    std::vector<QUIC_BUFFER> buffers;
+    for (const auto &segment : segments)
+    {
+        uint8_t *base = static_cast<uint8_t *>(segment.iov_base);
+        for (size_t offset = 0; offset < segment.iov_len; offset += max_buffer)
+            buffers.push_back({(uint32_t)std::min(max_buffer, segment.iov_len - offset), base + offset});
+    }
+    // 空的发送不占用流，接收方同样不读取任何数据
+    if (buffers.empty())
+        return;
+
+    SendCompletion completion;
+    start_send(buffers.data(), (uint32_t)buffers.size(), &completion);
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&]
+            { return completion.done; });
+    if (completion.canceled)
+        throw std::runtime_error("QuicIO send failed: connection closed");
+}
+
+void QuicIO::send_message(std::vector<uint8_t> message)
+{
+    OwnedMessage *owned;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        messages.push_back({std::move(message), {}, {}});
+        owned = &messages.back();
+    }
+    owned->buffer = {(uint32_t)owned->data.size(), owned->data.data()};
+    start_send(&owned->buffer, 1, &owned->completion);
+}
+
+// 当前流可读的字节数；读完且已结束的流让位给下一条
+size_t QuicIO::readable_locked()
+{
+    for (;;)
+    {
+        auto it = recv_streams.find(next_recv);
+        if (it == recv_streams.end())
+            return 0;
+        if (it->second.available > 0)
+            return it->second.available;
+        if (!it->second.fin)
+            return 0;
+        recv_streams.erase(it);
+        next_recv++;
+    }
+}
+
+void QuicIO::consume_locked(uint8_t *data, size_t len)
+{
+    RecvStream &stream = recv_streams[next_recv];
+    stream.available -= len;
+    while (len > 0)
+    {
+        std::vector<uint8_t> &chunk = stream.chunks.front();
+        size_t take = std::min(len, chunk.size() - stream.head_offset);
+        std::memcpy(data, chunk.data() + stream.head_offset, take);
+        data += take;
+        len -= take;
+        stream.head_offset += take;
+        if (stream.head_offset == chunk.size())
+        {
+            stream.chunks.pop_front();
+            stream.head_offset = 0;
+        }
+    }
+}
+
+void QuicIO::recv_segments(const std::vector<iovec> &segments)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    for (const auto &segment : segments)
+    {
+        uint8_t *data = static_cast<uint8_t *>(segment.iov_base);
+        size_t remaining = segment.iov_len;
+        while (remaining > 0)
+        {
+            cv.wait(lock, [&]
+                    { return readable_locked() > 0 || connection_state == State::Closed; });
+            size_t take = std::min(remaining, readable_locked());
+            if (take == 0)
+                throw std::runtime_error("QuicIO recv failed: connection closed by peer");
+            consume_locked(data, take);
+            data += take;
+            remaining -= take;
+        }
+    }
+}
+
+bool QuicIO::try_recv(void *data, size_t len)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (readable_locked() < len)
+        return false;
+    consume_locked(static_cast<uint8_t *>(data), len);
+    return true;
+}
+
+QuicIO::State QuicIO::state()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return connection_state;
+}
+
+void QuicIO::wait_readable()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&]
+            { return readable_locked() > 0 || connection_state == State::Closed; });
+}
+
+void QuicIO::abort()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        connection_state = State::Closed;
+    }
+    cv.notify_all();
+    context->api->ConnectionShutdown(connection, QUIC_CONNECTION_SHUTDOWN_FLAG_NONE, 1);
+}
+
+// 按 TCP_INFO 的含义填写：拥塞窗口换算成路径 MTU 大小的包数，重传取判定丢失的包数
+TcpInfo QuicIO::statistics() const
+{
+    TcpInfo info{};
+    QUIC_STATISTICS_V2 stats{};
+    uint32_t len = sizeof(stats);
+    if (QUIC_FAILED(context->api->GetParam(connection, QUIC_PARAM_CONN_STATISTICS_V2, &len, &stats)))
+        return info;
+    info.base.tcpi_rtt = stats.Rtt;
+    info.base.tcpi_snd_mss = stats.SendPathMtu;
+    info.base.tcpi_snd_cwnd = stats.SendPathMtu ? stats.SendCongestionWindow / stats.SendPathMtu : stats.SendCongestionWindow;
+    info.base.tcpi_total_retrans = (uint32_t)stats.SendSuspectedLostPackets;
+    info.min_rtt = stats.MinRtt;
+    info.bytes_acked = stats.SendTotalStreamBytes;
+    info.bytes_received = stats.RecvTotalStreamBytes;
+    return info;
+}
+
+QUIC_STATUS QUIC_API QuicIO::connection_callback(HQUIC connection, void *context, QUIC_CONNECTION_EVENT *event)
+{
+    auto *io = static_cast<QuicIO *>(context);
+    const QUIC_API_TABLE *api = io->context->api;
+    switch (event->Type)
+    {
+    case QUIC_CONNECTION_EVENT_CONNECTED:
+    {
+        {
+            std::lock_guard<std::mutex> lock(io->mutex);
+            io->session_resumed = event->CONNECTED.SessionResumed;
+            if (io->connection_state == State::Handshaking)
+                io->connection_state = State::Connected;
+        }
+        io->cv.notify_all();
+        // 服务端在握手完成后下发票据，拨号方下一次运行时用它恢复会话
+        if (io->accepting && !io->context->settings.ticket_dir.empty())
+            api->ConnectionSendResumptionTicket(connection, QUIC_SEND_RESUMPTION_FLAG_NONE, 0, nullptr);
+        break;
+    }
+    case QUIC_CONNECTION_EVENT_RESUMPTION_TICKET_RECEIVED:
+        if (!io->ticket_file.empty() &&
+            !write_binary_file(io->ticket_file, event->RESUMPTION_TICKET_RECEIVED.ResumptionTicket,
+                               event->RESUMPTION_TICKET_RECEIVED.ResumptionTicketLength))
+            std::cerr << "Failed to save QUIC resumption ticket " << io->ticket_file << std::endl;
+        break;
+    case QUIC_CONNECTION_EVENT_PEER_STREAM_STARTED:
+    {
+        HQUIC stream = event->PEER_STREAM_STARTED.Stream;
+        uint64_t id = 0;
+        uint32_t len = sizeof(id);
+        api->GetParam(stream, QUIC_PARAM_STREAM_ID, &len, &id);
+        api->SetCallbackHandler(stream, (void *)recv_stream_callback, io);
+        // 流编号的低两位是发起方与方向，同一方向的流按打开顺序编号
+        std::lock_guard<std::mutex> lock(io->mutex);
+        io->stream_index[stream] = id >> 2;
+        io->recv_streams[id >> 2];
+        break;
+    }
+    case QUIC_CONNECTION_EVENT_SHUTDOWN_COMPLETE:
+    {
+        {
+            std::lock_guard<std::mutex> lock(io->mutex);
+            io->connection_state = State::Closed;
+        }
+        io->cv.notify_all();
+        break;
+    }
+    default:
+        break;
+    }
+    return QUIC_STATUS_SUCCESS;
+}
+
+QUIC_STATUS QUIC_API QuicIO::send_stream_callback(HQUIC stream, void *context, QUIC_STREAM_EVENT *event)
+{
+    auto *io = static_cast<QuicIO *>(context);
+    switch (event->Type)
+    {
+    case QUIC_STREAM_EVENT_SEND_COMPLETE:
+    {
+        {
+            std::lock_guard<std::mutex> lock(io->mutex);
+            auto *completion = static_cast<SendCompletion *>(event->SEND_COMPLETE.ClientContext);
+            completion->canceled = event->SEND_COMPLETE.Canceled;
+            completion->done = true;
+        }
+        io->cv.notify_all();
+        break;
+    }
+    case QUIC_STREAM_EVENT_SHUTDOWN_COMPLETE:
+    {
+        {
+            std::lock_guard<std::mutex> lock(io->mutex);
+            io->open_send_streams--;
+        }
+        io->cv.notify_all();
+        io->context->api->StreamClose(stream);
+        break;
+    }
+    default:
+        break;
+    }
+    return QUIC_STATUS_SUCCESS;
+}
+
+// 收到的数据在回调中全部拷贝走，msquic 随即归还流控窗口
+QUIC_STATUS QUIC_API QuicIO::recv_stream_callback(HQUIC stream, void *context, QUIC_STREAM_EVENT *event)
+{
+    auto *io = static_cast<QuicIO *>(context);
+    switch (event->Type)
+    {
+    case QUIC_STREAM_EVENT_RECEIVE:
+    case QUIC_STREAM_EVENT_PEER_SEND_SHUTDOWN:
+    {
+        {
+            std::lock_guard<std::mutex> lock(io->mutex);
+            uint64_t index = io->stream_index[stream];
+            // 已读完删除的流不再重建
+            if (index < io->next_recv)
+                break;
+            RecvStream &entry = io->recv_streams[index];
+            if (event->Type == QUIC_STREAM_EVENT_PEER_SEND_SHUTDOWN)
+            {
+                entry.fin = true;
+            }
+            else
+            {
+                for (uint32_t i = 0; i < event->RECEIVE.BufferCount; i++)
+                {
+                    const QUIC_BUFFER &buffer = event->RECEIVE.Buffers[i];
+                    if (buffer.Length == 0)
+                        continue;
+                    entry.chunks.emplace_back(buffer.Buffer, buffer.Buffer + buffer.Length);
+                    entry.available += buffer.Length;
+                }
+                if (event->RECEIVE.Flags & QUIC_RECEIVE_FLAG_FIN)
+                    entry.fin = true;
+            }
+        }
+        io->cv.notify_all();
+        break;
+    }
+    case QUIC_STREAM_EVENT_PEER_SEND_ABORTED:
+    {
+        // 对端放弃了一条流，字节序列从此不完整
+        {
+            std::lock_guard<std::mutex> lock(io->mutex);
+            io->connection_state = State::Closed;
+        }
+        io->cv.notify_all();
+        break;
+    }
+    case QUIC_STREAM_EVENT_SHUTDOWN_COMPLETE:
+    {
+        {
+            std::lock_guard<std::mutex> lock(io->mutex);
+            io->stream_index.erase(stream);
+        }
+        io->context->api->StreamClose(stream);
+        break;
+    }
+    default:
+        break;
+    }
+    return QUIC_STATUS_SUCCESS;
+}
+
+std::map<int, std::vector<QuicIO *>> connect_quic_mesh(const std::shared_ptr<QuicContext> &context, int party_id,
+                                                      int num_parties, const std::vector<std::string> &ips,
+                                                      int base_port, const std::vector<int> &peers, int streams,
+                                                      int timeout_ms)
+{
+    using clock = std::chrono::steady_clock;
+    const auto deadline = clock::now() + std::chrono::milliseconds(timeout_ms);
+    const int initial_backoff_ms = 10;
+    const int max_backoff_ms = 250;
+
+    for (int peer_id : peers)
+    {
+        if (base_port + peer_id > 65535 || base_port + party_id > 65535)
+            throw std::invalid_argument("Port out of range: base_port + party_id must not exceed 65535");
+    }
+
+    struct Dial
+    {
+        int peer_id;
+        int stream;
+        std::unique_ptr<QuicIO> io;
+        clock::time_point next_attempt;
+        int backoff_ms;
+        bool done = false;
+    };
+
+    std::map<int, std::vector<std::unique_ptr<QuicIO>>> links;
+    std::vector<Dial> dials;
+    size_t expected_accepts = 0;
+    for (int peer_id : peers)
+    {
+        links[peer_id].resize(streams);
+        for (int k = 0; k < streams; k++)
+        {
+            if (peer_id < party_id)
+                dials.push_back({peer_id, k, nullptr, clock::now(), initial_backoff_ms});
+            else
+                expected_accepts++;
+        }
+    }
+    if (expected_accepts > 0)
+        context->listen(base_port + party_id);
+
+    std::vector<std::unique_ptr<QuicIO>> handshaking; // 已接入、尚未收到身份握手的连接
+    size_t dialed = 0;
+    size_t accepted = 0;
+    try
+    {
+        while (dialed < dials.size() || accepted < expected_accepts)
+        {
+            if (clock::now() > deadline)
+                throw std::runtime_error("Timed out waiting for QUIC connections: " + std::to_string(dialed) + "/" +
+                                         std::to_string(dials.size()) + " dialed, " + std::to_string(accepted) + "/" +
+                                         std::to_string(expected_accepts) + " accepted");
+
+            for (auto &dial : dials)
+            {
+                if (dial.done)
+                    continue;
+                if (!dial.io)
+                {
+                    if (clock::now() < dial.next_attempt)
+                        continue;
+                    std::string ticket_file;
+                    if (!context->settings.ticket_dir.empty())
+                        ticket_file = context->settings.ticket_dir + "/quic_ticket_p" + std::to_string(num_parties) + "_id" +
+                                      std::to_string(party_id) + "_to" + std::to_string(dial.peer_id) + "_" +
+                                      std::to_string(dial.stream) + ".bin";
+                    dial.io.reset(new QuicIO(context, ips[dial.peer_id], base_port + dial.peer_id, ticket_file));
+                    std::vector<uint8_t> hello(handshake_size);
+                    encode_handshake(hello.data(), party_id, num_parties, dial.stream);
+                    dial.io->send_message(std::move(hello));
+                    continue;
+                }
+                switch (dial.io->state())
+                {
+                case QuicIO::State::Connected:
+                    links[dial.peer_id][dial.stream] = std::move(dial.io);
+                    dial.done = true;
+                    dialed++;
+                    break;
+                case QuicIO::State::Closed:
+                    // 对端尚未监听，稍后重拨
+                    dial.io.reset();
+                    dial.next_attempt = clock::now() + std::chrono::milliseconds(dial.backoff_ms);
+                    dial.backoff_ms = std::min(dial.backoff_ms * 2, max_backoff_ms);
+                    break;
+                case QuicIO::State::Handshaking:
+                    break;
+                }
+            }
+
+            for (auto &io : context->take_accepted())
+                handshaking.push_back(std::move(io));
+            for (auto it = handshaking.begin(); it != handshaking.end();)
+            {
+                uint8_t hello[handshake_size];
+                if ((*it)->state() == QuicIO::State::Closed)
+                {
+                    it = handshaking.erase(it);
+                    continue;
+                }
+                if (!(*it)->try_recv(hello, handshake_size))
+                {
+                    ++it;
+                    continue;
+                }
+                int peer_id, stream;
+                if (!decode_handshake(hello, num_parties, peer_id, stream) || peer_id <= party_id || !links.count(peer_id) ||
+                    stream < 0 || stream >= streams)
+                {
+                    std::cerr << "Rejecting QUIC connection with an invalid handshake" << std::endl;
+                    it = handshaking.erase(it);
+                    continue;
+                }
+                // 对端重拨时新连接替换旧的
+                if (!links[peer_id][stream])
+                    accepted++;
+                links[peer_id][stream] = std::move(*it);
+                it = handshaking.erase(it);
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    catch (...)
+    {
+        // 监听器持有的连接引用着 context，不停止监听就无法释放
+        context->stop_listening();
+        throw;
+    }
+    context->stop_listening();
+
+    std::map<int, std::vector<QuicIO *>> result;
+    size_t resumed = 0;
+    size_t total = 0;
+    for (auto &entry : links)
+    {
+        for (auto &io : entry.second)
+        {
+            resumed += io->resumed();
+            total++;
+            result[entry.first].push_back(io.release());
+        }
+    }
+    if (!context->settings.ticket_dir.empty())
+        std::cout << "QUIC sessions resumed: " << resumed << "/" << total << std::endl;
+    return result;
+}
+
+void send_segments(QuicIO *io, const std::vector<iovec> &segments) { io->send_segments(segments); }
+void recv_segments(QuicIO *io, const std::vector<iovec> &segments) { io->recv_segments(segments); }
+void send_segments_concurrent(QuicIO *io, const std::vector<iovec> &segments) { io->send_segments(segments); }
+void recv_segments_concurrent(QuicIO *io, const std::vector<iovec> &segments) { io->recv_segments(segments); }
+
+// 条带的各份同时发出，以第 0 条连接为准
+void wait_readable(const std::vector<QuicIO *> &link) { link[0]->wait_readable(); }
+
+// msquic 看不到数据何时离开本机，发送在 msquic 接管数据（拷贝进发送缓冲）后即返回，不再单独等待
+void wait_transmitted(const std::vector<QuicIO *> &) {}
+
+void shutdown_io(QuicIO *io) { io->abort(); }
+
+TcpInfo read_tcp_info(QuicIO *io) { return io->statistics(); }
+
+// 把换算后的 msquic 设置按 socket 选项的列写出：缓冲区列为流接收窗口
+SocketSettings read_socket_settings(QuicIO *io)
+{
+    SocketSettings settings;
+    settings.sndbuf = (int)io->quic_context().recv_window;
+    settings.rcvbuf = settings.sndbuf;
+    settings.nodelay = 1;
+    settings.congestion = io->quic_context().bbr ? "bbr" : "cubic";
+    return settings;
+}
+
+// msquic 的窗口与拥塞控制在建连时由 QuicContext 设定，之后无法更改
+void apply_network_profile(QuicIO *, const NetworkProfile &) {}
+
+#endif
+
+// 自旋等待的次数：参与方线程不超过 CPU 数时先自旋，数据通常在这段时间内到达，省去一次睡眠与唤醒
+constexpr int kShmSpins = 2000;
+
+// 下一个包的可见时间不到这么久时自旋等待，否则睡眠到可见时间
+constexpr int64_t kShmSleepNs = 20000;
+
+static void futex_wait(std::atomic<uint32_t> &word, uint32_t expected)
+{
+    ::syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+}
+
+static void futex_wake(std::atomic<uint32_t> &word)
+{
+    ::syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+}
+
+static void sleep_until_ns(int64_t deadline_ns)
+{
+    timespec deadline{deadline_ns / 1000000000, deadline_ns % 1000000000};
+    while (::clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR)
+    {
+    }
+}
+
+ShmRing::ShmRing(size_t capacity, Egress *egress, double bytes_per_ns, int64_t delay_ns, bool spin)
+    : size(kShmPacket), egress(egress), bytes_per_ns(bytes_per_ns), delay_ns(delay_ns), spin(spin)
+{
+    while (size < capacity)
+        size *= 2;
+    // 不预先缺页：没有用到的链路不占内存
+    void *memory = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (memory == MAP_FAILED)
+        throw std::runtime_error(std::string("mmap failed for a shared-memory ring: ") + std::strerror(errno));
+    buffer = static_cast<uint8_t *>(memory);
+}
+
+ShmRing::~ShmRing()
+{
+    ::munmap(buffer, size);
+}
+
+// 先自旋，仍未满足时登记等待并在 seq 上睡眠。对端先更新状态、再递增 seq 并检查 waiting，
+// 本方先登记 waiting、再检查状态，两者都是顺序一致的原子操作，唤醒不会丢失
+template <typename Ready>
+void ShmRing::wait(std::atomic<uint32_t> &seq, std::atomic<bool> &waiting, Ready ready)
+{
+    for (int i = 0; spin && i < kShmSpins; i++)
+    {
+        if (ready() || closed)
+            return;
+        cpu_relax();
+    }
+    while (!ready() && !closed)
+    {
+        uint32_t observed = seq.load();
+        waiting.store(true);
+        if (ready() || closed)
+            return;
+        futex_wait(seq, observed);
+    }
+}
+
+void ShmRing::notify(std::atomic<uint32_t> &seq, std::atomic<bool> &waiting)
+{
+    seq.fetch_add(1);
+    if (waiting.exchange(false))
+        futex_wake(seq);
+}
+
+void ShmRing::write(const void *data, size_t len)
+{
+    const uint8_t *source = static_cast<const uint8_t *>(data);
+    while (len > 0)
+    {
+        size_t n = std::min(len, kShmPacket);
+        wait(space_seq, producer_waiting, [&]()
+             { return size - (head - tail.load()) >= n && marker_head.load(std::memory_order_relaxed) - marker_tail.load() < kMarkers; });
+        if (closed)
+            throw std::runtime_error("send failed: shared-memory link closed");
+
+        size_t offset = head & (size - 1);
+        size_t first = std::min(n, size - offset);
+        std::memcpy(buffer + offset, source, first);
+        std::memcpy(buffer, source + first, n - first);
+        head += n;
+
+        // 出口队列被同一参与方的多条环共用（全双工、流水线模式下由多个线程同时发送）
+        int64_t visible_ns = 0;
+        if (egress)
+        {
+            int64_t now = monotonic_ns();
+            int64_t transfer_ns = (int64_t)(n / bytes_per_ns);
+            int64_t free_ns = egress->free_ns.load();
+            int64_t departure;
+            do
+            {
+                departure = std::max(now, free_ns) + transfer_ns;
+            } while (!egress->free_ns.compare_exchange_weak(free_ns, departure));
+            last_departure_ns = departure;
+            visible_ns = departure + delay_ns;
+        }
+        uint64_t index = marker_head.load(std::memory_order_relaxed);
+        markers[index % kMarkers] = {head, visible_ns};
+        marker_head.store(index + 1);
+        notify(data_seq, consumer_waiting);
+
+        source += n;
+        len -= n;
+    }
+}
+
+int64_t ShmRing::advance_markers()
+{
+    uint64_t index = marker_tail.load(std::memory_order_relaxed);
+    uint64_t published = marker_head.load();
+    uint64_t first = index;
+    int64_t next_ns = -1;
+    int64_t now = 0;
+    for (; index < published; index++)
+    {
+        const Marker &marker = markers[index % kMarkers];
+        if (marker.visible_ns > 0)
+        {
+            if (now == 0)
+                now = monotonic_ns();
+            if (marker.visible_ns > now)
+            {
+                next_ns = marker.visible_ns;
+                break;
+            }
+        }
+        visible_end = marker.end;
+    }
+    if (index != first)
+    {
+        marker_tail.store(index);
+        notify(space_seq, producer_waiting);
+    }
+    return next_ns;
+}
+
+void ShmRing::wait_readable()
+{
+    while (!closed)
+    {
+        int64_t next_ns = advance_markers();
+        if (visible_end > tail.load(std::memory_order_relaxed))
+            return;
+        if (next_ns < 0)
+        {
+            wait(data_seq, consumer_waiting, [&]()
+                 { return marker_tail.load(std::memory_order_relaxed) < marker_head.load(); });
+        }
+        else if (!spin || next_ns - monotonic_ns() > kShmSleepNs)
+        {
+            sleep_until_ns(next_ns);
+        }
+        else
+        {
+            cpu_relax();
+        }
+    }
+}
+
+void ShmRing::read(void *data, size_t len)
+{
+    uint8_t *target = static_cast<uint8_t *>(data);
+    while (len > 0)
+    {
+        uint64_t position = tail.load(std::memory_order_relaxed);
+        if (visible_end == position)
+        {
+            wait_readable();
+            if (closed)
+                throw std::runtime_error("recv failed: shared-memory link closed");
+            continue;
+        }
+
+        size_t n = std::min<uint64_t>(len, visible_end - position);
+        size_t offset = position & (size - 1);
+        size_t first = std::min(n, size - offset);
+        std::memcpy(target, buffer + offset, first);
+        std::memcpy(target + first, buffer, n - first);
+        tail.store(position + n);
+        notify(space_seq, producer_waiting);
+
+        target += n;
+        len -= n;
+    }
+}
+
+void ShmRing::wait_departed()
+{
+    int64_t departure = last_departure_ns;
+    if (monotonic_ns() >= departure)
+        return;
+    if (spin && departure - monotonic_ns() <= kShmSleepNs)
+    {
+        while (monotonic_ns() < departure)
+            cpu_relax();
+        return;
+    }
+    sleep_until_ns(departure);
+}
+
+void ShmRing::close()
+{
+    closed = true;
+    for (auto *seq : {&data_seq, &space_seq})
+    {
+        seq->fetch_add(1);
+        futex_wake(*seq);
+    }
+}
+
+ShmFabric::ShmFabric(int num_parties, const NetworkProfile &profile, size_t ring_bytes, bool link_model)
+    : num_parties(num_parties), ring_bytes(ring_bytes), link_model(link_model),
+      egress(new ShmRing::Egress[num_parties])
+{
+    // 线程比 CPU 多时自旋只会占住别的参与方要用的 CPU
+    spin = (size_t)num_parties <= allowed_cpus().size();
+    bytes_per_ns = profile.bandwidth_mbps * 1e6 / 8 / 1e9;
+    delay_ns = (int64_t)(profile.rtt_ms / 2 * 1e6);
+    // 与 TCP 相同，在途的数据受缓冲区限制：模拟链路时环不小于 socket 缓冲区（默认 2 倍带宽时延积）
+    if (link_model)
+        this->ring_bytes = std::max(ring_bytes, profile.socket_buffer_bytes());
+    size_t rounded = ShmRing::kShmPacket;
+    while (rounded < this->ring_bytes)
+        rounded *= 2;
+    this->ring_bytes = rounded;
+}
+
+std::map<int, ShmFabric::Endpoint> ShmFabric::connect(int party_id, const std::vector<int> &peers, int streams)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::map<int, Endpoint> result;
+    for (int peer : peers)
+    {
+        int low = std::min(party_id, peer);
+        int high = std::max(party_id, peer);
+        Pair &pair = pairs[{low, high}];
+        if (pair.up.empty())
+        {
+            // 控制消息只有几个字节，控制连接的环取最小的大小
+            for (int k = 0; k <= streams; k++)
+            {
+                size_t capacity = k < streams ? ring_bytes : ShmRing::kShmPacket;
+                pair.up.push_back(std::make_shared<ShmRing>(capacity, link_model ? &egress[low] : nullptr, bytes_per_ns,
+                                                            delay_ns, spin));
+                pair.down.push_back(std::make_shared<ShmRing>(capacity, link_model ? &egress[high] : nullptr, bytes_per_ns,
+                                                              delay_ns, spin));
+            }
+        }
+        if ((int)pair.up.size() != streams + 1)
+            throw std::invalid_argument("all parties must use the same streams with transport=shm");
+
+        bool is_low = party_id == low;
+        const auto &out = is_low ? pair.up : pair.down;
+        const auto &in = is_low ? pair.down : pair.up;
+        Endpoint endpoint;
+        for (int k = 0; k < streams; k++)
+            endpoint.streams.push_back(new ShmIO(out[k], in[k]));
+        endpoint.control = new ShmIO(out[streams], in[streams]);
+        result[peer] = endpoint;
+    }
+    return result;
+}
+
+void ShmFabric::abort()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto &entry : pairs)
+    {
+        for (const auto &rings : {entry.second.up, entry.second.down})
+        {
+            for (const auto &ring : rings)
+                ring->close();
+        }
+    }
+}
+
+void send_segments(ShmIO *io, const std::vector<iovec> &segments)
+{
+    for (const auto &segment : segments)
+        io->out->write(segment.iov_base, segment.iov_len);
+}
+
+void recv_segments(ShmIO *io, const std::vector<iovec> &segments)
+{
+    for (const auto &segment : segments)
+        io->in->read(segment.iov_base, segment.iov_len);
+}
+
+// 两个方向是不同的环，收发线程各用一个，不需要额外同步
+void send_segments_concurrent(ShmIO *io, const std::vector<iovec> &segments) { send_segments(io, segments); }
+void recv_segments_concurrent(ShmIO *io, const std::vector<iovec> &segments) { recv_segments(io, segments); }
+
+// 条带的各份同时发出，以第 0 条连接为准
+void wait_readable(const std::vector<ShmIO *> &link) { link[0]->in->wait_readable(); }
+
+// 模拟链路时等到最后一个包离开出口队列，相当于 TCP 的数据全部发到线上
+void wait_transmitted(const std::vector<ShmIO *> &link)
+{
+    for (auto io : link)
+        io->out->wait_departed();
+}
+
+void shutdown_io(ShmIO *io)
+{
+    io->out->close();
+    io->in->close();
+}
+
+// 只有能对应上的字段：往返时延（模拟链路时）与两个方向已读取的字节数
+TcpInfo read_tcp_info(ShmIO *io)
+{
+    TcpInfo info;
+    std::memset(&info, 0, sizeof(info));
+    info.base.tcpi_rtt = (uint32_t)(2 * io->out->delay() / 1000);
+    info.min_rtt = info.base.tcpi_rtt;
+    info.bytes_acked = io->out->bytes_read();
+    info.bytes_received = io->in->bytes_read();
+    return info;
+}
+
+// 缓冲区列为环的大小
+SocketSettings read_socket_settings(ShmIO *io)
+{
+    SocketSettings settings;
+    settings.sndbuf = (int)io->out->capacity();
+    settings.rcvbuf = settings.sndbuf;
+    settings.nodelay = 1;
+    settings.congestion = "shm";
+    return settings;
+}
+
+// 环的大小与链路模型在建立 ShmFabric 时确定
+void apply_network_profile(ShmIO *, const NetworkProfile &) {}
+
+std::vector<int> allowed_cpus()
+{
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (::sched_getaffinity(0, sizeof(set), &set) == 0)
+    {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        {
+            if (CPU_ISSET(cpu, &set))
+                cpus.push_back(cpu);
+        }
+    }
+    if (cpus.empty())
+        cpus.push_back(0);
+    return cpus;
+}
+
+bool pin_current_thread(int cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set) == 0;
+}
+
+// 构造引擎时设置一次，之后各收发线程只读
+static cpu_set_t worker_cpu_set;
+static std::atomic<bool> worker_cpus_set{false};
+
+void set_worker_cpus(const std::vector<int> &cpus)
+{
+    CPU_ZERO(&worker_cpu_set);
+    for (int cpu : cpus)
+        CPU_SET(cpu, &worker_cpu_set);
+    worker_cpus_set.store(!cpus.empty());
+}
+
+void pin_worker_thread()
+{
+    if (worker_cpus_set.load())
+        ::pthread_setaffinity_np(::pthread_self(), sizeof(worker_cpu_set), &worker_cpu_set);
+}
@@ -0,0 +1,1245 @@
+// 传输层：网络配置与 socket 选项、单端口建连、各 IO 实现（SocketIO / RawSocketIO / UringIO / QuicIO / ShmIO）、
+// 执行器使用的按链路分条收发入口，以及收发共用的测试缓冲区
+#pragma once
+
+#include <emp-tool/emp-tool.h>
+#include <vector>
+#include <string>
+#include <map>
+#include <memory>
+#include <thread>
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <climits>
+#include <type_traits>
+#include <atomic>
+#include <mutex>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <csignal>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define HAVE_IO_URING 1
+#endif
+// HAVE_MSQUIC 由构建系统在找到 msquic 的头文件和库时定义
+#ifdef HAVE_MSQUIC
+#include <msquic.h>
+#include <condition_variable>
+#include <deque>
+#endif
+
+// 网络配置（network_mode 参数选择其一），应用到每一条连接的 socket 选项。
+// 配置文件中用 <名称>.<字段>=值 修改或新增，例如 wan.rtt_ms=60、wan.congestion=bbr
+struct NetworkProfile
+{
+    double bandwidth_mbps = 1000; // 链路带宽，与 rtt_ms 一起决定带宽时延积
+    double rtt_ms = 1;
+    size_t buffer_bytes = 0;      // SO_SNDBUF/SO_RCVBUF，0 表示取 2 倍带宽时延积
+    bool nodelay = true;          // TCP_NODELAY
+    std::string congestion;       // TCP_CONGESTION，空表示使用系统默认
+    int busy_poll_us = 0;         // SO_BUSY_POLL，0 表示关闭
+    int streams = 1;              // 每条逻辑链路的TCP连接数
+
+    size_t socket_buffer_bytes() const
+    {
+        if (buffer_bytes > 0)
+            return buffer_bytes;
+        return (size_t)(2 * bandwidth_mbps * 1e6 / 8 * rtt_ms / 1e3);
+    }
+};
+
+// 内置配置：lan 对应 network_config.sh 中的 10Gbit/0.1ms，wan 对应 latency.txt 中约 60ms 的跨区域链路
+std::map<std::string, NetworkProfile> default_network_profiles();
+
+// 网络配置中的单个字段，key 为去掉 "<名称>." 前缀后的部分
+bool apply_profile_option(NetworkProfile &profile, const std::string &key, const std::string &value);
+
+// 在已建立的TCP连接上实现 emp IOChannel 接口，缓冲方式与 emp::NetIO 相同（stdio 全缓冲 + 显式 flush）。
+// emp::NetIO 只能自己监听/拨号，无法接管握手完成的 socket，所以单端口建连后用它承载数据
+class SocketIO : public emp::IOChannel<SocketIO>
+{
+public:
+    int consocket;
+
+    explicit SocketIO(int fd) : consocket(fd)
+    {
+        stream = fdopen(consocket, "wb+");
+        if (!stream)
+        {
+            throw std::runtime_error(std::string("fdopen failed: ") + std::strerror(errno));
+        }
+        buffer = new char[buffer_size];
+        setvbuf(stream, buffer, _IOFBF, buffer_size);
+    }
+
+    ~SocketIO()
+    {
+        fflush(stream);
+        fclose(stream);
+        delete[] buffer;
+    }
+
+    SocketIO(const SocketIO &) = delete;
+    SocketIO &operator=(const SocketIO &) = delete;
+
+    void flush() { fflush(stream); }
+
+    void send_data_internal(const void *data, size_t len)
+    {
+        size_t sent = 0;
+        while (sent < len)
+        {
+            size_t res = fwrite(static_cast<const char *>(data) + sent, 1, len - sent, stream);
+            if (res == 0)
+                throw std::runtime_error("SocketIO send failed");
+            sent += res;
+        }
+        has_sent = true;
+    }
+
+    void recv_data_internal(void *data, size_t len)
+    {
+        if (has_sent)
+            fflush(stream);
+        has_sent = false;
+
+        size_t received = 0;
+        while (received < len)
+        {
+            size_t res = fread(static_cast<char *>(data) + received, 1, len - received, stream);
+            if (res == 0)
+                throw std::runtime_error("SocketIO recv failed: connection closed by peer");
+            received += res;
+        }
+    }
+
+private:
+    static const size_t buffer_size = 1024 * 1024;
+    FILE *stream = nullptr;
+    char *buffer = nullptr;
+    bool has_sent = false;
+};
+
+void set_blocking(int fd, bool blocking);
+
+// 把网络配置应用到 socket。在 connect/listen 之前设置缓冲区，窗口缩放才能按设置的大小协商；
+// 连接建立后会再应用一次，保证接受得到的 socket 也完整生效。设置失败只打印一次警告
+void apply_network_profile(int fd, const NetworkProfile &profile);
+
+// 内核实际生效的 socket 选项，写入连接结果CSV
+struct SocketSettings
+{
+    int sndbuf = 0;
+    int rcvbuf = 0;
+    int nodelay = 0;
+    std::string congestion;
+    int busy_poll_us = 0;
+};
+
+SocketSettings read_socket_settings(int fd);
+
+// 内核 struct tcp_info 的前一部分。glibc 的 <netinet/tcp.h> 只声明到 tcpi_total_retrans，
+// <linux/tcp.h> 又与之冲突不能同时包含，所以按内核布局补上后续字段（内核只在末尾追加字段）
+struct TcpInfo
+{
+    tcp_info base;
+    uint64_t pacing_rate;
+    uint64_t max_pacing_rate;
+    uint64_t bytes_acked;
+    uint64_t bytes_received;
+    uint32_t segs_out;
+    uint32_t segs_in;
+    uint32_t notsent_bytes;
+    uint32_t min_rtt;
+    uint32_t data_segs_in;
+    uint32_t data_segs_out;
+    uint64_t delivery_rate; // 字节/秒
+};
+
+TcpInfo read_tcp_info(int fd);
+
+// 建立到 peers 中所有对端的连接，每个对端 profile.streams 条，返回 对端编号 -> 按连接序号排列的已握手 socket。
+// 每个参与方只监听 base_port + party_id 一个端口，编号大的一方拨号编号小的一方并在握手中表明身份和连接序号；
+// 所有拨号与接受在同一个 poll 循环里并发进行，对端尚未监听时按指数退避重试，
+// 因此建连耗时取决于最慢的一方何时上线，而不是各条连接依次阻塞的总和。
+// nic_ips[p] 非空时 party p 有多块网卡：i < j 之间的第 k 条连接由 j 从自己的第 (i+k) 个地址拨向 i 的第 (j+k) 个地址
+// （下标对各自的地址数取模），连接轮流分到两端的各块网卡上；监听仍在所有地址上
+std::map<int, std::vector<int>> connect_mesh(int party_id, int num_parties, const std::vector<std::string> &ips,
+                                             int base_port, const std::vector<int> &peers, const NetworkProfile &profile,
+                                             int timeout_ms, const std::vector<std::vector<std::string>> &nic_ips = {});
+
+// 测量用的纳秒时钟。steady_clock 在 Linux 上即 CLOCK_MONOTONIC，经 vDSO 读取，不陷入内核，
+// 各核之间一致，收发线程在不同核上取的时间可以直接相减
+int64_t monotonic_ns();
+
+// 直接在socket上收发一组分段（sendmsg/recvmsg + iovec），绕过NetIO的stdio缓冲。全双工模式下收发分处两个线程，
+// 同一个FILE*的锁会让fread与fwrite互相阻塞，所以不能走send_data/recv_data。
+// 返回实际调用 sendmsg 的次数，MSG_ZEROCOPY 模式下每次调用对应一个完成通知
+size_t send_vectored(int fd, std::vector<iovec> segments, int flags = 0);
+
+void recv_vectored(int fd, std::vector<iovec> segments);
+
+// 与 recv_vectored 相同，但不在内核中阻塞：没有数据时以 MSG_DONTWAIT 反复读取，省去睡眠与唤醒的延迟，期间占满一个核
+void recv_vectored_spin(int fd, std::vector<iovec> segments);
+
+// 与 recv_vectored 相同，但最多等到 deadline_ns（monotonic_ns 的时间），返回届时已收到的字节数
+size_t recv_vectored_until(int fd, std::vector<iovec> segments, int64_t deadline_ns);
+
+// 阻塞直到 fds 中任一连接可读（数据到达、对端关闭或出错），用于把接收时间拆成等待数据与拷贝数据两部分
+void wait_readable(const std::vector<int> &fds);
+
+// 与 wait_readable 相同，但以零超时的 poll 自旋等待
+void spin_readable(const std::vector<int> &fds);
+
+// 等待 fd 上已写入内核的数据全部发到线上（SIOCOUTQNSD 为 0）。send 返回只说明数据已拷贝进发送缓冲区，
+// 之后还要等对端的接收窗口和拥塞窗口放行。不等 ACK：接收方的延迟确认会让等待多出几十毫秒，反而扭曲测量。
+// 连接出错时 ioctl 失败，直接返回交给后续收发报错
+void wait_transmitted(int fd);
+
+// 无缓冲的socket传输：数据直接从 recv_buffers 经 sendmsg(iovec) 发出，接收直接写入目标偏移，
+// 没有 stdio 缓冲的那次 memcpy，也不需要 flush。达到 zerocopy_threshold 的发送使用 MSG_ZEROCOPY，
+// 并在返回前等待内核的完成通知，保证调用返回后缓冲区可以安全改写。spin_recv 时接收与等待数据都在用户态自旋
+class RawSocketIO : public emp::IOChannel<RawSocketIO>
+{
+public:
+    int consocket;
+    bool spin_recv;
+
+    RawSocketIO(int fd, size_t zerocopy_threshold, bool spin_recv = false)
+        : consocket(fd), spin_recv(spin_recv), zerocopy_threshold(zerocopy_threshold)
+    {
+#ifdef SO_ZEROCOPY
+        if (zerocopy_threshold > 0)
+        {
+            int one = 1;
+            if (setsockopt(consocket, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) < 0)
+            {
+                std::cerr << "SO_ZEROCOPY unavailable, falling back to copying sends: " << std::strerror(errno) << std::endl;
+                this->zerocopy_threshold = 0;
+            }
+        }
+#else
+        this->zerocopy_threshold = 0;
+#endif
+    }
+
+    ~RawSocketIO() { close(consocket); }
+
+    RawSocketIO(const RawSocketIO &) = delete;
+    RawSocketIO &operator=(const RawSocketIO &) = delete;
+
+    void flush() {}
+
+    void send_data_internal(const void *data, size_t len)
+    {
+        send_segments({{const_cast<void *>(data), len}});
+    }
+
+    void recv_data_internal(void *data, size_t len)
+    {
+        recv_segments({{data, len}});
+    }
+
+    void send_segments(const std::vector<iovec> &segments)
+    {
+        size_t total = 0;
+        for (const auto &segment : segments)
+            total += segment.iov_len;
+
+#ifdef MSG_ZEROCOPY
+        if (zerocopy_threshold > 0 && total >= zerocopy_threshold)
+        {
+            zerocopy_issued += send_vectored(consocket, segments, MSG_ZEROCOPY);
+            wait_zerocopy_completions();
+            return;
+        }
+#endif
+        send_vectored(consocket, segments);
+    }
+
+    void recv_segments(const std::vector<iovec> &segments)
+    {
+        if (spin_recv)
+            recv_vectored_spin(consocket, segments);
+        else
+            recv_vectored(consocket, segments);
+    }
+
+private:
+    size_t zerocopy_threshold;
+    uint64_t zerocopy_issued = 0;
+    uint64_t zerocopy_completed = 0;
+
+    // 从 socket 错误队列读取 MSG_ZEROCOPY 完成通知，每条通知覆盖区间 [ee_info, ee_data] 内的发送调用
+    void wait_zerocopy_completions()
+    {
+#ifdef MSG_ZEROCOPY
+        while (zerocopy_completed < zerocopy_issued)
+        {
+            char control[128];
+            msghdr msg{};
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            if (::recvmsg(consocket, &msg, MSG_ERRQUEUE) < 0)
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                {
+                    pollfd pfd{consocket, 0, 0};
+                    ::poll(&pfd, 1, 100);
+                    continue;
+                }
+                throw std::runtime_error(std::string("MSG_ERRQUEUE read failed: ") + std::strerror(errno));
+            }
+
+            for (cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm))
+            {
+                auto *err = reinterpret_cast<sock_extended_err *>(CMSG_DATA(cm));
+                if (err->ee_errno == 0 && err->ee_origin == SO_EE_ORIGIN_ZEROCOPY)
+                    zerocopy_completed += err->ee_data - err->ee_info + 1;
+            }
+        }
+#endif
+    }
+};
+
+// 传输层（IO）概念：
+//   send_data / recv_data / flush  emp::IOChannel 接口
+//   consocket                      底层已连接的 socket（QuicIO、ShmIO 没有，它们重载了所有用到 consocket 的入口）
+// 下面几个函数是执行器使用的收发入口，带stdio缓冲的 IO（emp::NetIO、SocketIO）走通用版本，
+// RawSocketIO 重载为自己的无缓冲路径
+template <typename IO>
+void send_segments(IO *io, const std::vector<iovec> &segments)
+{
+    for (const auto &segment : segments)
+        io->send_data(segment.iov_base, segment.iov_len);
+    io->flush();
+}
+
+template <typename IO>
+void recv_segments(IO *io, const std::vector<iovec> &segments)
+{
+    for (const auto &segment : segments)
+        io->recv_data(segment.iov_base, segment.iov_len);
+}
+
+// 测试缓冲区分配后通知传输层，默认什么都不做
+template <typename IO>
+void register_buffer(IO *, void *, size_t) {}
+
+// 全双工/流水线模式下同一连接的收发在不同线程进行，带缓冲的 IO 绕过缓冲直接使用 socket
+template <typename IO>
+void send_segments_concurrent(IO *io, const std::vector<iovec> &segments)
+{
+    send_vectored(io->consocket, segments);
+}
+
+template <typename IO>
+void recv_segments_concurrent(IO *io, const std::vector<iovec> &segments)
+{
+    recv_vectored(io->consocket, segments);
+}
+
+void send_segments(RawSocketIO *io, const std::vector<iovec> &segments);
+void recv_segments(RawSocketIO *io, const std::vector<iovec> &segments);
+void send_segments_concurrent(RawSocketIO *io, const std::vector<iovec> &segments);
+void recv_segments_concurrent(RawSocketIO *io, const std::vector<iovec> &segments);
+void wait_readable(const std::vector<RawSocketIO *> &link);
+
+// 把一组分段按字节数均分成 parts 份，第 k 份走第 k 条连接；两端按同样的规则切分，接收方直接写回原偏移
+std::vector<std::vector<iovec>> split_segments(const std::vector<iovec> &segments, size_t parts);
+
+// 收发线程可以使用的 CPU（配置项 cpus 中除第一个以外的），空表示不限制。进程内所有引擎共用一份
+void set_worker_cpus(const std::vector<int> &cpus);
+
+// 收发线程开始时调用，把自己限制在 set_worker_cpus 指定的 CPU 上
+void pin_worker_thread();
+
+// 每条连接一个线程并行执行 fn(k)，全部结束后抛出第一个异常
+template <typename Fn>
+void for_each_stream(size_t streams, Fn &&fn)
+{
+    if (streams == 1)
+    {
+        fn(0);
+        return;
+    }
+
+    std::vector<std::exception_ptr> errors(streams);
+    std::vector<std::thread> workers;
+    for (size_t k = 0; k < streams; k++)
+    {
+        workers.emplace_back([&, k]()
+                             {
+            pin_worker_thread();
+            try
+            {
+                fn(k);
+            }
+            catch (...)
+            {
+                errors[k] = std::current_exception();
+            } });
+    }
+    for (auto &worker : workers)
+        worker.join();
+    for (auto &error : errors)
+    {
+        if (error)
+            std::rethrow_exception(error);
+    }
+}
+
+// 一条逻辑链路由 K 条 TCP 连接组成，每一步的数据均分到各条连接上同时传输，
+// 避免单条连接的拥塞窗口限制高带宽时延积链路的吞吐
+template <typename IO>
+void send_striped(const std::vector<IO *> &link, const std::vector<iovec> &segments)
+{
+    auto parts = split_segments(segments, link.size());
+    for_each_stream(link.size(), [&](size_t k)
+                    { send_segments(link[k], parts[k]); });
+}
+
+template <typename IO>
+void recv_striped(const std::vector<IO *> &link, const std::vector<iovec> &segments)
+{
+    auto parts = split_segments(segments, link.size());
+    for_each_stream(link.size(), [&](size_t k)
+                    { recv_segments(link[k], parts[k]); });
+}
+
+template <typename IO>
+void send_striped_concurrent(const std::vector<IO *> &link, const std::vector<iovec> &segments)
+{
+    auto parts = split_segments(segments, link.size());
+    for_each_stream(link.size(), [&](size_t k)
+                    { send_segments_concurrent(link[k], parts[k]); });
+}
+
+template <typename IO>
+void recv_striped_concurrent(const std::vector<IO *> &link, const std::vector<iovec> &segments)
+{
+    auto parts = split_segments(segments, link.size());
+    for_each_stream(link.size(), [&](size_t k)
+                    { recv_segments_concurrent(link[k], parts[k]); });
+}
+
+#ifdef HAVE_IO_URING
+// 直接基于系统调用的最小 io_uring 封装（不依赖 liburing）。一个参与方的所有连接共用一个 ring，
+// 每一步的发送和接收作为一对请求一起提交，由一个线程等待两者完成
+class IoUring
+{
+public:
+
+    IoUring(unsigned entries, bool sqpoll) : sqpoll(sqpoll)
+    {
+        io_uring_params params{};
+        if (sqpoll)
+        {
+            // 内核线程轮询提交队列，提交请求不再需要系统调用
+            params.flags |= IORING_SETUP_SQPOLL;
+            params.sq_thread_idle = 1000;
+        }
+        ring_fd = syscall(__NR_io_uring_setup, entries, &params);
+        if (ring_fd < 0)
+        {
+            throw std::runtime_error(std::string("io_uring_setup failed: ") + std::strerror(errno));
+        }
+
+        sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap)
+            sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+
+        sq_ring = map_region(sq_ring_size, IORING_OFF_SQ_RING);
+        cq_ring = single_mmap ? sq_ring : map_region(cq_ring_size, IORING_OFF_CQ_RING);
+        sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe *>(map_region(sqes_size, IORING_OFF_SQES));
+
+        char *sq = static_cast<char *>(sq_ring);
+        sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        sq_mask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        sq_flags = reinterpret_cast<unsigned *>(sq + params.sq_off.flags);
+        sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+
+        char *cq = static_cast<char *>(cq_ring);
+        cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        cq_mask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+        // 写已关闭的socket时避免 SIGPIPE 终止进程，错误由完成事件返回
+        std::signal(SIGPIPE, SIG_IGN);
+    }
+
+    ~IoUring()
+    {
+        munmap(sqes, sqes_size);
+        if (cq_ring != sq_ring)
+            munmap(cq_ring, cq_ring_size);
+        munmap(sq_ring, sq_ring_size);
+        close(ring_fd);
+    }
+
+    IoUring(const IoUring &) = delete;
+    IoUring &operator=(const IoUring &) = delete;
+
+    // 把缓冲区注册为固定缓冲区，落在其中的发送使用 WRITE_FIXED，省去每次请求的页面 pin/unpin。
+    // 注册受 RLIMIT_MEMLOCK 限制，失败时退回普通请求
+    void register_buffer(void *base, size_t len)
+    {
+        if (base == registered_base && len == registered_len)
+            return;
+
+        if (registered_base)
+        {
+            syscall(__NR_io_uring_register, ring_fd, IORING_UNREGISTER_BUFFERS, nullptr, 0);
+            registered_base = nullptr;
+            registered_len = 0;
+        }
+
+        iovec region{base, len};
+        if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_BUFFERS, &region, 1) < 0)
+        {
+            if (!register_warned)
+                std::cerr << "io_uring buffer registration failed, using unregistered sends: " << std::strerror(errno) << std::endl;
+            register_warned = true;
+            return;
+        }
+        registered_base = base;
+        registered_len = len;
+    }
+
+    // 一个方向上的一组分段：fd 上依次发送或接收 segments，end_ns 记录最后一段完成的时间
+    struct Transfer
+    {
+        int fd;
+        bool is_send;
+        std::vector<iovec> segments;
+        int64_t *end_ns = nullptr;
+    };
+
+    // 同时推进若干个方向的传输，每个方向同一时刻只有一个请求在途，请求提前返回时继续提交剩余部分
+    void transfer(std::vector<Transfer> transfers)
+    {
+        std::vector<size_t> next(transfers.size(), 0);
+        size_t inflight = 0;
+        for (uint64_t tag = 0; tag < transfers.size(); tag++)
+        {
+            if (!transfers[tag].segments.empty())
+            {
+                prepare(transfers[tag].fd, transfers[tag].is_send, transfers[tag].segments[0], tag);
+                inflight++;
+            }
+        }
+        submit();
+
+        while (inflight > 0)
+        {
+            io_uring_cqe cqe = wait_cqe();
+            Transfer &dir = transfers[cqe.user_data];
+            size_t &index = next[cqe.user_data];
+            iovec &segment = dir.segments[index];
+            if (cqe.res < 0 && cqe.res != -EINTR && cqe.res != -EAGAIN)
+            {
+                throw std::runtime_error(std::string(dir.is_send ? "send" : "recv") + " failed: " + std::strerror(-cqe.res));
+            }
+            if (cqe.res == 0 && !dir.is_send)
+            {
+                throw std::runtime_error("recv failed: connection closed by peer");
+            }
+
+            if (cqe.res > 0)
+            {
+                segment.iov_base = static_cast<uint8_t *>(segment.iov_base) + cqe.res;
+                segment.iov_len -= cqe.res;
+                if (segment.iov_len == 0)
+                    index++;
+            }
+
+            if (index < dir.segments.size())
+            {
+                prepare(dir.fd, dir.is_send, dir.segments[index], cqe.user_data);
+                submit();
+            }
+            else
+            {
+                inflight--;
+                if (dir.end_ns)
+                    *dir.end_ns = monotonic_ns();
+            }
+        }
+    }
+
+private:
+    int ring_fd;
+    bool sqpoll;
+    void *sq_ring;
+    void *cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned *sq_flags;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    io_uring_cqe *cqes;
+    unsigned to_submit = 0;
+
+    void *registered_base = nullptr;
+    size_t registered_len = 0;
+    bool register_warned = false;
+
+    void *map_region(size_t size, off_t offset)
+    {
+        void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, offset);
+        if (ptr == MAP_FAILED)
+        {
+            throw std::runtime_error(std::string("io_uring mmap failed: ") + std::strerror(errno));
+        }
+        return ptr;
+    }
+
+    void prepare(int fd, bool is_send, const iovec &segment, uint64_t tag)
+    {
+        unsigned tail = *sq_tail;
+        unsigned index = tail & sq_mask;
+        io_uring_sqe &sqe = sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.fd = fd;
+        sqe.addr = reinterpret_cast<uint64_t>(segment.iov_base);
+        sqe.len = segment.iov_len;
+        sqe.user_data = tag;
+
+        uint8_t *begin = static_cast<uint8_t *>(segment.iov_base);
+        uint8_t *region = static_cast<uint8_t *>(registered_base);
+        if (is_send && registered_base && begin >= region && begin + segment.iov_len <= region + registered_len)
+        {
+            sqe.opcode = IORING_OP_WRITE_FIXED;
+            sqe.buf_index = 0;
+        }
+        else if (is_send)
+        {
+            sqe.opcode = IORING_OP_SEND;
+            sqe.msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+        }
+        else
+        {
+            // 接收直接写入目标偏移，MSG_WAITALL 让内核凑满整段后再完成，大消息也只有一个完成事件
+            sqe.opcode = IORING_OP_RECV;
+            sqe.msg_flags = MSG_WAITALL;
+        }
+
+        sq_array[index] = index;
+        __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+        to_submit++;
+    }
+
+    void submit()
+    {
+        if (sqpoll)
+        {
+            // 轮询线程空闲休眠后需要唤醒一次
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            if (__atomic_load_n(sq_flags, __ATOMIC_RELAXED) & IORING_SQ_NEED_WAKEUP)
+                enter(0, 0, IORING_ENTER_SQ_WAKEUP);
+            to_submit = 0;
+            return;
+        }
+        enter(to_submit, 0, 0);
+        to_submit = 0;
+    }
+
+    io_uring_cqe wait_cqe()
+    {
+        while (true)
+        {
+            unsigned head = *cq_head;
+            if (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE))
+            {
+                io_uring_cqe cqe = cqes[head & cq_mask];
+                __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+                return cqe;
+            }
+            // SQPOLL 模式下在用户态自旋等待完成事件，其余情况阻塞在 io_uring_enter
+            if (!sqpoll)
+                enter(0, 1, IORING_ENTER_GETEVENTS);
+        }
+    }
+
+    void enter(unsigned submit_count, unsigned min_complete, unsigned flags)
+    {
+        while (syscall(__NR_io_uring_enter, ring_fd, submit_count, min_complete, flags, nullptr, 0) < 0)
+        {
+            if (errno != EINTR)
+                throw std::runtime_error(std::string("io_uring_enter failed: ") + std::strerror(errno));
+        }
+    }
+};
+
+// io_uring 传输：连接由单端口建连得到，收发提交到共享的 ring
+class UringIO : public emp::IOChannel<UringIO>
+{
+public:
+    int consocket;
+    std::shared_ptr<IoUring> ring;
+
+    UringIO(int fd, std::shared_ptr<IoUring> ring) : consocket(fd), ring(std::move(ring)) {}
+
+    ~UringIO() { close(consocket); }
+
+    UringIO(const UringIO &) = delete;
+    UringIO &operator=(const UringIO &) = delete;
+
+    void flush() {}
+
+    void send_data_internal(const void *data, size_t len)
+    {
+        ring->transfer({{consocket, true, {{const_cast<void *>(data), len}}}});
+    }
+
+    void recv_data_internal(void *data, size_t len)
+    {
+        ring->transfer({{consocket, false, {{data, len}}}});
+    }
+};
+
+void register_buffer(UringIO *io, void *base, size_t len);
+
+// 多连接时所有连接的请求一起提交到 ring，不需要每条连接一个线程
+void send_striped(const std::vector<UringIO *> &link, const std::vector<iovec> &segments);
+
+void recv_striped(const std::vector<UringIO *> &link, const std::vector<iovec> &segments);
+
+// 一步的发送和接收一起提交，没有发送线程；ring 不是线程安全的，不支持每条连接一个线程的流水线模式
+void exchange_striped(const std::vector<UringIO *> &send_link, const std::vector<iovec> &send,
+                      const std::vector<UringIO *> &recv_link, const std::vector<iovec> &recv,
+                      int64_t &send_end_ns, int64_t &recv_end_ns);
+#endif
+
+// QUIC 传输的参数，与是否构建了 msquic 无关，便于统一解析配置
+struct QuicSettings
+{
+    std::string cert_file;             // 接受连接的一方（编号小的一方）的证书，PEM
+    std::string key_file;              // 对应的私钥，PEM
+    std::string ticket_dir = ".";      // 会话恢复票据与票据密钥所在的目录，空表示不做会话恢复
+};
+
+#ifdef HAVE_MSQUIC
+class QuicIO;
+
+// 一个参与方所有 QUIC 连接共用的 msquic 注册、配置与监听。设置由网络配置换算：
+// 流/连接的接收窗口取 socket 缓冲区大小，congestion=bbr 时使用 BBR，其余为 CUBIC
+class QuicContext : public std::enable_shared_from_this<QuicContext>
+{
+public:
+    const QUIC_API_TABLE *api = nullptr;
+    HQUIC registration = nullptr;
+    HQUIC server_configuration = nullptr; // 有证书时才创建
+    HQUIC client_configuration = nullptr;
+    QuicSettings settings;
+    size_t recv_window = 0;
+    bool bbr = false;
+
+    QuicContext(const NetworkProfile &profile, const QuicSettings &settings, int party_id, bool accepts);
+    ~QuicContext();
+
+    QuicContext(const QuicContext &) = delete;
+    QuicContext &operator=(const QuicContext &) = delete;
+
+    // 在 UDP 端口 port 上接受连接，接入的连接由 take_accepted 取走
+    void listen(int port);
+    std::vector<std::unique_ptr<QuicIO>> take_accepted();
+    // 停止监听，尚未取走的连接随之关闭
+    void stop_listening();
+
+private:
+    HQUIC listener = nullptr;
+    std::mutex accepted_mutex;
+    std::vector<std::unique_ptr<QuicIO>> accepted;
+
+    static QUIC_STATUS QUIC_API listener_callback(HQUIC listener, void *context, QUIC_LISTENER_EVENT *event);
+};
+
+// QUIC 传输：一条 QUIC 连接对应 TCP 下的一条连接（streams=K 时每条链路 K 条连接，各有独立的拥塞控制）。
+// 每次发送调用（一步、条带中的一份或流水线的一个分块）打开一条新的单向流并以 FIN 结束，
+// 一条流上的丢包重传不会阻塞其他步骤已到达的数据。接收方按流编号把各条流首尾相接还原成字节序列，
+// 收发两端的调用边界不必一一对应。收到的数据先缓存在用户态，再拷贝到目标偏移。
+// 拨号方保存服务端下发的会话恢复票据，下一次运行时带上票据恢复会话，身份握手随 0-RTT 数据发出
+class QuicIO : public emp::IOChannel<QuicIO>
+{
+public:
+    // 拨号到 host:port；ticket_file 非空时读取其中的票据用于恢复会话，并在收到新票据时写回
+    QuicIO(std::shared_ptr<QuicContext> context, const std::string &host, int port, const std::string &ticket_file);
+    // 接管监听到的连接，回调与配置由 QuicContext 设置
+    QuicIO(std::shared_ptr<QuicContext> context, HQUIC connection)
+        : context(std::move(context)), connection(connection), accepting(true) {}
+    ~QuicIO();
+
+    QuicIO(const QuicIO &) = delete;
+    QuicIO &operator=(const QuicIO &) = delete;
+
+    void flush() {}
+
+    void send_data_internal(const void *data, size_t len) { send_segments({{const_cast<void *>(data), len}}); }
+    void recv_data_internal(void *data, size_t len) { recv_segments({{data, len}}); }
+
+    // 返回时 msquic 已不再引用这些缓冲区
+    void send_segments(const std::vector<iovec> &segments);
+    void recv_segments(const std::vector<iovec> &segments);
+
+    // 不等待完成地在一条新流上发送一条小消息（身份握手），缓冲区由 QuicIO 保管到连接关闭
+    void send_message(std::vector<uint8_t> message);
+    // 不阻塞地从当前流读取 len 字节，数据尚未全部到达时不消耗任何数据并返回 false
+    bool try_recv(void *data, size_t len);
+
+    enum class State
+    {
+        Handshaking,
+        Connected,
+        Closed
+    };
+    State state();
+    bool resumed() const { return session_resumed; }
+    const QuicContext &quic_context() const { return *context; }
+
+    void wait_readable();
+    // 关闭连接，唤醒阻塞在本连接上的收发
+    void abort();
+    TcpInfo statistics() const;
+
+private:
+    friend class QuicContext;
+
+    std::shared_ptr<QuicContext> context;
+    HQUIC connection = nullptr;
+    bool accepting;
+    std::string ticket_file;
+    bool session_resumed = false;
+
+    // msquic 在 SEND_COMPLETE 之前一直引用 QUIC_BUFFER 数组和数据
+    struct SendCompletion
+    {
+        bool done = false;
+        bool canceled = false;
+    };
+    struct OwnedMessage
+    {
+        std::vector<uint8_t> data;
+        QUIC_BUFFER buffer;
+        SendCompletion completion;
+    };
+
+    // 已到达的一条流：收到的缓冲区依次排队，fin 表示对端已结束这条流
+    struct RecvStream
+    {
+        std::deque<std::vector<uint8_t>> chunks;
+        size_t head_offset = 0; // chunks.front() 中已读取的字节数
+        size_t available = 0;
+        bool fin = false;
+    };
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    State connection_state = State::Handshaking;
+    std::map<uint64_t, RecvStream> recv_streams; // 流序号 -> 数据，读完的流即删除
+    std::map<HQUIC, uint64_t> stream_index;      // 对端流句柄 -> 流序号
+    uint64_t next_recv = 0;                      // 当前读取的流序号
+    size_t open_send_streams = 0;                // 尚未被对端确认完的发送流
+    std::deque<OwnedMessage> messages;
+
+    void start_send(const QUIC_BUFFER *buffers, uint32_t count, SendCompletion *completion);
+    size_t readable_locked();
+    void consume_locked(uint8_t *data, size_t len);
+
+    static QUIC_STATUS QUIC_API connection_callback(HQUIC connection, void *context, QUIC_CONNECTION_EVENT *event);
+    static QUIC_STATUS QUIC_API send_stream_callback(HQUIC stream, void *context, QUIC_STREAM_EVENT *event);
+    static QUIC_STATUS QUIC_API recv_stream_callback(HQUIC stream, void *context, QUIC_STREAM_EVENT *event);
+};
+
+// 建立到 peers 中所有对端的 QUIC 连接，每个对端 streams 条。与 connect_mesh 相同：每个参与方监听 UDP 端口
+// base_port + party_id，编号大的一方拨号并在第一条流上发送身份握手；对端尚未上线时按指数退避重拨
+std::map<int, std::vector<QuicIO *>> connect_quic_mesh(const std::shared_ptr<QuicContext> &context, int party_id,
+                                                      int num_parties, const std::vector<std::string> &ips,
+                                                      int base_port, const std::vector<int> &peers, int streams,
+                                                      int timeout_ms);
+
+void send_segments(QuicIO *io, const std::vector<iovec> &segments);
+void recv_segments(QuicIO *io, const std::vector<iovec> &segments);
+void send_segments_concurrent(QuicIO *io, const std::vector<iovec> &segments);
+void recv_segments_concurrent(QuicIO *io, const std::vector<iovec> &segments);
+void wait_readable(const std::vector<QuicIO *> &link);
+void wait_transmitted(const std::vector<QuicIO *> &link);
+void shutdown_io(QuicIO *io);
+TcpInfo read_tcp_info(QuicIO *io);
+SocketSettings read_socket_settings(QuicIO *io);
+void apply_network_profile(QuicIO *io, const NetworkProfile &profile);
+#endif
+
+// 同一进程内两个参与方线程之间单向的无锁单生产者/单消费者环形缓冲区。生产者按不超过 kShmPacket 的包写入，
+// 每个包附带一个可见时间：不模拟链路时为 0（写入即可读），模拟链路时由发送方的出口队列按带宽排队，
+// 再加上单向时延，接收方只能读到可见时间已过的包。等不到数据或空间时先自旋，再在 futex 上睡眠
+class ShmRing
+{
+public:
+    static constexpr size_t kShmPacket = 64 * 1024;
+
+    // 模拟的发送方网卡：同一参与方所有发出的环共用，按带宽依次排队
+    struct Egress
+    {
+        std::atomic<int64_t> free_ns{0}; // 出口队列空出的时刻
+    };
+
+    // capacity 向上取 2 的幂；egress 为空时不模拟链路
+    ShmRing(size_t capacity, Egress *egress, double bytes_per_ns, int64_t delay_ns, bool spin);
+    ~ShmRing();
+
+    ShmRing(const ShmRing &) = delete;
+    ShmRing &operator=(const ShmRing &) = delete;
+
+    // 写完或读满 len 字节才返回；环关闭后抛出异常
+    void write(const void *data, size_t len);
+    void read(void *data, size_t len);
+    // 等到有可读的数据（或环已关闭）
+    void wait_readable();
+    // 等到最后写入的包离开发送方的出口队列，不模拟链路时立即返回
+    void wait_departed();
+    // 关闭环，唤醒两端
+    void close();
+
+    size_t capacity() const { return size; }
+    int64_t delay() const { return delay_ns; }
+    uint64_t bytes_read() const { return tail.load(); }
+
+private:
+    struct Marker
+    {
+        uint64_t end;          // 包结束处的写入位置
+        int64_t visible_ns;    // monotonic_ns 时间，之后才能读取
+    };
+    static constexpr size_t kMarkers = 4096;
+
+    uint8_t *buffer;
+    size_t size;
+    Egress *egress;
+    double bytes_per_ns;
+    int64_t delay_ns;
+    bool spin;
+    std::atomic<bool> closed{false};
+
+    // 生产者一侧
+    alignas(64) uint64_t head = 0;             // 已写入的字节数
+    int64_t last_departure_ns = 0;
+    std::atomic<uint64_t> marker_head{0};      // 已发布的包数
+    std::atomic<uint32_t> data_seq{0};         // 每发布一个包加一，消费者在其上等待
+    std::atomic<bool> consumer_waiting{false};
+
+    // 消费者一侧
+    alignas(64) std::atomic<uint64_t> tail{0}; // 已读取的字节数
+    uint64_t visible_end = 0;                  // 可见时间已过的数据的结束位置
+    std::atomic<uint64_t> marker_tail{0};      // 已取走的包数
+    std::atomic<uint32_t> space_seq{0};        // 每释放一次空间加一，生产者在其上等待
+    std::atomic<bool> producer_waiting{false};
+
+    Marker markers[kMarkers];
+
+    template <typename Ready>
+    void wait(std::atomic<uint32_t> &seq, std::atomic<bool> &waiting, Ready ready);
+    void notify(std::atomic<uint32_t> &seq, std::atomic<bool> &waiting);
+    // 取走可见时间已过的包，返回下一个包的可见时间（没有已发布的包时为 -1）
+    int64_t advance_markers();
+};
+
+// 同一进程内以线程运行的参与方之间的连接：每个方向每条连接一个 ShmRing
+class ShmIO : public emp::IOChannel<ShmIO>
+{
+public:
+    ShmIO(std::shared_ptr<ShmRing> out, std::shared_ptr<ShmRing> in) : out(std::move(out)), in(std::move(in)) {}
+
+    void flush() {}
+    void send_data_internal(const void *data, size_t len) { out->write(data, len); }
+    void recv_data_internal(void *data, size_t len) { in->read(data, len); }
+
+    std::shared_ptr<ShmRing> out;
+    std::shared_ptr<ShmRing> in;
+};
+
+// transport=shm 时所有参与方线程共用的链路：每对参与方之间的数据连接与一条控制连接由先建连的一方创建，
+// 控制连接同样是一对环（参与方多时 socket 会耗尽 fd）。link_model 为 true 时按网络配置模拟链路：
+// 每个参与方的出口按 bandwidth_mbps 排队（与 network_config.sh 在网卡上限速相同），再加上 rtt_ms / 2 的单向时延
+class ShmFabric
+{
+public:
+    // 一个对端的链路：streams 条数据连接与一条控制连接，都由参与方释放
+    struct Endpoint
+    {
+        std::vector<ShmIO *> streams;
+        ShmIO *control = nullptr;
+    };
+
+    ShmFabric(int num_parties, const NetworkProfile &profile, size_t ring_bytes, bool link_model);
+
+    ShmFabric(const ShmFabric &) = delete;
+    ShmFabric &operator=(const ShmFabric &) = delete;
+
+    std::map<int, Endpoint> connect(int party_id, const std::vector<int> &peers, int streams);
+    // 关闭所有环，唤醒阻塞在上面的参与方（某个参与方出错退出时使用）
+    void abort();
+
+    size_t ring_capacity() const { return ring_bytes; }
+    bool modeled() const { return link_model; }
+
+private:
+    // 每个方向 streams 条数据连接的环，最后一个是控制连接的环
+    struct Pair
+    {
+        std::vector<std::shared_ptr<ShmRing>> up;   // 编号小的一方发给编号大的一方
+        std::vector<std::shared_ptr<ShmRing>> down; // 反方向
+    };
+
+    int num_parties;
+    size_t ring_bytes;
+    bool link_model;
+    bool spin;
+    double bytes_per_ns;
+    int64_t delay_ns;
+    std::unique_ptr<ShmRing::Egress[]> egress;
+    std::mutex mutex;
+    std::map<std::pair<int, int>, Pair> pairs;
+};
+
+void send_segments(ShmIO *io, const std::vector<iovec> &segments);
+void recv_segments(ShmIO *io, const std::vector<iovec> &segments);
+void send_segments_concurrent(ShmIO *io, const std::vector<iovec> &segments);
+void recv_segments_concurrent(ShmIO *io, const std::vector<iovec> &segments);
+void wait_readable(const std::vector<ShmIO *> &link);
+void wait_transmitted(const std::vector<ShmIO *> &link);
+void shutdown_io(ShmIO *io);
+TcpInfo read_tcp_info(ShmIO *io);
+SocketSettings read_socket_settings(ShmIO *io);
+void apply_network_profile(ShmIO *io, const NetworkProfile &profile);
+
+// 进程可以使用的 CPU 编号，按升序
+std::vector<int> allowed_cpus();
+
+// 把调用线程绑定到一个 CPU 上，失败时返回 false
+bool pin_current_thread(int cpu);
+
+// IO 是否在用户态缓冲接收的数据。带缓冲的 IO 可能已把后续数据预读进缓冲区，此时 socket 不再可读，
+// 不能用 poll 判断数据何时到达
+template <typename IO>
+struct is_buffered_io : std::true_type
+{
+};
+
+template <>
+struct is_buffered_io<RawSocketIO> : std::false_type
+{
+};
+
+#ifdef HAVE_IO_URING
+template <>
+struct is_buffered_io<UringIO> : std::false_type
+{
+};
+#endif
+
+template <>
+struct is_buffered_io<ShmIO> : std::false_type
+{
+};
+
+#ifdef HAVE_MSQUIC
+// QuicIO 的 wait_readable 直接检查用户态缓存，同样能测出数据何时到达
+template <>
+struct is_buffered_io<QuicIO> : std::false_type
+{
+};
+#endif
+
+template <typename IO>
+void wait_readable(const std::vector<IO *> &link)
+{
+    std::vector<int> fds;
+    for (auto io : link)
+        fds.push_back(io->consocket);
+    wait_readable(fds);
+}
+
+template <typename IO>
+void wait_transmitted(const std::vector<IO *> &link)
+{
+    for (auto io : link)
+        wait_transmitted(io->consocket);
+}
+
+// 出错时关闭连接，唤醒阻塞在其上的收发线程
+template <typename IO>
+void shutdown_io(IO *io)
+{
+    ::shutdown(io->consocket, SHUT_RDWR);
+}
+
+template <typename IO>
+TcpInfo read_tcp_info(IO *io)
+{
+    return read_tcp_info(io->consocket);
+}
+
+template <typename IO>
+SocketSettings read_socket_settings(IO *io)
+{
+    return read_socket_settings(io->consocket);
+}
+
+// 在已建立的连接上重新应用网络配置（守护进程切换网络配置时）
+template <typename IO>
+void apply_network_profile(IO *io, const NetworkProfile &profile)
+{
+    apply_network_profile(io->consocket, profile);
+}
+
+// 本机 IP 所在网卡的 NUMA 节点；找不到网卡或网卡没有 NUMA 信息（回环、虚拟网卡、单节点机器）时为 -1
+int nic_numa_node(const std::string &ip);
+
+// 测试缓冲区：按扫描中最大的数据大小一次性分配，所有轮次和传输层复用。优先使用 hugetlbfs 大页
+// （1GB 仅在区域不小于 1GB 时尝试），没有预留大页时退回透明大页；可绑定到指定 NUMA 节点。
+// 分配后立即逐页写入完成缺页，计时迭代中不再发生缺页。
+// 流式输出时改为映射一个输出文件（或不预先缺页的匿名内存），已完成的块由 release 交还内核，常驻内存只剩在途的块
+class BufferArena
+{
+public:
+    BufferArena() = default;
+    ~BufferArena() { release(); }
+
+    BufferArena(const BufferArena &) = delete;
+    BufferArena &operator=(const BufferArena &) = delete;
+
+    // huge_pages 为 auto / off / 2m / 1g，numa_node < 0 表示不绑定；backing_file 非空时映射该文件（不使用大页），
+    // prefault 为 false 时不预先缺页
+    void allocate(size_t bytes, const std::string &huge_pages, int numa_node, const std::string &backing_file = "",
+                  bool prefault = true)
+    {
+        release();
+
+        page_size = sysconf(_SC_PAGESIZE);
+        const size_t small_page = page_size;
+        if (!backing_file.empty())
+        {
+            file_fd = ::open(backing_file.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if (file_fd < 0 || ftruncate(file_fd, bytes) != 0)
+                throw std::runtime_error("Failed to create " + backing_file + ": " + std::strerror(errno));
+        }
+
+        auto try_map = [&](int flags, size_t page, const char *kind)
+        {
+            size_t len = (bytes + page - 1) / page * page;
+            void *ptr = file_fd >= 0 ? mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, file_fd, 0)
+                                     : mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+            if (ptr == MAP_FAILED)
+                return false;
+            base = static_cast<uint8_t *>(ptr);
+            mapped = len;
+            page_kind = kind;
+            return true;
+        };
+
+        bool mapped_huge = false;
+        if (file_fd >= 0)
+        {
+            if (!try_map(0, small_page, "file"))
+                throw std::runtime_error("Failed to map " + backing_file + ": " + std::strerror(errno));
+            mapped_huge = true;
+        }
+        if (!mapped_huge && (huge_pages == "1g" || (huge_pages == "auto" && bytes >= (size_t(1) << 30))))
+            mapped_huge = try_map(MAP_HUGETLB | (30 << MAP_HUGE_SHIFT), size_t(1) << 30, "1GB");
+        if (!mapped_huge && huge_pages != "off")
+            mapped_huge = try_map(MAP_HUGETLB | (21 << MAP_HUGE_SHIFT), size_t(2) << 20, "2MB");
+        if (!mapped_huge)
+        {
+            if (!try_map(0, small_page, "4KB"))
+                throw std::runtime_error(std::string("Buffer allocation failed: ") + std::strerror(errno));
+            if (huge_pages != "off" && madvise(base, mapped, MADV_HUGEPAGE) == 0)
+                page_kind = "THP";
+        }
+
+        // 必须在缺页之前设置内存策略，页面才会分配在目标节点上
+        if (numa_node >= 0)
+        {
+            std::vector<unsigned long> mask(numa_node / (8 * sizeof(unsigned long)) + 1, 0);
+            mask[numa_node / (8 * sizeof(unsigned long))] |= 1UL << (numa_node % (8 * sizeof(unsigned long)));
+            if (syscall(SYS_mbind, base, mapped, MPOL_BIND, mask.data(), mask.size() * 8 * sizeof(unsigned long) + 1, 0) != 0)
+            {
+                std::cerr << "Warning: failed to bind buffers to NUMA node " << numa_node << ": " << std::strerror(errno) << std::endl;
+                numa_node = -1;
+            }
+        }
+        node = numa_node;
+
+        if (prefault)
+        {
+            for (size_t offset = 0; offset < mapped; offset += small_page)
+                base[offset] = 0;
+        }
+        length = bytes;
+    }
+
+    // 把 [offset, offset + len) 内完整的页交还内核，区域两端与相邻数据共用的页保留。
+    // 文件映射先启动回写，数据留在文件中；匿名内存的内容被丢弃，下次访问时重新缺页得到零页
+    void release_range(size_t offset, size_t len)
+    {
+        size_t begin = (offset + page_size - 1) / page_size * page_size;
+        size_t end = (offset + len) / page_size * page_size;
+        if (begin >= end)
+            return;
+        if (file_fd >= 0)
+            sync_file_range(file_fd, begin, end - begin, SYNC_FILE_RANGE_WRITE);
+        madvise(base + begin, end - begin, MADV_DONTNEED);
+    }
+
+    uint8_t *data() { return base; }
+    const uint8_t *data() const { return base; }
+    size_t size() const { return length; }
+    uint8_t &operator[](size_t index) { return base[index]; }
+
+    const char *pages() const { return page_kind; } // 1GB / 2MB / THP / 4KB / file
+    int numa_node() const { return node; }
+
+private:
+    uint8_t *base = nullptr;
+    size_t length = 0;
+    size_t mapped = 0;
+    size_t page_size = 4096;
+    const char *page_kind = "";
+    int node = -1;
+    int file_fd = -1;
+
+    void release()
+    {
+        if (base)
+            munmap(base, mapped);
+        if (file_fd >= 0)
+            close(file_fd);
+        base = nullptr;
+        length = 0;
+        mapped = 0;
+        file_fd = -1;
+    }
+};
+